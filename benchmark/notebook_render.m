@@ -0,0 +1,37 @@
+# Time the redraw of line plots with the notebook toolkit, drawing the
+# vertices one by one or in batches (see notebook_options("batch_vertices")).
+#
+# Run it in a cell of an xeus-octave notebook:
+#
+#   run benchmark/notebook_render.m
+
+graphics_toolkit notebook
+
+old = notebook_options("batch_vertices");
+repeats = 5;
+
+printf("%10s %8s %12s\n", "points", "batched", "drawnow [s]");
+
+for n = [1e6 1e7]
+  h = figure();
+  l = plot(rand(1, n));
+
+  for batch = [false true]
+    notebook_options("batch_vertices", batch);
+    elapsed = 0;
+
+    for r = 1:repeats
+      # Changing the data forces a complete redraw
+      set(l, "ydata", rand(1, n));
+      tic();
+      drawnow();
+      elapsed += toc();
+    end
+
+    printf("%10d %8d %12.3f\n", n, batch, elapsed / repeats);
+  end
+
+  close(h);
+end
+
+notebook_options("batch_vertices", old);
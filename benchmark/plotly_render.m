@@ -0,0 +1,67 @@
+# Time the serialisation of a large figure with the plotly toolkit, sent as a
+# display_data message built with nl::json, or over the figure channel as a
+# document written straight from the points (see plotly_options("comm")).
+# The figures sent over the channel are published again at the end of the
+# cell, which __plotly_flush__ does here, and is timed with them.
+#
+# All the points are sent every time: the lines are not decimated, and the
+# figures are not sent as what changed since the last ones.
+#
+# Run it in a cell of a notebook which loads the kernel.js of the kernelspec
+# (the classic notebook), with Plotly available, so that the channel is open:
+#
+#   run benchmark/plotly_render.m
+
+graphics_toolkit plotly
+
+old_comm = plotly_options("comm");
+old_typed = plotly_options("typed_arrays");
+old_decimation = plotly_options("decimation");
+old_incremental = plotly_options("incremental");
+
+plotly_options("decimation", "none");
+plotly_options("incremental", false);
+
+traces = 100;
+points = 1e5;
+repeats = 3;
+
+h = figure();
+hold on;
+l = zeros(1, traces);
+for i = 1:traces
+  l(i) = plot(1:points, rand(1, points));
+end
+
+printf("%6s %12s %12s %16s\n", "comm", "typed_arrays", "drawnow [s]", "end of cell [s]");
+
+for typed = [true false]
+  plotly_options("typed_arrays", typed);
+
+  for comm = [false true]
+    plotly_options("comm", comm);
+    drawn = 0;
+    flushed = 0;
+
+    for r = 1:repeats
+      # Changing the data forces a complete redraw
+      set(l(1), "ydata", rand(1, points));
+      tic();
+      drawnow();
+      drawn += toc();
+
+      tic();
+      __plotly_flush__();
+      flushed += toc();
+    end
+
+    printf("%6d %12d %12.3f %16.3f\n", comm, typed, drawn / repeats, flushed / repeats);
+  end
+end
+
+close(h);
+
+plotly_options("comm", old_comm);
+plotly_options("typed_arrays", old_typed);
+plotly_options("decimation", old_decimation);
+plotly_options("incremental", old_incremental);
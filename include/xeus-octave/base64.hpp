@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XEUS_OCTAVE_BASE64_H
+#define XEUS_OCTAVE_BASE64_H
+
+#include <cstddef>
+#include <string>
+
+namespace xeus_octave::utils
+{
+
+/**
+ * Length of the base64 encoding of size bytes, padding included
+ */
+constexpr std::size_t base64_size(std::size_t size)
+{
+  return (size + 2) / 3 * 4;
+}
+
+/**
+ * Encode a buffer to base64 (with the standard alphabet and padding), writing
+ * exactly base64_size(size) characters to out. Large buffers are encoded with
+ * the vector instructions of the CPU when available.
+ */
+void base64_encode(void const* data, std::size_t size, char* out);
+
+/**
+ * Append the base64 encoding of a buffer to a string, growing it only once
+ */
+void base64_append(void const* data, std::size_t size, std::string& out);
+
+}  // namespace xeus_octave::utils
+
+#endif  // XEUS_OCTAVE_BASE64_H
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XEUS_OCTAVE_DECIMATION_H
+#define XEUS_OCTAVE_DECIMATION_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace xeus_octave::tk::plotly
+{
+
+/**
+ * The ways to reduce the points of the long lines sent to the frontends
+ */
+enum class decimation
+{
+  none,
+  // The first, last, lowest and highest points of each pixel column
+  minmax,
+  // Largest-Triangle-Three-Buckets, one point per half pixel column
+  lttb,
+};
+
+std::string to_string(decimation);
+bool from_string(std::string const&, decimation&);
+
+/**
+ * Whether the x of a line increase, so that its points can be picked by
+ * ranges of x. Lines with NaN x do not.
+ */
+bool is_increasing(double const* x, std::size_t size);
+
+/**
+ * Indices of the points to keep, in order, to draw a line on an axis showing
+ * [lo, hi] with the given number of pixel columns. The points outside of
+ * [lo, hi] are decimated with the same density. Log axes split [lo, hi] in
+ * logarithmic columns. The x must be increasing.
+ */
+std::vector<std::size_t> decimate(
+  decimation method,
+  double const* x,
+  double const* y,
+  std::size_t size,
+  double lo,
+  double hi,
+  bool log,
+  std::size_t columns
+);
+
+}  // namespace xeus_octave::tk::plotly
+
+#endif  // XEUS_OCTAVE_DECIMATION_H
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XEUS_OCTAVE_DISPLAY_LISTS_H
+#define XEUS_OCTAVE_DISPLAY_LISTS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+#include "xeus-octave/opengl.hpp"
+
+#include <octave/gl-render.h>
+#include <octave/graphics.h>
+
+namespace xeus_octave::tk::notebook
+{
+
+/**
+ * OpenGL display lists holding the geometry of the graphics objects drawn
+ * in the previous redraws. A list is keyed by the handle of its object, the
+ * generation of the object properties (bumped by the toolkit every time one
+ * of them is set) and a hash of the state of its axes which goes into the
+ * geometry (limits, scales, colormap...).
+ */
+class display_list_cache
+{
+public:
+
+  /**
+   * Invalidate the geometry of an object whose properties have changed
+   */
+  void touch(double handle);
+
+  /**
+   * Start the redraw of a figure
+   */
+  void begin(double figure);
+
+  /**
+   * Delete the lists of the objects of the figure which were not drawn since
+   * begin, as they were deleted or can no longer be cached
+   */
+  void end(octave::opengl_functions& glfcns);
+
+  /**
+   * Delete all the lists of a figure
+   */
+  void forget(double figure, octave::opengl_functions& glfcns);
+
+  /**
+   * Forget all the lists without deleting them, when their context is gone
+   */
+  void clear();
+
+  /**
+   * The list drawing an object in the given axes state, or 0 if it must be
+   * compiled again
+   */
+  GLuint find(double handle, std::uint64_t context);
+
+  /**
+   * Whether there is still room for the geometry of an object
+   */
+  bool fits(std::size_t points) const { return m_points + points <= max_points; }
+
+  /**
+   * Store the list just compiled for an object
+   */
+  void insert(double handle, std::uint64_t context, std::size_t points, GLuint list, octave::opengl_functions& glfcns);
+
+private:
+
+  struct key
+  {
+    std::uint64_t generation;
+    std::uint64_t context;
+
+    bool operator==(key const& other) const { return generation == other.generation && context == other.context; }
+  };
+
+  struct entry
+  {
+    double figure;
+    std::uint64_t generation = 0;
+    key compiled = {};
+    GLuint list = 0;
+    std::size_t points = 0;
+    std::uint64_t frame = 0;
+  };
+
+  // Display lists duplicate the geometry in the driver memory, so only so
+  // many data points are cached
+  static constexpr std::size_t max_points = 4'000'000;
+
+  std::unordered_map<double, entry> m_entries;
+  std::size_t m_points = 0;
+  double m_figure = 0;
+  std::uint64_t m_frame = 0;
+};
+
+/**
+ * The octave renderer, drawing lines, surfaces and patches from the display
+ * list cache when they did not change since the last redraw. Objects using
+ * other display lists (markers) or textures are always drawn again.
+ */
+class caching_renderer : public octave::opengl_renderer
+{
+public:
+
+  caching_renderer(octave::opengl_functions& glfcns, display_list_cache* cache, double dpr);
+
+protected:
+
+  void draw_axes(octave::axes::properties const& props) override;
+  void draw_line(octave::line::properties const& props) override;
+  void draw_surface(octave::surface::properties const& props) override;
+  void draw_patch(octave::patch::properties const& props) override;
+
+private:
+
+  template <typename F>
+  void draw_cached(octave::base_properties const& props, bool cacheable, std::size_t points, F&& draw);
+
+  octave::opengl_functions& m_functions;
+  display_list_cache* m_cache;
+  double m_dpr;
+  // Hash of the state of the axes being drawn
+  std::uint64_t m_context = 0;
+};
+
+}  // namespace xeus_octave::tk::notebook
+
+#endif  // XEUS_OCTAVE_DISPLAY_LISTS_H
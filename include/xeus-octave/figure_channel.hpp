@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XEUS_OCTAVE_FIGURE_CHANNEL_H
+#define XEUS_OCTAVE_FIGURE_CHANNEL_H
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include <xeus/xcomm.hpp>
+
+namespace nl = nlohmann;
+
+namespace xeus_octave::io
+{
+
+/**
+ * Channel carrying the figures to the frontends as raw binary buffers, rather
+ * than base64 strings in display_data messages.
+ *
+ * Frontends opt in by opening a comm with the "xeus-octave.figure" target, as
+ * the kernel.js of the kernelspec does. Those which do not, and the static
+ * renderings of the notebooks, only get the display_data messages.
+ *
+ * The frontends can send messages back, such as the ranges shown by the
+ * interactive figures, which are dispatched on their "type".
+ */
+class figure_channel
+{
+public:
+
+  using handler = std::function<void(nl::json const& data)>;
+
+  static constexpr char const* target_name = "xeus-octave.figure";
+
+  /**
+   * Whether a frontend is listening
+   */
+  bool is_open() const;
+
+  /**
+   * Incremented each time a frontend connects. The figures sent before then
+   * must be sent whole again, as what changes in them means nothing to the
+   * new frontend.
+   */
+  std::size_t generation() const;
+
+  /**
+   * Send a message to all the frontends listening, from any thread. Returns
+   * false if there are none.
+   */
+  bool send(nl::json const& data, xeus::buffer_sequence buffers) const;
+
+  /**
+   * Handle the messages of a type sent by the frontends
+   */
+  void on_message(std::string const& type, handler h);
+
+  /**
+   * Accept the comms opened by the frontends
+   */
+  void register_target(xeus::xcomm_manager& manager);
+
+private:
+
+  struct connection
+  {
+    std::unique_ptr<xeus::xcomm> comm;
+    bool open = true;
+  };
+
+  void accept(xeus::xcomm&& comm);
+  void receive(nl::json const& data) const;
+
+  mutable std::mutex m_mutex;
+  std::vector<std::shared_ptr<connection>> m_connections;
+  std::size_t m_generation = 0;
+  std::map<std::string, handler> m_handlers;
+};
+
+figure_channel& get_figure_channel();
+
+}  // namespace xeus_octave::io
+
+#endif  // XEUS_OCTAVE_FIGURE_CHANNEL_H
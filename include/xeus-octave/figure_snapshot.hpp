@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XEUS_OCTAVE_FIGURE_SNAPSHOT_H
+#define XEUS_OCTAVE_FIGURE_SNAPSHOT_H
+
+#include <array>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "xeus-octave/opengl.hpp"
+#include "xeus-octave/opengl_recording.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+/**
+ * The answers to the queries which only depend on the driver (its limits
+ * and strings), taken once from a context
+ */
+struct driver_limits
+{
+  std::map<GLenum, std::vector<GLdouble>> values;
+  std::map<GLenum, std::string> strings;
+};
+
+/**
+ * Query the limits of the current context
+ */
+driver_limits query_driver_limits();
+
+/**
+ * The opengl calls drawing a figure, recorded on the interpreter thread.
+ * Unlike the graphics objects they were recorded from, they can be replayed
+ * on any thread with its own context.
+ */
+struct figure_snapshot
+{
+  std::vector<char> calls;
+  int width = 0;
+  int height = 0;
+  bool batching = true;
+};
+
+/**
+ * OpenGL functions recording a figure snapshot. The queries are answered
+ * from the driver limits and from the state tracked here (viewport, enabled
+ * capabilities); a query which cannot be answered makes the snapshot
+ * incomplete, and the figure must then be drawn directly.
+ *
+ * The snapshot starts with the state set by opengl_replayer::begin_frame.
+ */
+class snapshot_recorder : public recording_opengl_functions
+{
+public:
+
+  snapshot_recorder(driver_limits const& limits, int width, int height);
+
+  bool is_complete() const { return m_complete; }
+
+  /**
+   * Move the recorded snapshot out
+   */
+  figure_snapshot take(bool batching);
+
+  void glDisable(GLenum cap) override;
+  void glEnable(GLenum cap) override;
+  void glPopAttrib() override;
+  void glPushAttrib(GLbitfield mask) override;
+  void glViewport(GLint x, GLint y, GLsizei width, GLsizei height) override;
+
+protected:
+
+  bool query(std::vector<char>& result) override;
+
+private:
+
+  struct attributes
+  {
+    GLbitfield mask;
+    std::map<GLenum, bool> enabled;
+    bool enabled_known;
+    std::array<GLdouble, 4> viewport;
+  };
+
+  /**
+   * Get whether a capability is enabled, returning false if it is not known
+   */
+  bool is_enabled(GLenum cap, GLboolean& enabled) const;
+
+  driver_limits const& m_limits;
+  int m_width;
+  int m_height;
+  bool m_complete = true;
+
+  // The capabilities enabled or disabled since the start, the others having
+  // their default state unless it is no longer known
+  std::map<GLenum, bool> m_enabled;
+  bool m_enabled_known = true;
+  std::array<GLdouble, 4> m_viewport;
+  std::vector<attributes> m_attributes;
+};
+
+}  // namespace xeus_octave::tk::notebook
+
+#endif  // XEUS_OCTAVE_FIGURE_SNAPSHOT_H
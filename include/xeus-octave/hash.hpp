@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XEUS_OCTAVE_HASH_H
+#define XEUS_OCTAVE_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace xeus_octave::utils
+{
+
+/**
+ * The 64 bit xxHash of a buffer. It is not a cryptographic hash, but it is
+ * fast enough to tell apart large buffers without comparing them.
+ */
+std::uint64_t xxhash64(void const* data, std::size_t size, std::uint64_t seed = 0);
+
+}  // namespace xeus_octave::utils
+
+#endif  // XEUS_OCTAVE_HASH_H
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XEUS_OCTAVE_JSON_WRITER_H
+#define XEUS_OCTAVE_JSON_WRITER_H
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace nl = nlohmann;
+
+namespace xeus_octave::utils
+{
+
+/**
+ * Streaming JSON serialiser, writing the document into a single buffer as it
+ * goes instead of building a DOM first. The buffer should be reserved with
+ * the expected size of the document, so that it grows at most once.
+ *
+ * The writer does not check the document: each key must be followed by one
+ * value, and each container closed.
+ */
+class json_writer
+{
+public:
+
+  explicit json_writer(std::size_t capacity = 0) { m_buffer.reserve(capacity); }
+
+  void begin_object();
+  void end_object();
+  void begin_array();
+  void end_array();
+
+  /**
+   * Write the name of the next member of the current object
+   */
+  void key(std::string_view name);
+
+  /**
+   * Write a number. NaN and infinities are written as null, like nl::json
+   * does.
+   */
+  void number(double value);
+  void boolean(bool value);
+  void string(std::string_view value);
+
+  /**
+   * Write a (small) value built with nl::json
+   */
+  void value(nl::json const& value);
+
+  /**
+   * Write the members of an object built with nl::json, in the current object
+   */
+  void members(nl::json const& object);
+
+  /**
+   * Write an array of numbers
+   */
+  void number_array(double const* data, std::size_t size);
+
+  /**
+   * Write a plotly typed array of doubles, encoded to base64 in place. The
+   * shape of the matrices is given as "rows,cols".
+   */
+  void typed_array(double const* data, std::size_t size, std::string_view shape = {});
+
+  std::size_t size() const { return m_buffer.size(); }
+
+  std::size_t capacity() const { return m_buffer.capacity(); }
+
+  /**
+   * Take the document out of the writer, which can then be reused
+   */
+  std::vector<char> take();
+
+private:
+
+  void separate();
+  void append(std::string_view text) { m_buffer.insert(m_buffer.end(), text.begin(), text.end()); }
+  void append_string(std::string_view text);
+
+  std::vector<char> m_buffer;
+  // Whether the current containers are still empty
+  std::vector<bool> m_empty;
+  bool m_after_key = false;
+};
+
+}  // namespace xeus_octave::utils
+
+#endif  // XEUS_OCTAVE_JSON_WRITER_H
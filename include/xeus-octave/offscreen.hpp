@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XEUS_OCTAVE_OFFSCREEN_H
+#define XEUS_OCTAVE_OFFSCREEN_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "xeus-octave/opengl.hpp"
+
+struct GLFWwindow;
+
+namespace xeus_octave::tk::notebook
+{
+
+/**
+ * Counters of the OpenGL resources created and reused by the notebook
+ * toolkit since the kernel started. The counters are updated by the render
+ * threads too.
+ */
+struct gl_stats
+{
+  std::atomic<std::size_t> contexts_created = 0;
+  // Contexts of the render threads, which do not change the init time and
+  // backend of the main context
+  std::atomic<std::size_t> thread_contexts_created = 0;
+  std::atomic<std::size_t> contexts_reused = 0;
+  std::atomic<std::size_t> framebuffers_created = 0;
+  std::atomic<std::size_t> framebuffers_reused = 0;
+  // Figure snapshots drawn by the render threads
+  std::atomic<std::size_t> snapshots_drawn = 0;
+  // Time taken to set up the windowing system and the context
+  std::size_t init_microseconds = 0;
+  // Backend of the context, empty until it is created
+  std::string backend;
+};
+
+gl_stats& get_gl_stats();
+
+/**
+ * The libraries creating the OpenGL context. GLFW needs a display server,
+ * while EGL (with pbuffers) and OSMesa (software rendering) also work on
+ * headless hosts.
+ */
+enum class context_backend
+{
+  glfw,
+  egl,
+  osmesa,
+};
+
+std::string to_string(context_backend);
+bool from_string(std::string const&, context_backend&);
+
+/**
+ * The backends built in, in the order they are tried
+ */
+std::vector<context_backend> available_backends();
+
+/**
+ * A long lived hidden OpenGL context. Figures are never drawn on its default
+ * framebuffer, which is only 1x1, but on framebuffer objects taken from a
+ * framebuffer_pool.
+ *
+ * The context is created with the first available backend which works, or
+ * with the one named by the XEUS_OCTAVE_GL_BACKEND environment variable.
+ * Several contexts can live at once, each current on its own thread; they
+ * must all be created and destroyed on the interpreter thread.
+ */
+class offscreen_context
+{
+public:
+
+  /**
+   * Create a context, for a render thread or as the main context of the
+   * toolkit, whose creation is recorded in the gl_stats
+   */
+  explicit offscreen_context(bool render_thread = false);
+  ~offscreen_context();
+
+  offscreen_context(offscreen_context const&) = delete;
+  offscreen_context& operator=(offscreen_context const&) = delete;
+
+  bool is_valid() const { return m_valid; }
+
+  context_backend backend() const { return m_backend; }
+
+  /**
+   * Make the context current on the calling thread
+   */
+  void make_current();
+
+  /**
+   * Leave the calling thread without a current context, so that the context
+   * can be made current on another thread
+   */
+  void release_current();
+
+  /**
+   * Scale factor between the screen coordinates and the pixels of the primary
+   * monitor (1 when there is no monitor)
+   */
+  float content_scale() const;
+
+private:
+
+  bool create();
+  void destroy();
+  GLADloadproc proc_address_loader() const;
+
+  context_backend m_backend = context_backend::glfw;
+  bool m_valid = false;
+
+  GLFWwindow* m_window = nullptr;
+
+  // The EGL and OSMesa handles are opaque pointers, to keep their headers out
+  void* m_egl_display = nullptr;
+  void* m_egl_surface = nullptr;
+  void* m_egl_context = nullptr;
+  void* m_osmesa_context = nullptr;
+  // OSMesa needs a color buffer to make its context current
+  std::array<unsigned char, 4> m_osmesa_buffer = {};
+};
+
+/**
+ * A framebuffer object with an RGBA color and a depth/stencil attachment
+ */
+class framebuffer
+{
+public:
+
+  framebuffer(int width, int height);
+  ~framebuffer();
+
+  framebuffer(framebuffer const&) = delete;
+  framebuffer& operator=(framebuffer const&) = delete;
+
+  int width() const { return m_width; }
+
+  int height() const { return m_height; }
+
+  void bind() const;
+  static void unbind();
+
+private:
+
+  int m_width;
+  int m_height;
+  GLuint m_fbo = 0;
+  GLuint m_color = 0;
+  GLuint m_depth = 0;
+};
+
+/**
+ * A pixel buffer object receiving the RGB pixels of a framebuffer without
+ * stalling the pipeline. Once mapped, the pixels can be read from any thread
+ * until the buffer is unmapped.
+ */
+class pixel_buffer
+{
+public:
+
+  pixel_buffer() = default;
+  ~pixel_buffer();
+
+  pixel_buffer(pixel_buffer const&) = delete;
+  pixel_buffer& operator=(pixel_buffer const&) = delete;
+
+  /**
+   * Start reading the pixels of the bound framebuffer
+   */
+  void read(int width, int height);
+
+  /**
+   * Map the pixels of the last read, waiting for it to complete. Returns null
+   * on failure.
+   */
+  unsigned char const* map();
+  void unmap();
+
+  bool is_mapped() const { return m_mapped; }
+
+private:
+
+  GLuint m_pbo = 0;
+  std::size_t m_capacity = 0;
+  std::size_t m_size = 0;
+  bool m_mapped = false;
+};
+
+/**
+ * A pool of framebuffer objects, indexed by their size. Released framebuffers
+ * are kept around for the next figure with the same size, up to a maximum
+ * number after which the least recently used ones are destroyed.
+ */
+class framebuffer_pool
+{
+public:
+
+  explicit framebuffer_pool(std::size_t capacity = 8) : m_capacity(capacity) {}
+
+  std::unique_ptr<framebuffer> acquire(int width, int height);
+  void release(std::unique_ptr<framebuffer> fb);
+  void clear() { m_free.clear(); }
+
+private:
+
+  std::size_t m_capacity;
+  // Least recently used first
+  std::vector<std::unique_ptr<framebuffer>> m_free;
+};
+
+}  // namespace xeus_octave::tk::notebook
+
+#endif  // XEUS_OCTAVE_OFFSCREEN_H
@@ -0,0 +1,357 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XEUS_OCTAVE_OPENGL_BATCH_H
+#define XEUS_OCTAVE_OPENGL_BATCH_H
+
+#include <array>
+#include <vector>
+
+#include "xeus-octave/opengl.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+/**
+ * OpenGL functions recording the immediate mode primitives (glBegin/glEnd)
+ * in client side arrays, so that a run of primitives of the same kind is
+ * drawn with a single call instead of one driver call per vertex.
+ *
+ * Any other function first draws the recorded primitives, so that they are
+ * drawn with the state they were issued with. Inside glBegin/glEnd, a call
+ * which is not a vertex attribute (e.g. glMaterial) makes the current
+ * primitive fall back to immediate mode.
+ */
+class batched_opengl_functions : public octave::opengl_functions
+{
+public:
+
+  void glBegin(GLenum mode) override;
+
+  void glEnd() override;
+
+  void glVertex2d(GLdouble x, GLdouble y) override { glVertex3d(x, y, 0); }
+
+  void glVertex3d(GLdouble x, GLdouble y, GLdouble z) override;
+
+  void glVertex3dv(GLdouble const* v) override { glVertex3d(v[0], v[1], v[2]); }
+
+  void glColor3dv(GLdouble const* v) override { glColor4d(v[0], v[1], v[2], 1); }
+
+  void glColor3f(GLfloat red, GLfloat green, GLfloat blue) override { glColor4f(red, green, blue, 1); }
+
+  void glColor3fv(GLfloat const* v) override { glColor4f(v[0], v[1], v[2], 1); }
+
+  void glColor4d(GLdouble red, GLdouble green, GLdouble blue, GLdouble alpha) override;
+
+  void glColor4f(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) override;
+
+  void glColor4fv(GLfloat const* v) override { glColor4f(v[0], v[1], v[2], v[3]); }
+
+  void glNormal3d(GLdouble nx, GLdouble ny, GLdouble nz) override;
+
+  void glNormal3dv(GLdouble const* v) override { glNormal3d(v[0], v[1], v[2]); }
+
+  void glTexCoord2d(GLdouble s, GLdouble t) override;
+
+  /**
+   * Draw the recorded primitives. This must be called once the renderer is
+   * done, before reading the pixels.
+   */
+  void flush();
+
+  /**
+   * Turn the batching on or off, in which case the primitives are drawn in
+   * immediate mode
+   */
+  void set_batching(bool batching) { m_batching = batching; }
+
+  /**
+   * Whether the calls are made in between glBegin and glEnd
+   */
+  bool is_recording() const { return m_recording; }
+
+  // Every other function draws the recorded primitives first
+
+  void glAlphaFunc(GLenum func, GLclampf ref) override { interrupt(); opengl_functions::glAlphaFunc(func, ref); }
+
+  void glBindTexture(GLenum target, GLuint texture) override
+  {
+    interrupt();
+    opengl_functions::glBindTexture(target, texture);
+  }
+
+  void glBitmap(
+    GLsizei width, GLsizei height, GLfloat xorig, GLfloat yorig, GLfloat xmove, GLfloat ymove, GLubyte const* bitmap
+  ) override
+  {
+    interrupt();
+    opengl_functions::glBitmap(width, height, xorig, yorig, xmove, ymove, bitmap);
+  }
+
+  void glBlendFunc(GLenum sfactor, GLenum dfactor) override
+  {
+    interrupt();
+    opengl_functions::glBlendFunc(sfactor, dfactor);
+  }
+
+  void glCallList(GLuint list) override { interrupt(); opengl_functions::glCallList(list); }
+
+  void glClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha) override
+  {
+    interrupt();
+    opengl_functions::glClearColor(red, green, blue, alpha);
+  }
+
+  void glClear(GLbitfield mask) override { interrupt(); opengl_functions::glClear(mask); }
+
+  void glClipPlane(GLenum plane, GLdouble const* equation) override
+  {
+    interrupt();
+    opengl_functions::glClipPlane(plane, equation);
+  }
+
+  void glDeleteLists(GLuint list, GLsizei range) override { interrupt(); opengl_functions::glDeleteLists(list, range); }
+
+  void glDeleteTextures(GLsizei n, GLuint const* textures) override
+  {
+    interrupt();
+    opengl_functions::glDeleteTextures(n, textures);
+  }
+
+  void glDepthFunc(GLenum func) override { interrupt(); opengl_functions::glDepthFunc(func); }
+
+  void glDisable(GLenum cap) override { interrupt(); opengl_functions::glDisable(cap); }
+
+  void glDrawPixels(GLsizei width, GLsizei height, GLenum format, GLenum type, GLvoid const* pixels) override
+  {
+    interrupt();
+    opengl_functions::glDrawPixels(width, height, format, type, pixels);
+  }
+
+  void glEdgeFlag(GLboolean flag) override { interrupt(); opengl_functions::glEdgeFlag(flag); }
+
+  void glEnable(GLenum cap) override { interrupt(); opengl_functions::glEnable(cap); }
+
+  void glEndList() override { interrupt(); opengl_functions::glEndList(); }
+
+  void glFinish() override { interrupt(); opengl_functions::glFinish(); }
+
+  GLuint glGenLists(GLsizei range) override { interrupt(); return opengl_functions::glGenLists(range); }
+
+  void glGenTextures(GLsizei n, GLuint* textures) override
+  {
+    interrupt();
+    opengl_functions::glGenTextures(n, textures);
+  }
+
+  void glGetBooleanv(GLenum pname, GLboolean* data) override
+  {
+    interrupt();
+    opengl_functions::glGetBooleanv(pname, data);
+  }
+
+  void glGetDoublev(GLenum pname, GLdouble* data) override { interrupt(); opengl_functions::glGetDoublev(pname, data); }
+
+  GLenum glGetError() override { interrupt(); return opengl_functions::glGetError(); }
+
+  void glGetFloatv(GLenum pname, GLfloat* data) override { interrupt(); opengl_functions::glGetFloatv(pname, data); }
+
+  void glGetIntegerv(GLenum pname, GLint* data) override { interrupt(); opengl_functions::glGetIntegerv(pname, data); }
+
+  GLubyte const* glGetString(GLenum name) override { interrupt(); return opengl_functions::glGetString(name); }
+
+  void glHint(GLenum target, GLenum mode) override { interrupt(); opengl_functions::glHint(target, mode); }
+
+  void glInitNames() override { interrupt(); opengl_functions::glInitNames(); }
+
+  GLboolean glIsEnabled(GLenum cap) override { interrupt(); return opengl_functions::glIsEnabled(cap); }
+
+  void glLightfv(GLenum light, GLenum pname, GLfloat const* params) override
+  {
+    interrupt();
+    opengl_functions::glLightfv(light, pname, params);
+  }
+
+  void glLineStipple(GLint factor, GLushort pattern) override
+  {
+    interrupt();
+    opengl_functions::glLineStipple(factor, pattern);
+  }
+
+  void glLineWidth(GLfloat width) override { interrupt(); opengl_functions::glLineWidth(width); }
+
+  void glLoadIdentity() override { interrupt(); opengl_functions::glLoadIdentity(); }
+
+  void glMaterialf(GLenum face, GLenum pname, GLfloat param) override
+  {
+    interrupt();
+    opengl_functions::glMaterialf(face, pname, param);
+  }
+
+  void glMaterialfv(GLenum face, GLenum pname, GLfloat const* params) override
+  {
+    interrupt();
+    opengl_functions::glMaterialfv(face, pname, params);
+  }
+
+  void glMatrixMode(GLenum mode) override { interrupt(); opengl_functions::glMatrixMode(mode); }
+
+  void glMultMatrixd(GLdouble const* m) override { interrupt(); opengl_functions::glMultMatrixd(m); }
+
+  void glNewList(GLuint list, GLenum mode) override { interrupt(); opengl_functions::glNewList(list, mode); }
+
+  void glOrtho(
+    GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdouble near_val, GLdouble far_val
+  ) override
+  {
+    interrupt();
+    opengl_functions::glOrtho(left, right, bottom, top, near_val, far_val);
+  }
+
+  void glPixelStorei(GLenum pname, GLint param) override { interrupt(); opengl_functions::glPixelStorei(pname, param); }
+
+  void glPixelZoom(GLfloat xfactor, GLfloat yfactor) override
+  {
+    interrupt();
+    opengl_functions::glPixelZoom(xfactor, yfactor);
+  }
+
+  void glPolygonMode(GLenum face, GLenum mode) override { interrupt(); opengl_functions::glPolygonMode(face, mode); }
+
+  void glPolygonOffset(GLfloat factor, GLfloat units) override
+  {
+    interrupt();
+    opengl_functions::glPolygonOffset(factor, units);
+  }
+
+  void glPopAttrib() override { interrupt(); opengl_functions::glPopAttrib(); }
+
+  void glPopMatrix() override { interrupt(); opengl_functions::glPopMatrix(); }
+
+  void glPopName() override { interrupt(); opengl_functions::glPopName(); }
+
+  void glPushAttrib(GLbitfield mask) override { interrupt(); opengl_functions::glPushAttrib(mask); }
+
+  void glPushMatrix() override { interrupt(); opengl_functions::glPushMatrix(); }
+
+  void glPushName(GLuint name) override { interrupt(); opengl_functions::glPushName(name); }
+
+  void glRasterPos3d(GLdouble x, GLdouble y, GLdouble z) override
+  {
+    interrupt();
+    opengl_functions::glRasterPos3d(x, y, z);
+  }
+
+  void glReadPixels(
+    GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, GLvoid* pixels
+  ) override
+  {
+    interrupt();
+    opengl_functions::glReadPixels(x, y, width, height, format, type, pixels);
+  }
+
+  GLint glRenderMode(GLenum mode) override { interrupt(); return opengl_functions::glRenderMode(mode); }
+
+  void glRotated(GLdouble angle, GLdouble x, GLdouble y, GLdouble z) override
+  {
+    interrupt();
+    opengl_functions::glRotated(angle, x, y, z);
+  }
+
+  void glScaled(GLdouble x, GLdouble y, GLdouble z) override { interrupt(); opengl_functions::glScaled(x, y, z); }
+
+  void glScalef(GLfloat x, GLfloat y, GLfloat z) override { interrupt(); opengl_functions::glScalef(x, y, z); }
+
+  void glSelectBuffer(GLsizei size, GLuint* buffer) override
+  {
+    interrupt();
+    opengl_functions::glSelectBuffer(size, buffer);
+  }
+
+  void glShadeModel(GLenum mode) override { interrupt(); opengl_functions::glShadeModel(mode); }
+
+  void glTexImage2D(
+    GLenum target,
+    GLint level,
+    GLint internalFormat,
+    GLsizei width,
+    GLsizei height,
+    GLint border,
+    GLenum format,
+    GLenum type,
+    GLvoid const* pixels
+  ) override
+  {
+    interrupt();
+    opengl_functions::glTexImage2D(target, level, internalFormat, width, height, border, format, type, pixels);
+  }
+
+  void glTexParameteri(GLenum target, GLenum pname, GLint param) override
+  {
+    interrupt();
+    opengl_functions::glTexParameteri(target, pname, param);
+  }
+
+  void glTranslated(GLdouble x, GLdouble y, GLdouble z) override
+  {
+    interrupt();
+    opengl_functions::glTranslated(x, y, z);
+  }
+
+  void glTranslatef(GLfloat x, GLfloat y, GLfloat z) override { interrupt(); opengl_functions::glTranslatef(x, y, z); }
+
+  void glViewport(GLint x, GLint y, GLsizei width, GLsizei height) override
+  {
+    interrupt();
+    opengl_functions::glViewport(x, y, width, height);
+  }
+
+private:
+
+  void interrupt();
+  void fall_back();
+  void draw_arrays() const;
+
+  // Current vertex attributes
+  std::array<GLfloat, 4> m_color = {1, 1, 1, 1};
+  std::array<GLfloat, 3> m_normal = {0, 0, 1};
+  std::array<GLfloat, 2> m_texcoord = {0, 0};
+
+  // Recorded vertices, kept allocated between the redraws
+  std::vector<GLdouble> m_vertices;
+  std::vector<GLfloat> m_colors;
+  std::vector<GLfloat> m_normals;
+  std::vector<GLfloat> m_texcoords;
+
+  // Recorded primitives, which all have the same mode
+  GLenum m_mode = 0;
+  std::vector<GLint> m_firsts;
+  std::vector<GLsizei> m_counts;
+
+  bool m_batching = true;
+  // Inside glBegin/glEnd
+  bool m_recording = false;
+  // The current primitive fell back to immediate mode
+  bool m_immediate = false;
+};
+
+}  // namespace xeus_octave::tk::notebook
+
+#endif  // XEUS_OCTAVE_OPENGL_BATCH_H
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XEUS_OCTAVE_OPENGL_RECORDING_H
+#define XEUS_OCTAVE_OPENGL_RECORDING_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "xeus-octave/opengl.hpp"
+#include "xeus-octave/render_protocol.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+/**
+ * OpenGL functions recording the calls of the octave renderer in a message
+ * of the render protocol, to be replayed by an opengl_replayer.
+ *
+ * The names of the display lists and textures are chosen here and mapped to
+ * real ones by the replayer, so that creating them does not wait for it. The
+ * queries (glGet*, glIsEnabled, glGetError...) are answered by the derived
+ * classes.
+ */
+class recording_opengl_functions : public octave::opengl_functions
+{
+public:
+
+  void glAlphaFunc(GLenum func, GLclampf ref) override;
+  void glBegin(GLenum mode) override;
+  void glBindTexture(GLenum target, GLuint texture) override;
+  void glBitmap(
+    GLsizei width, GLsizei height, GLfloat xorig, GLfloat yorig, GLfloat xmove, GLfloat ymove, GLubyte const* bitmap
+  ) override;
+  void glBlendFunc(GLenum sfactor, GLenum dfactor) override;
+  void glCallList(GLuint list) override;
+  void glClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha) override;
+  void glClear(GLbitfield mask) override;
+  void glClipPlane(GLenum plane, GLdouble const* equation) override;
+  void glColor3dv(GLdouble const* v) override;
+  void glColor3f(GLfloat red, GLfloat green, GLfloat blue) override;
+  void glColor3fv(GLfloat const* v) override;
+  void glColor4d(GLdouble red, GLdouble green, GLdouble blue, GLdouble alpha) override;
+  void glColor4f(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) override;
+  void glColor4fv(GLfloat const* v) override;
+  void glDeleteLists(GLuint list, GLsizei range) override;
+  void glDeleteTextures(GLsizei n, GLuint const* textures) override;
+  void glDepthFunc(GLenum func) override;
+  void glDisable(GLenum cap) override;
+  void glDrawPixels(GLsizei width, GLsizei height, GLenum format, GLenum type, GLvoid const* pixels) override;
+  void glEdgeFlag(GLboolean flag) override;
+  void glEnable(GLenum cap) override;
+  void glEndList() override;
+  void glEnd() override;
+  void glFinish() override;
+  GLuint glGenLists(GLsizei range) override;
+  void glGenTextures(GLsizei n, GLuint* textures) override;
+  void glGetBooleanv(GLenum pname, GLboolean* data) override;
+  void glGetDoublev(GLenum pname, GLdouble* data) override;
+  GLenum glGetError() override;
+  void glGetFloatv(GLenum pname, GLfloat* data) override;
+  void glGetIntegerv(GLenum pname, GLint* data) override;
+  GLubyte const* glGetString(GLenum name) override;
+  void glHint(GLenum target, GLenum mode) override;
+  void glInitNames() override;
+  GLboolean glIsEnabled(GLenum cap) override;
+  void glLightfv(GLenum light, GLenum pname, GLfloat const* params) override;
+  void glLineStipple(GLint factor, GLushort pattern) override;
+  void glLineWidth(GLfloat width) override;
+  void glLoadIdentity() override;
+  void glMaterialf(GLenum face, GLenum pname, GLfloat param) override;
+  void glMaterialfv(GLenum face, GLenum pname, GLfloat const* params) override;
+  void glMatrixMode(GLenum mode) override;
+  void glMultMatrixd(GLdouble const* m) override;
+  void glNewList(GLuint list, GLenum mode) override;
+  void glNormal3d(GLdouble nx, GLdouble ny, GLdouble nz) override;
+  void glNormal3dv(GLdouble const* v) override;
+  void glOrtho(
+    GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdouble near_val, GLdouble far_val
+  ) override;
+  void glPixelStorei(GLenum pname, GLint param) override;
+  void glPixelZoom(GLfloat xfactor, GLfloat yfactor) override;
+  void glPolygonMode(GLenum face, GLenum mode) override;
+  void glPolygonOffset(GLfloat factor, GLfloat units) override;
+  void glPopAttrib() override;
+  void glPopMatrix() override;
+  void glPopName() override;
+  void glPushAttrib(GLbitfield mask) override;
+  void glPushMatrix() override;
+  void glPushName(GLuint name) override;
+  void glRasterPos3d(GLdouble x, GLdouble y, GLdouble z) override;
+  void glReadPixels(
+    GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, GLvoid* pixels
+  ) override;
+  GLint glRenderMode(GLenum mode) override;
+  void glRotated(GLdouble angle, GLdouble x, GLdouble y, GLdouble z) override;
+  void glScaled(GLdouble x, GLdouble y, GLdouble z) override;
+  void glScalef(GLfloat x, GLfloat y, GLfloat z) override;
+  void glSelectBuffer(GLsizei size, GLuint* buffer) override;
+  void glShadeModel(GLenum mode) override;
+  void glTexCoord2d(GLdouble s, GLdouble t) override;
+  void glTexImage2D(
+    GLenum target,
+    GLint level,
+    GLint internalFormat,
+    GLsizei width,
+    GLsizei height,
+    GLint border,
+    GLenum format,
+    GLenum type,
+    GLvoid const* pixels
+  ) override;
+  void glTexParameteri(GLenum target, GLenum pname, GLint param) override;
+  void glTranslated(GLdouble x, GLdouble y, GLdouble z) override;
+  void glTranslatef(GLfloat x, GLfloat y, GLfloat z) override;
+  void glVertex2d(GLdouble x, GLdouble y) override;
+  void glVertex3d(GLdouble x, GLdouble y, GLdouble z) override;
+  void glVertex3dv(GLdouble const* v) override;
+  void glViewport(GLint x, GLint y, GLsizei width, GLsizei height) override;
+
+protected:
+
+  /**
+   * Answer the last recorded call, which is a query, writing its result as
+   * the replayer would. Returns false if it cannot be answered, in which
+   * case the query returns zeros.
+   */
+  virtual bool query(std::vector<char>& result) = 0;
+
+  /**
+   * Called before recording a call once the buffered calls are large
+   */
+  virtual void flush_calls() {}
+
+  /**
+   * Whether the calls are still recorded
+   */
+  virtual bool is_recording() const { return true; }
+
+  /**
+   * Forget the pixel store state, when the replayer starts a frame
+   */
+  void reset_pixel_store();
+
+  message_writer m_calls;
+  // Offset of the last call in the buffered calls
+  std::size_t m_last_call = 0;
+
+private:
+
+  template <typename... T> void call(gl_call function, T const&... args);
+
+  /**
+   * Add an array to the arguments of the last call
+   */
+  template <typename T> void append(T const* values, std::size_t count);
+
+  template <typename T> void get_values(gl_call function, GLenum pname, T* data);
+
+  // Names of the next display list and texture
+  GLuint m_next_list = 1;
+  GLuint m_next_texture = 1;
+
+  // The pixel store state, which tells how many bytes the pixel arrays hold
+  GLint m_pack_alignment = 4;
+  GLint m_pack_row_length = 0;
+  GLint m_unpack_alignment = 4;
+  GLint m_unpack_row_length = 0;
+
+  // The strings returned by glGetString, which must outlive the call
+  std::map<GLenum, std::string> m_strings;
+
+  GLuint* m_select_buffer = nullptr;
+  GLsizei m_select_size = 0;
+};
+
+}  // namespace xeus_octave::tk::notebook
+
+#endif  // XEUS_OCTAVE_OPENGL_RECORDING_H
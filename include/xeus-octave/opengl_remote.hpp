@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XEUS_OCTAVE_OPENGL_REMOTE_H
+#define XEUS_OCTAVE_OPENGL_REMOTE_H
+
+#include <string>
+#include <vector>
+
+#include "xeus-octave/opengl.hpp"
+#include "xeus-octave/opengl_recording.hpp"
+#include "xeus-octave/render_protocol.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+/**
+ * OpenGL functions executed by the render daemon listening on a UNIX socket.
+ *
+ * The calls are buffered and sent in batches, and only the queries (glGet*,
+ * glIsEnabled, glGetError...) wait for the daemon.
+ *
+ * Once the connection is broken the functions do nothing, the queries return
+ * zeros, and the connection is no longer valid.
+ */
+class remote_opengl_functions : public recording_opengl_functions
+{
+public:
+
+  explicit remote_opengl_functions(std::string const& socket);
+  ~remote_opengl_functions() override;
+
+  remote_opengl_functions(remote_opengl_functions const&) = delete;
+  remote_opengl_functions& operator=(remote_opengl_functions const&) = delete;
+
+  bool is_valid() const { return m_socket >= 0; }
+
+  /**
+   * The largest width and height of the frames the daemon can draw
+   */
+  int max_size() const { return m_max_size; }
+
+  /**
+   * Start drawing a frame on a framebuffer of the daemon
+   */
+  bool begin_frame(int width, int height);
+
+  /**
+   * Wait for the daemon to draw the frame, and get its RGB pixels, bottom row
+   * first
+   */
+  bool end_frame(std::vector<unsigned char>& pixels);
+
+protected:
+
+  bool query(std::vector<char>& result) override;
+
+  void flush_calls() override { send_calls(); }
+
+  bool is_recording() const override { return is_valid(); }
+
+private:
+
+  /**
+   * Send the buffered calls with a message, and wait for the reply
+   */
+  bool exchange(render_message type, render_message reply, std::vector<char>& payload);
+
+  void send_calls();
+  void disconnect();
+
+  int m_socket = -1;
+  int m_max_size = 0;
+};
+
+}  // namespace xeus_octave::tk::notebook
+
+#endif  // XEUS_OCTAVE_OPENGL_REMOTE_H
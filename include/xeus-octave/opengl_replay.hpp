@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XEUS_OCTAVE_OPENGL_REPLAY_H
+#define XEUS_OCTAVE_OPENGL_REPLAY_H
+
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "xeus-octave/opengl.hpp"
+#include "xeus-octave/opengl_batch.hpp"
+#include "xeus-octave/render_protocol.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+/**
+ * A query which the replayer does not answer. The calls before it were
+ * replayed, and the next ones can be.
+ */
+struct unanswered_query : std::runtime_error
+{
+  using std::runtime_error::runtime_error;
+};
+
+/**
+ * Replays the opengl calls recorded by a recording_opengl_functions on the
+ * current context, with the vertex batching of the notebook toolkit.
+ *
+ * The display lists and textures are named by the recorder, and get their
+ * own names here, which live until release. The replayer must only be used
+ * with the context it was used with first.
+ */
+class opengl_replayer
+{
+public:
+
+  explicit opengl_replayer(batched_opengl_functions& glfcns) : m_glfcns(glfcns) {}
+
+  /**
+   * Save the state of the context and reset it for a frame, drawn on the
+   * bound framebuffer
+   */
+  void begin_frame(int width, int height);
+
+  /**
+   * Save the state of the context for the calls made outside the frames
+   */
+  void begin_calls();
+
+  /**
+   * Replay the calls of a message, writing the result of the queries. The
+   * calls which would make opengl read past their arrays, or pop the state
+   * saved by begin_frame, throw a std::runtime_error.
+   *
+   * The calls of a frame can be replayed again from its start, on a new
+   * frame: the display lists and textures they create are then reused.
+   */
+  void replay(message_reader& reader, message_writer& result);
+
+  /**
+   * Draw what is left of the frame and restore the state of the context, as
+   * saved by begin_frame or begin_calls
+   */
+  void end_frame();
+
+  /**
+   * Delete the display lists and textures still alive
+   */
+  void release();
+
+private:
+
+  /**
+   * The pixels of an image, which must be as many as opengl reads with the
+   * unpack state of the client. Images without pixels are null.
+   */
+  GLvoid const* get_pixels(
+    message_reader& reader, GLsizei width, GLsizei height, GLenum format, GLenum type, bool optional
+  ) const;
+
+  batched_opengl_functions& m_glfcns;
+  // The names of the display lists and textures of the recorder, and the
+  // ones they have here
+  std::unordered_map<GLuint, GLuint> m_lists;
+  std::unordered_map<GLuint, GLuint> m_textures;
+  std::vector<GLuint> m_select_buffer;
+  // The unpack state set by the client, which tells how many bytes the
+  // images of its calls hold
+  GLint m_unpack_alignment = 4;
+  GLint m_unpack_row_length = 0;
+  // Depth of the attribute stack once saved by begin_calls
+  GLint m_attrib_depth = 0;
+};
+
+}  // namespace xeus_octave::tk::notebook
+
+#endif  // XEUS_OCTAVE_OPENGL_REPLAY_H
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XEUS_OCTAVE_OPENGL_TILES_H
+#define XEUS_OCTAVE_OPENGL_TILES_H
+
+#include <array>
+
+#include "xeus-octave/opengl.hpp"
+#include "xeus-octave/opengl_batch.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+/**
+ * OpenGL functions drawing a single tile of a viewport, for figures larger
+ * than the framebuffers the driver can allocate. The renderer keeps seeing
+ * the viewport of the whole figure, while the projection is narrowed to the
+ * tile, whose pixels are drawn on a framebuffer of the size of the tile.
+ *
+ * The tiles are drawn with the batched functions, so that the toolkit has a
+ * single set of functions for all the figures.
+ */
+class tiled_opengl_functions : public batched_opengl_functions
+{
+public:
+
+  /**
+   * Draw only the tile with its bottom left corner at (x, y) of the viewport
+   * of a figure of full_width x full_height pixels
+   */
+  void set_tile(int x, int y, int width, int height, int full_width, int full_height);
+
+  /**
+   * Draw the whole viewport again
+   */
+  void reset_tile() { m_tiled = false; }
+
+  void glViewport(GLint x, GLint y, GLsizei width, GLsizei height) override;
+
+  void glGetIntegerv(GLenum pname, GLint* data) override;
+
+  void glMatrixMode(GLenum mode) override;
+
+  void glLoadIdentity() override;
+
+  void glRasterPos3d(GLdouble x, GLdouble y, GLdouble z) override;
+
+private:
+
+  /**
+   * Map the normalized device coordinates of the viewport to the ones of the
+   * tile
+   */
+  std::array<GLdouble, 16> tile_matrix() const;
+
+  bool m_tiled = false;
+  // x, y, width and height, as for glViewport
+  std::array<GLint, 4> m_tile = {};
+  std::array<GLint, 4> m_viewport = {};
+  GLenum m_matrix_mode = GL_MODELVIEW;
+};
+
+}  // namespace xeus_octave::tk::notebook
+
+#endif  // XEUS_OCTAVE_OPENGL_TILES_H
@@ -44,6 +44,12 @@ protected:
   std::mutex m_mutex;
 };
 
+/**
+ * Serializes the messages published on IOPub by the interpreter thread and by
+ * the figure publisher thread
+ */
+std::mutex& publish_mutex();
+
 }  // namespace xeus_octave::io
 
 #endif
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XEUS_OCTAVE_PNG_H
+#define XEUS_OCTAVE_PNG_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace xeus_octave::tk::notebook
+{
+
+/**
+ * The library writing the PNG stream. The zlib backend writes the stream by
+ * itself and deflates large images as parallel strips; it uses zlib-ng when
+ * the kernel is linked against its zlib compatible build.
+ */
+enum class png_backend
+{
+  libpng,
+  zlib,
+};
+
+/**
+ * Tradeoff between encoding speed and image size
+ */
+enum class png_preset
+{
+  fast,
+  balanced,
+  small,
+};
+
+struct png_options
+{
+  png_backend backend = png_backend::zlib;
+  png_preset preset = png_preset::balanced;
+};
+
+std::string to_string(png_backend backend);
+std::string to_string(png_preset preset);
+
+/**
+ * Parse a backend or preset name, returning false if it is unknown
+ */
+bool from_string(std::string const& name, png_backend& backend);
+bool from_string(std::string const& name, png_preset& preset);
+
+/**
+ * Encode a set of opengl RGB pixels, bottom row first, to a PNG stream. Images
+ * with at most 256 colours are written with a palette, or as grayscale.
+ */
+std::vector<char>
+png_encode(unsigned char const* pixels, unsigned int width, unsigned int height, png_options const& options);
+
+/**
+ * PNG encoder for images too large to be read back at once, which are given
+ * as horizontal bands from the top of the image. Each band is deflated on its
+ * own thread while the next ones are produced, and its pixels are released
+ * once it is done. Images are always written as RGB, by the zlib backend.
+ */
+class png_band_encoder
+{
+public:
+
+  png_band_encoder(unsigned int width, unsigned int height, png_options const& options);
+  ~png_band_encoder();
+
+  png_band_encoder(png_band_encoder const&) = delete;
+  png_band_encoder& operator=(png_band_encoder const&) = delete;
+
+  /**
+   * Queue the next band of RGB pixels, bottom row first like opengl
+   */
+  void add(std::vector<unsigned char> pixels);
+
+  /**
+   * Wait for all the bands, which must cover the image, and return the PNG
+   * stream
+   */
+  std::vector<char> finish();
+
+private:
+
+  struct state;
+  std::unique_ptr<state> m_state;
+};
+
+}  // namespace xeus_octave::tk::notebook
+
+#endif  // XEUS_OCTAVE_PNG_H
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XEUS_OCTAVE_PUBLISHER_H
+#define XEUS_OCTAVE_PUBLISHER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace xeus_octave::tk::notebook
+{
+
+/**
+ * A worker thread encoding and publishing the figures once their pixels have
+ * been read back, so that the interpreter can go on with the execution.
+ *
+ * Jobs are run one at a time in submission order, so that the updates of a
+ * display are never reordered. Jobs must not access the octave graphics
+ * objects, which are not thread safe.
+ */
+class figure_publisher
+{
+public:
+
+  using job = std::function<void()>;
+
+  figure_publisher();
+  ~figure_publisher();
+
+  figure_publisher(figure_publisher const&) = delete;
+  figure_publisher& operator=(figure_publisher const&) = delete;
+
+  /**
+   * Queue a job for the worker thread. The returned future is ready once the
+   * job has been run, even if it failed.
+   */
+  std::future<void> submit(job j);
+
+  /**
+   * Block until all the submitted jobs have been run
+   */
+  void flush();
+
+private:
+
+  void run();
+
+  std::mutex m_mutex;
+  std::condition_variable m_work;
+  std::condition_variable m_idle;
+  std::deque<std::pair<job, std::promise<void>>> m_jobs;
+  bool m_busy = false;
+  bool m_stop = false;
+  std::thread m_thread;
+};
+
+}  // namespace xeus_octave::tk::notebook
+
+#endif  // XEUS_OCTAVE_PUBLISHER_H
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XEUS_OCTAVE_RENDER_DAEMON_H
+#define XEUS_OCTAVE_RENDER_DAEMON_H
+
+#include <csignal>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "xeus-octave/offscreen.hpp"
+#include "xeus-octave/opengl.hpp"
+#include "xeus-octave/opengl_batch.hpp"
+#include "xeus-octave/opengl_replay.hpp"
+#include "xeus-octave/render_protocol.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+/**
+ * A process drawing the figures of all the kernels of a host, so that they
+ * share a single OpenGL context (and its framebuffer pool) instead of
+ * creating one each.
+ *
+ * The kernels connect to its UNIX socket and send the opengl calls of the
+ * octave renderer, which are replayed with the vertex batching of the
+ * notebook toolkit, and get back the pixels of their frames.
+ *
+ * The messages of the kernels are read as they come, without waiting for a
+ * kernel in the middle of a frame. The calls of a frame are kept until its
+ * end, and only replayed when the kernel waits for the daemon (a query, or
+ * the end of the frame). When other frames were drawn in between, the calls
+ * of the frame are replayed again from its start.
+ */
+class render_daemon
+{
+public:
+
+  explicit render_daemon(std::string const& socket);
+  ~render_daemon();
+
+  render_daemon(render_daemon const&) = delete;
+  render_daemon& operator=(render_daemon const&) = delete;
+
+  bool is_valid() const { return m_socket >= 0 && m_context && m_context->is_valid(); }
+
+  /**
+   * Serve the clients until the flag is set (by a signal handler)
+   */
+  void run(volatile std::sig_atomic_t const& stop);
+
+private:
+
+  struct client
+  {
+    client(int s, batched_opengl_functions& glfcns) : socket(s), replayer(glfcns) {}
+
+    int socket;
+    // Replays the calls of the client, with the names of its display lists
+    // and textures
+    opengl_replayer replayer;
+    message_receiver input;
+
+    // The frame being received, and its messages so far
+    bool in_frame = false;
+    bool frame_valid = false;
+    int width = 0;
+    int height = 0;
+    std::vector<std::vector<char>> frame;
+    std::size_t frame_size = 0;
+    // The messages of the frame already replayed on the framebuffer
+    std::size_t replayed = 0;
+  };
+
+  /**
+   * Serve the messages received from a client, returning false if it must
+   * be disconnected
+   */
+  bool serve(client&);
+
+  bool handle(client&, render_message type, std::vector<char> payload);
+
+  /**
+   * Replay the calls of a frame which were not replayed yet, on the
+   * framebuffer of the frame, writing the result of the last message
+   */
+  void resume(client&, message_writer& result);
+
+  /**
+   * Set aside the frame being drawn, so that the context can draw another
+   */
+  void suspend();
+
+  /**
+   * Replay calls made outside the frames
+   */
+  void replay_calls(client&, std::vector<char> const& payload, message_writer& result);
+
+  bool end_frame(client&);
+
+  void disconnect(client&);
+
+  std::string m_path;
+  int m_socket = -1;
+  std::unique_ptr<offscreen_context> m_context;
+  framebuffer_pool m_framebuffers;
+  batched_opengl_functions m_glfcns;
+  int m_max_size = 0;
+  std::vector<std::unique_ptr<client>> m_clients;
+
+  // The client whose frame is on the framebuffer
+  client* m_drawing = nullptr;
+  std::unique_ptr<framebuffer> m_framebuffer;
+};
+
+}  // namespace xeus_octave::tk::notebook
+
+#endif  // XEUS_OCTAVE_RENDER_DAEMON_H
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XEUS_OCTAVE_RENDER_POOL_H
+#define XEUS_OCTAVE_RENDER_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "xeus-octave/figure_snapshot.hpp"
+#include "xeus-octave/offscreen.hpp"
+#include "xeus-octave/opengl_batch.hpp"
+#include "xeus-octave/opengl_replay.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+/**
+ * Threads drawing figure snapshots at once, each with its own OpenGL
+ * context, framebuffer pool and vertex batching.
+ *
+ * Each snapshot is drawn by the thread picked by its key, so that the
+ * snapshots of a figure are drawn in submission order.
+ */
+class render_pool
+{
+public:
+
+  /**
+   * Called on the thread which drew a snapshot, with its RGB pixels (bottom
+   * row first) and the microseconds taken to replay and read them back
+   */
+  using callback =
+    std::function<void(std::vector<unsigned char>& pixels, std::size_t render_us, std::size_t readback_us)>;
+
+  /**
+   * Create the contexts of the threads, after which the given context is
+   * made current again on the calling thread
+   */
+  render_pool(std::size_t threads, offscreen_context& current);
+  ~render_pool();
+
+  render_pool(render_pool const&) = delete;
+  render_pool& operator=(render_pool const&) = delete;
+
+  bool is_valid() const { return m_valid; }
+
+  /**
+   * The number of threads asked for, even when their contexts could not be
+   * created
+   */
+  std::size_t threads() const { return m_threads; }
+
+  /**
+   * The limits of the driver, to record the snapshots with
+   */
+  driver_limits const& limits() const { return m_limits; }
+
+  /**
+   * Queue a snapshot on the thread picked by the key
+   */
+  void submit(std::size_t key, figure_snapshot snapshot, callback done);
+
+  /**
+   * Block until all the submitted snapshots have been drawn
+   */
+  void flush();
+
+private:
+
+  struct worker
+  {
+    offscreen_context context{true};
+    framebuffer_pool framebuffers;
+    batched_opengl_functions glfcns;
+    opengl_replayer replayer{glfcns};
+    std::deque<std::pair<figure_snapshot, callback>> jobs;
+    std::condition_variable work;
+    bool busy = false;
+    std::thread thread;
+  };
+
+  void run(worker&);
+  void draw(worker&, figure_snapshot const&, callback&);
+
+  std::mutex m_mutex;
+  std::condition_variable m_idle;
+  bool m_stop = false;
+  bool m_valid = true;
+  std::size_t m_threads;
+  driver_limits m_limits;
+  std::vector<std::unique_ptr<worker>> m_workers;
+};
+
+}  // namespace xeus_octave::tk::notebook
+
+#endif  // XEUS_OCTAVE_RENDER_POOL_H
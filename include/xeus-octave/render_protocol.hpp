@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef XEUS_OCTAVE_RENDER_PROTOCOL_H
+#define XEUS_OCTAVE_RENDER_PROTOCOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "xeus-octave/opengl.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+/**
+ * Messages exchanged between the kernels and the render daemon over its UNIX
+ * socket. Each message is a header (type and payload size, in host byte
+ * order) followed by its payload.
+ *
+ * A client says hello first, and the daemon answers with the size of the
+ * largest frame it can draw. A frame is then drawn by a begin_frame message,
+ * the opengl calls of the octave renderer, and an end_frame message to which
+ * the daemon answers with the pixels.
+ */
+enum class render_message : std::uint32_t
+{
+  // Client: protocol version. Daemon: protocol version and largest size.
+  hello,
+  // Client: opengl calls to replay
+  calls,
+  // Client: opengl calls ending with a query, answered with a result
+  query,
+  // Daemon: the values returned by a query
+  result,
+  // Client: width and height of the frame drawn by the next calls
+  begin_frame,
+  // Client: the last calls of the frame, answered with its pixels
+  end_frame,
+  // Daemon: the RGB pixels of the frame, bottom row first
+  pixels,
+  // Daemon: the request cannot be served, with the reason
+  failure,
+};
+
+constexpr std::uint32_t render_protocol_version = 1;
+
+// Largest payload accepted, which holds a frame of 16384x16384 pixels
+constexpr std::size_t max_message_size = std::size_t(1) << 30;
+
+/**
+ * The opengl functions of the octave renderer, which start each call in the
+ * payload of the calls and query messages
+ */
+enum class gl_call : std::uint8_t
+{
+  alpha_func,
+  begin,
+  bind_texture,
+  bitmap,
+  blend_func,
+  call_list,
+  clear_color,
+  clear,
+  clip_plane,
+  color3dv,
+  color3f,
+  color3fv,
+  color4d,
+  color4f,
+  color4fv,
+  delete_lists,
+  delete_textures,
+  depth_func,
+  disable,
+  draw_pixels,
+  edge_flag,
+  enable,
+  end_list,
+  end,
+  finish,
+  gen_lists,
+  gen_textures,
+  get_booleanv,
+  get_doublev,
+  get_error,
+  get_floatv,
+  get_integerv,
+  get_string,
+  hint,
+  init_names,
+  is_enabled,
+  lightfv,
+  line_stipple,
+  line_width,
+  load_identity,
+  materialf,
+  materialfv,
+  matrix_mode,
+  mult_matrixd,
+  new_list,
+  normal3d,
+  normal3dv,
+  ortho,
+  pixel_storei,
+  pixel_zoom,
+  polygon_mode,
+  polygon_offset,
+  pop_attrib,
+  pop_matrix,
+  pop_name,
+  push_attrib,
+  push_matrix,
+  push_name,
+  raster_pos3d,
+  read_pixels,
+  render_mode,
+  rotated,
+  scaled,
+  scalef,
+  select_buffer,
+  shade_model,
+  tex_coord2d,
+  tex_image2d,
+  tex_parameteri,
+  translated,
+  translatef,
+  vertex2d,
+  vertex3d,
+  vertex3dv,
+  viewport,
+};
+
+/**
+ * Writes the payload of a message. Arrays are aligned on 8 bytes, so that
+ * they can be handed to opengl right from the payload.
+ */
+class message_writer
+{
+public:
+
+  template <typename... T> void put(T const&... values) { (put_value(values), ...); }
+
+  template <typename T> void put_array(T const* values, std::size_t count)
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    m_data.resize((m_data.size() + 7) & ~std::size_t(7));
+
+    auto const offset = m_data.size();
+    m_data.resize(offset + sizeof(T) * count);
+
+    if (count > 0)
+      std::memcpy(m_data.data() + offset, values, sizeof(T) * count);
+  }
+
+  std::vector<char> const& data() const { return m_data; }
+
+  std::size_t size() const { return m_data.size(); }
+
+  void clear() { m_data.clear(); }
+
+  /**
+   * Drop what was written after the given size
+   */
+  void truncate(std::size_t size) { m_data.resize(std::min(size, m_data.size())); }
+
+  /**
+   * Move the payload out, leaving the writer empty
+   */
+  std::vector<char> take()
+  {
+    std::vector<char> data;
+    data.swap(m_data);
+    return data;
+  }
+
+private:
+
+  template <typename T> void put_value(T const& value)
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    auto const offset = m_data.size();
+    m_data.resize(offset + sizeof(T));
+    std::memcpy(m_data.data() + offset, &value, sizeof(T));
+  }
+
+  std::vector<char> m_data;
+};
+
+/**
+ * Reads the payload of a message written by a message_writer. Reading past
+ * its end throws a std::runtime_error.
+ */
+class message_reader
+{
+public:
+
+  explicit message_reader(std::vector<char> const& data) : m_data(data) {}
+
+  template <typename T> T get()
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    T value;
+    std::memcpy(&value, take(sizeof(T)), sizeof(T));
+    return value;
+  }
+
+  /**
+   * The array starting at the current position, which stays in the payload
+   */
+  template <typename T> T const* get_array(std::size_t count)
+  {
+    m_position = (m_position + 7) & ~std::size_t(7);
+
+    if (count > (m_data.size() - std::min(m_position, m_data.size())) / sizeof(T))
+      truncated();
+
+    return reinterpret_cast<T const*>(take(sizeof(T) * count));
+  }
+
+  bool at_end() const { return m_position >= m_data.size(); }
+
+private:
+
+  char const* take(std::size_t size);
+  [[noreturn]] static void truncated();
+
+  std::vector<char> const& m_data;
+  std::size_t m_position = 0;
+};
+
+/**
+ * Receives the messages of a socket as their bytes come, so that a peer
+ * sending a message slowly does not block the receiver
+ */
+class message_receiver
+{
+public:
+
+  /**
+   * Read what the socket holds, without waiting for more. Returns false if
+   * the connection is closed or broken, or sends an invalid message.
+   */
+  bool receive(int socket);
+
+  /**
+   * Take the next message, once it is received whole. An invalid message
+   * throws a std::runtime_error.
+   */
+  bool next(render_message& type, std::vector<char>& payload);
+
+private:
+
+  std::vector<char> m_data;
+};
+
+/**
+ * Send a message on a socket, returning false if the connection is broken
+ */
+bool send_message(int socket, render_message type, std::vector<char> const& payload = {});
+
+/**
+ * Receive the next message from a socket, returning false if the connection
+ * is broken, times out or sends an invalid message
+ */
+bool receive_message(int socket, render_message& type, std::vector<char>& payload);
+
+/**
+ * The socket of the render daemon when none is given:
+ * $XDG_RUNTIME_DIR/xoctave-renderd.sock, or /tmp/xoctave-renderd.sock
+ */
+std::string default_render_socket();
+
+/**
+ * Size in bytes of the pixels read or written by opengl for an image, with
+ * the given GL_[UN]PACK_ALIGNMENT and GL_[UN]PACK_ROW_LENGTH. It is 0 for the
+ * formats and types not known here, and larger than max_message_size for the
+ * images which do not fit in a message.
+ */
+std::size_t pixel_data_size(
+  GLsizei width, GLsizei height, GLenum format, GLenum type, GLint alignment, GLint row_length
+);
+
+/**
+ * Number of values returned by glGet* for a parameter, or 0 for the ones not
+ * known here
+ */
+std::size_t get_value_count(GLenum pname);
+
+/**
+ * Number of values passed to glLightfv and glMaterialfv for a parameter, or 0
+ * for the ones not known here
+ */
+std::size_t light_value_count(GLenum pname);
+
+}  // namespace xeus_octave::tk::notebook
+
+#endif  // XEUS_OCTAVE_RENDER_PROTOCOL_H
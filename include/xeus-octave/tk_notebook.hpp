@@ -20,16 +20,73 @@
 #ifndef XEUS_OCTAVE_NOTEBOOK_TOOLKIT_H
 #define XEUS_OCTAVE_NOTEBOOK_TOOLKIT_H
 
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <octave/graphics-toolkit.h>
 #include <octave/interpreter.h>
 
 #include "xeus-octave/config.hpp"
+#include "xeus-octave/display_lists.hpp"
+#include "xeus-octave/offscreen.hpp"
+#include "xeus-octave/opengl_remote.hpp"
+#include "xeus-octave/opengl_tiles.hpp"
+#include "xeus-octave/png.hpp"
+#include "xeus-octave/render_pool.hpp"
 
 namespace xeus_octave::tk::notebook
 {
 
+/**
+ * Timings (in microseconds) and size of the last frame published for a
+ * figure. The frames which did not change since the previous one are not
+ * sent, and have no bytes.
+ */
+struct figure_stats
+{
+  double figure = 0;
+  std::size_t render_us = 0;
+  std::size_t readback_us = 0;
+  std::size_t encode_us = 0;
+  std::size_t publish_us = 0;
+  std::size_t bytes = 0;
+  std::size_t pixels = 0;
+};
+
+/**
+ * A rectangle of a frame, in pixels from its bottom left corner as in opengl
+ */
+struct dirty_rect
+{
+  int x;
+  int y;
+  int width;
+  int height;
+};
+
+/**
+ * How a frame is sent, from the options set when it was drawn, as the
+ * publisher thread must not read the options changed by the interpreter
+ */
+struct frame_delivery
+{
+  // Drawn while the cell runs, and likely to be followed by others
+  bool live = false;
+  // Sent over the figure channel, if a frontend listens to it
+  bool comm = false;
+  // Sent over the figure channel as the tiles which changed
+  bool dirty_tiles = false;
+};
+
 /**
  * Generic graphics_toolkit for rendering within a GLFW context. It cannot be
  * used on its own, but must be inherited from the actual toolkits
@@ -41,9 +98,220 @@ public:
   glfw_graphics_toolkit(std::string const&);
   ~glfw_graphics_toolkit();
 
+  using octave::base_graphics_toolkit::update;
+
   bool initialize(octave::graphics_object const&) override;
   void redraw_figure(octave::graphics_object const&) const override;
-  virtual void send_figure(octave::graphics_object const&, std::vector<char> const&, int, int, double) const = 0;
+  void update(octave::graphics_object const&, int) override;
+  void finalize(octave::graphics_object const&) override;
+
+  /**
+   * Send the encoded figure to the frontend. This is called from the figure
+   * publisher thread, so it must not access the graphics objects: the figure
+   * is identified by its plot stream id.
+   */
+  virtual void send_figure(
+    std::string const& id, std::vector<char> const&, int, int, double, figure_stats const&, frame_delivery
+  ) const = 0;
+
+  /**
+   * Send only some rectangles of a live frame going over the figure channel,
+   * the ones which changed since the previous frame of the figure. This is called from the figure
+   * publisher thread with the raw pixels, and returns false if the whole
+   * frame must be sent instead.
+   */
+  virtual bool send_tiles(
+    std::string const& /*id*/,
+    unsigned char const* /*pixels*/,
+    int /*width*/,
+    int /*height*/,
+    double /*dpr*/,
+    std::vector<dirty_rect> const&,
+    png_options const&,
+    figure_stats&
+  ) const
+  {
+    return false;
+  }
+
+  /**
+   * Called from the figure publisher thread once the frames drawn so far have
+   * been sent
+   */
+  virtual void frames_flushed() const {}
+
+  /**
+   * Draw the figures whose redraws were throttled, and publish the frame
+   * whose readback is still in flight
+   */
+  void flush_frames() const;
+
+  /**
+   * The statistics of the last frame of each figure. The publisher must be
+   * idle, see flush().
+   */
+  std::vector<figure_stats> stats() const;
+
+private:
+
+  bool has_local_context() const { return m_context && m_context->is_valid(); }
+
+  /**
+   * How the frames drawn now are sent
+   */
+  frame_delivery current_delivery() const;
+
+  /**
+   * Make the local context current, creating it if needed
+   */
+  bool make_local_current() const;
+
+  /**
+   * Render a figure and queue its readback
+   */
+  void draw_figure(octave::graphics_object const&) const;
+
+  /**
+   * Render a figure with the render daemon and queue its publication.
+   * Returns false if the daemon could not draw it.
+   */
+  bool draw_remote(octave::graphics_object const&, int width, int height, double dpr) const;
+
+  /**
+   * Record a figure snapshot and queue it on the render threads, which draw
+   * and encode it. Returns false if the figure must be drawn directly.
+   */
+  bool draw_parallel(octave::graphics_object const&, int width, int height, double dpr) const;
+
+  /**
+   * Wait for the snapshots of a figure queued on the render threads, before
+   * its next frame is published otherwise
+   */
+  void flush_snapshots(double figure) const;
+
+  /**
+   * Render a figure in tiles of at most tile x tile pixels, and encode it
+   * as it is read back
+   */
+  void draw_tiled(octave::graphics_object const&, int width, int height, double dpr, int tile) const;
+
+  /**
+   * The size of the largest tile which can be drawn at once
+   */
+  int max_tile_size() const;
+
+  /**
+   * Whether the figure is expected to take long enough to be drawn that a
+   * preview should be sent first
+   */
+  bool needs_preview(octave::graphics_object const&, int width, int height) const;
+
+  /**
+   * Draw and publish the figure at a lower resolution
+   */
+  void draw_preview(octave::graphics_object const&, int width, int height, double dpr) const;
+
+  /**
+   * A frame being read back, to be published at the next redraw
+   */
+  struct pending_frame
+  {
+    std::string id;
+    int width;
+    int height;
+    double dpr;
+    png_options options;
+    std::size_t buffer;
+    figure_stats stats;
+  };
+
+  /**
+   * Map the pending frame and hand it to the publisher
+   */
+  void publish_pending() const;
+
+  /**
+   * Encode and send a frame, unless it did not change since the last one of
+   * its display. This runs on the publisher thread.
+   */
+  void publish_frame(
+    std::string const& id,
+    unsigned char const* pixels,
+    int width,
+    int height,
+    double dpr,
+    png_options const&,
+    figure_stats,
+    frame_delivery
+  ) const;
+
+  /**
+   * Wait for the job reading a pixel buffer and unmap it
+   */
+  void release_buffer(std::size_t) const;
+
+  // The context is created with the first figure and shared by all of them,
+  // which are drawn on pooled framebuffer objects
+  mutable std::unique_ptr<offscreen_context> m_context;
+  // The render daemon named by XEUS_OCTAVE_RENDER_SOCKET, which draws the
+  // figures instead of the local context while it is reachable
+  mutable std::unique_ptr<remote_opengl_functions> m_remote;
+  // The threads drawing the figure snapshots, with the render_threads option
+  mutable std::unique_ptr<render_pool> m_pool;
+  // The figures with snapshots queued on the render threads since they were
+  // last waited for
+  mutable std::unordered_set<double> m_pooled_figures;
+  mutable framebuffer_pool m_framebuffers;
+
+  // Kept between the redraws, so that its arrays are allocated only once
+  mutable tiled_opengl_functions m_glfcns;
+  // Limit of the driver, queried with the first figure
+  mutable int m_max_tile_size = 0;
+
+  // The geometry of the objects drawn in the previous redraws
+  mutable display_list_cache m_display_lists;
+
+  struct frame
+  {
+    std::uint64_t hash;
+    int width;
+    int height;
+    double dpr;
+    // Hashes of the tiles of the live frames, to find the parts which change
+    // in the next one
+    std::vector<std::uint64_t> tiles = {};
+
+    bool operator==(frame const& other) const
+    {
+      return hash == other.hash && width == other.width && height == other.height && dpr == other.dpr;
+    }
+  };
+
+  // The last frame sent to each display, to avoid sending the same pixels
+  // again. It is only accessed from the publisher thread.
+  mutable std::unordered_map<std::string, frame> m_last_frames;
+  // Likewise for the statistics of the last frame of each display
+  mutable std::unordered_map<std::string, figure_stats> m_stats;
+
+  // Double buffered readback: a frame is read in one buffer while the
+  // previous one is encoded from the other, mapped, buffer
+  mutable std::array<pixel_buffer, 2> m_buffers;
+  mutable std::array<std::future<void>, 2> m_readers;
+  mutable std::size_t m_next_buffer = 0;
+  mutable std::optional<pending_frame> m_pending;
+  // Whether the frames are drawn and published at the end of the cell
+  mutable bool m_flushing = false;
+
+  // When the figures were last drawn, and the figures whose redraws were
+  // throttled since then, by figure handle
+  mutable std::unordered_map<double, std::chrono::steady_clock::time_point> m_last_redraws;
+  mutable std::unordered_map<double, octave::graphics_object> m_deferred;
+
+  // Time the last render of each figure took, in microseconds per pixel
+  mutable std::unordered_map<double, double> m_render_costs;
+  // The figures whose snapshots could not be recorded, which the render
+  // threads do not draw
+  mutable std::unordered_set<double> m_direct_figures;
 };
 
 /**
@@ -60,12 +328,58 @@ public:
   bool is_valid() const override { return true; }
 
   bool initialize(octave::graphics_object const&) override;
-  void send_figure(octave::graphics_object const&, std::vector<char> const&, int, int, double) const override;
+  void send_figure(
+    std::string const& id, std::vector<char> const&, int, int, double, figure_stats const&, frame_delivery
+  ) const override;
+  bool send_tiles(
+    std::string const& id,
+    unsigned char const* pixels,
+    int width,
+    int height,
+    double dpr,
+    std::vector<dirty_rect> const&,
+    png_options const&,
+    figure_stats&
+  ) const override;
+  void frames_flushed() const override;
   void show_figure(octave::graphics_object const&) const override;
+
+private:
+
+  /**
+   * Replace the content of the display with the image
+   */
+  void update_display(
+    std::string const& id, std::vector<char> const&, int, int, double, figure_stats const&
+  ) const;
+
+  struct streamed_frame
+  {
+    // The frames sent in tiles are only encoded if they must be published
+    std::vector<char> img;
+    std::vector<unsigned char> pixels;
+    png_options options;
+    int width;
+    int height;
+    double dpr;
+    figure_stats stats;
+    // Generation of the figure channel the frame was sent in
+    std::size_t generation;
+  };
+
+  // The last frame of the figures sent over the figure channel, which still
+  // has to be published in their display for the notebook to keep it. It is
+  // only accessed from the publisher thread.
+  mutable std::unordered_map<std::string, streamed_frame> m_streamed;
 };
 
 void register_all(octave::interpreter& interpreter);
 
+/**
+ * Wait for all the figures drawn so far to be published
+ */
+void flush();
+
 }  // namespace xeus_octave::tk::notebook
 
 #endif  // XEUS_OCTAVE_NOTEBOOK_TOOLKIT_H
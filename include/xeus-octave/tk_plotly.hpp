@@ -23,6 +23,7 @@
 #include <algorithm>
 #include <iostream>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -42,17 +43,46 @@ namespace nl = nlohmann;
 namespace xeus_octave::tk::plotly
 {
 
+/**
+ * A trace of a figure. The arrays of points, which take most of the room, are
+ * kept in their matrices until the figure is serialised.
+ */
+struct trace
+{
+  struct array
+  {
+    std::string name;
+    Matrix data;
+    // Whether the array is a matrix, rather than a vector
+    bool matrix = false;
+  };
+
+  nl::json attributes = nl::json::object();
+  std::vector<array> arrays;
+  // Width in pixels of the axes of the lines which can be decimated, 0 for
+  // the other traces
+  double width = 0;
+};
+
 class plotly_graphics_toolkit : public octave::base_graphics_toolkit
 {
 public:
 
-  plotly_graphics_toolkit(octave::interpreter& interp) : base_graphics_toolkit("plotly"), m_interpreter(interp) {}
+  plotly_graphics_toolkit(octave::interpreter& interp);
+  ~plotly_graphics_toolkit();
 
   bool is_valid() const override { return true; }
 
   bool initialize(octave::graphics_object const& go) override;
   void redraw_figure(octave::graphics_object const& go) const override;
   void show_figure(octave::graphics_object const& go) const override;
+  void finalize(octave::graphics_object const& go) override;
+
+  /**
+   * Publish the last figures sent over the figure channel in their displays,
+   * for the notebook to keep them
+   */
+  void flush_figures() const;
 
 private:
 
@@ -111,10 +141,11 @@ private:
   void legend(nl::json& legend, Matrix position, bool box, double lineWidth, Matrix backgroundColor) const;
 
   /**
-   * Fill the line properties
+   * Fill the line properties. The lines without markers can be decimated to
+   * the width in pixels of their axes.
    */
   void line(
-    nl::json& line,
+    trace& line,
     bool visible,
     std::string type,
     Matrix xdata,
@@ -124,14 +155,15 @@ private:
     std::string lineStyle,
     Matrix lineColor,
     double lineWidth,
-    double markerSize
+    double markerSize,
+    double width = 0
   ) const;
 
   /**
    * Fill the (3d) surface properties
    */
   void surface(
-    nl::json& surf, bool visible, Matrix xdata, Matrix ydata, Matrix zdata, Matrix cdata, Matrix colorMap, Matrix clim
+    trace& surf, bool visible, Matrix xdata, Matrix ydata, Matrix zdata, Matrix cdata, Matrix colorMap, Matrix clim
   ) const;
 
   /**
@@ -139,13 +171,26 @@ private:
    */
   void setLegendVisibility(nl::json& data, std::string name) const;
 
+  /**
+   * Send the figure to the frontends, over the figure channel if one listens
+   */
+  void send_figure(std::string const& id, std::vector<trace>& data, nl::json& layout, Matrix const& position) const;
+
 private:
 
   octave::interpreter& m_interpreter;
+  // The displays which received their figures over the figure channel
+  // since the end of the last cell
+  mutable std::set<std::string> m_streamed;
 };
 
 void register_all(octave::interpreter& interpreter);
 
+/**
+ * Publish the figures sent over the figure channel by the cell which ended
+ */
+void flush();
+
 }  // namespace xeus_octave::tk::plotly
 
 #endif  // XEUS_OCTAVE_PLOTLY_TOOLKIT_H
@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Renderer of the figures sent over the "xeus-octave.figure" comm, loaded by
+ * the frontends which support the kernel.js of the kernelspecs. The kernel
+ * sends the frames drawn while a cell runs as binary buffers, either whole or
+ * as the tiles which changed since the previous frame, and makes room for
+ * them in the display of the figure with an empty <img>. Each display is
+ * drawn on a canvas which replaces this <img>.
+ *
+ * The plotly toolkit sends its figures as JSON documents in binary buffers,
+ * drawn with the Plotly of the page on a <div> replacing an empty one. The
+ * kernel publishes the last figure in the display at the end of the cell. The
+ * ranges shown after a zoom are sent back, so that the kernel replaces the
+ * decimated lines with the points in these ranges. Once a figure is drawn,
+ * the kernel only sends what changes in it: the traces to replace, the
+ * points appended to the others and the keys of the layout.
+ */
+define(function () {
+  "use strict";
+
+  var target = "xeus-octave.figure";
+
+  // Element of each display, and the promise of its last drawing
+  var displays = {};
+  // Displays whose <img> is not in the page yet
+  var waiting = {};
+  var observer = null;
+  var comm = null;
+
+  function attach(id) {
+    var display = displays[id];
+    var slot = document.getElementById("xeus-octave-figure-" + id);
+
+    if (slot)
+      slot.parentNode.replaceChild(display.element, slot);
+
+    return display.element.isConnected;
+  }
+
+  function attachWaiting() {
+    Object.keys(waiting).forEach(function (id) {
+      if (attach(id))
+        delete waiting[id];
+    });
+
+    if (Object.keys(waiting).length === 0 && observer) {
+      observer.disconnect();
+      observer = null;
+    }
+  }
+
+  function show(id) {
+    if (attach(id))
+      return;
+
+    waiting[id] = true;
+
+    if (!observer) {
+      observer = new MutationObserver(attachWaiting);
+      observer.observe(document.body, { childList: true, subtree: true });
+    }
+  }
+
+  function getDisplay(id, tag) {
+    var display = displays[id];
+
+    if (!display || display.element.tagName !== tag.toUpperCase()) {
+      display = displays[id] = { element: document.createElement(tag), drawn: Promise.resolve() };
+      display.element.className = "xeus-octave-figure";
+    }
+
+    return display;
+  }
+
+  // Plotly, as loaded in the page or by the plotly extension of the notebook
+  function getPlotly() {
+    if (window.Plotly)
+      return Promise.resolve(window.Plotly);
+
+    return new Promise(function (resolve, reject) {
+      requirejs(["plotly"], resolve, reject);
+    });
+  }
+
+  // Ranges of the x axes in a plotly_relayout event, null for the axes which
+  // were reset
+  function visibleRanges(event) {
+    var ranges = {};
+
+    Object.keys(event).forEach(function (key) {
+      var match = /^(xaxis\d*)\.(autorange|range)(?:\[([01])\])?$/.exec(key);
+
+      if (!match)
+        return;
+
+      var axis = match[1];
+
+      if (match[2] === "autorange")
+        ranges[axis] = null;
+      else if (match[3] === undefined)
+        ranges[axis] = event[key].slice();
+      else {
+        ranges[axis] = ranges[axis] || [];
+        ranges[axis][Number(match[3])] = event[key];
+      }
+    });
+
+    return ranges;
+  }
+
+  function listen(id, display) {
+    if (display.listening)
+      return;
+
+    display.listening = true;
+    display.element.on("plotly_relayout", function (event) {
+      var ranges = visibleRanges(event);
+
+      if (comm && Object.keys(ranges).length > 0)
+        comm.send({ type: "relayout", display_id: id, ranges: ranges });
+    });
+  }
+
+  function decodeArray(value) {
+    if (!value || value.dtype !== "f8" || value.shape)
+      return value;
+
+    var bytes = atob(value.bdata);
+    var array = new Uint8Array(bytes.length);
+
+    for (var i = 0; i < bytes.length; i++)
+      array[i] = bytes.charCodeAt(i);
+
+    return new Float64Array(array.buffer);
+  }
+
+  // The points of the traces are decoded, so that they can be extended
+  function decodeTrace(trace) {
+    ["x", "y", "z", "r", "theta"].forEach(function (key) {
+      if (key in trace)
+        trace[key] = decodeArray(trace[key]);
+    });
+
+    return trace;
+  }
+
+  function concat(a, b) {
+    if (!(a instanceof Float64Array))
+      return Array.from(a).concat(Array.from(b));
+
+    var result = new Float64Array(a.length + b.length);
+    result.set(a);
+    result.set(b, a.length);
+
+    return result;
+  }
+
+  function receivePlotly(data, buffer) {
+    var display = getDisplay(data.display_id, "div");
+    var figure = JSON.parse(new TextDecoder().decode(buffer));
+
+    figure.data.forEach(decodeTrace);
+
+    display.drawn = display.drawn
+      .then(getPlotly)
+      .then(function (Plotly) {
+        show(data.display_id);
+        return Plotly.react(display.element, figure.data, figure.layout);
+      })
+      .then(function () {
+        listen(data.display_id, display);
+      })
+      .catch(function (error) {
+        console.error("Cannot draw the plotly figure", error);
+      });
+  }
+
+  function receiveUpdate(data, buffer) {
+    var display = displays[data.display_id];
+
+    if (!display)
+      return;
+
+    var update = JSON.parse(new TextDecoder().decode(buffer));
+
+    display.drawn = display.drawn
+      .then(getPlotly)
+      .then(function (Plotly) {
+        // The display may have been published again since the figure was
+        // drawn
+        show(data.display_id);
+
+        var traces = display.element.data.slice(0, update.length);
+        var layout = display.element.layout;
+
+        update.traces.forEach(function (replaced) {
+          traces[replaced[0]] = decodeTrace(replaced[1]);
+        });
+
+        update.extend.forEach(function (extended) {
+          var trace = traces[extended[0]];
+
+          Object.keys(extended[1]).forEach(function (key) {
+            trace[key] = concat(trace[key], decodeArray(extended[1][key]));
+          });
+        });
+
+        Object.keys(update.layout).forEach(function (key) {
+          if (update.layout[key] === null)
+            delete layout[key];
+          else
+            layout[key] = update.layout[key];
+        });
+
+        // The traces are changed in place, which Plotly only notices with a
+        // new revision
+        layout.datarevision = (layout.datarevision || 0) + 1;
+
+        return Plotly.react(display.element, traces, layout);
+      })
+      .catch(function (error) {
+        console.error("Cannot update the plotly figure", error);
+      });
+  }
+
+  function receiveRestyle(data, buffer) {
+    var display = displays[data.display_id];
+
+    if (!display)
+      return;
+
+    var update = JSON.parse(new TextDecoder().decode(buffer));
+
+    Object.keys(update).forEach(function (key) {
+      update[key] = update[key].map(decodeArray);
+    });
+
+    display.drawn = display.drawn
+      .then(getPlotly)
+      .then(function (Plotly) {
+        return Plotly.restyle(display.element, update, data.traces);
+      })
+      .catch(function (error) {
+        console.error("Cannot update the plotly figure", error);
+      });
+  }
+
+  function draw(display, data, bitmaps) {
+    var canvas = display.element;
+    var context = canvas.getContext("2d");
+
+    if (data.type === "figure") {
+      canvas.width = bitmaps[0].width;
+      canvas.height = bitmaps[0].height;
+      context.drawImage(bitmaps[0], 0, 0);
+    } else {
+      data.tiles.forEach(function (tile, i) {
+        context.drawImage(bitmaps[i], tile.x, tile.y);
+      });
+    }
+
+    canvas.style.width = data.width + "px";
+    canvas.style.height = data.height + "px";
+
+    bitmaps.forEach(function (bitmap) {
+      bitmap.close();
+    });
+  }
+
+  function receive(msg) {
+    var data = msg.content.data;
+
+    if (!msg.buffers)
+      return;
+
+    if (data.type === "plotly") {
+      receivePlotly(data, msg.buffers[0]);
+      return;
+    }
+
+    if (data.type === "update") {
+      receiveUpdate(data, msg.buffers[0]);
+      return;
+    }
+
+    if (data.type === "restyle") {
+      receiveRestyle(data, msg.buffers[0]);
+      return;
+    }
+
+    if (data.type !== "figure" && data.type !== "tiles")
+      return;
+
+    var id = data.display_id;
+    var display = getDisplay(id, "canvas");
+
+    var images = msg.buffers.map(function (buffer) {
+      return createImageBitmap(new Blob([buffer], { type: data.mimetype }));
+    });
+
+    // The tiles must be drawn in order, on top of the previous frame
+    display.drawn = display.drawn
+      .then(function () {
+        return Promise.all(images);
+      })
+      .then(function (bitmaps) {
+        draw(display, data, bitmaps);
+        show(id);
+      });
+  }
+
+  function connect(kernel) {
+    comm = kernel.comm_manager.new_comm(target, {});
+    comm.on_msg(receive);
+  }
+
+  return {
+    onload: function () {
+      var notebook = Jupyter.notebook;
+
+      if (notebook.kernel && notebook.kernel.is_connected())
+        connect(notebook.kernel);
+
+      // The comms do not survive the restarts of the kernel
+      notebook.events.on("kernel_ready.Kernel", function (event, data) {
+        connect(data.kernel);
+      });
+    },
+  };
+});
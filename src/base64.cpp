@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define XEUS_OCTAVE_BASE64_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define XEUS_OCTAVE_BASE64_NEON
+#include <arm_neon.h>
+#endif
+
+#include "xeus-octave/base64.hpp"
+
+namespace xeus_octave::utils
+{
+
+namespace
+{
+
+constexpr char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * Encode the remaining bytes, with the padding
+ */
+void encode_scalar(unsigned char const* in, std::size_t size, char* out)
+{
+  for (; size >= 3; size -= 3, in += 3, out += 4)
+  {
+    auto const block = (std::uint32_t{in[0]} << 16) | (std::uint32_t{in[1]} << 8) | in[2];
+    out[0] = alphabet[(block >> 18) & 0x3f];
+    out[1] = alphabet[(block >> 12) & 0x3f];
+    out[2] = alphabet[(block >> 6) & 0x3f];
+    out[3] = alphabet[block & 0x3f];
+  }
+
+  if (size == 0)
+    return;
+
+  auto const block = (std::uint32_t{in[0]} << 16) | (size == 2 ? std::uint32_t{in[1]} << 8 : 0);
+  out[0] = alphabet[(block >> 18) & 0x3f];
+  out[1] = alphabet[(block >> 12) & 0x3f];
+  out[2] = size == 2 ? alphabet[(block >> 6) & 0x3f] : '=';
+  out[3] = '=';
+}
+
+// The vector encoders handle the whole blocks they can, and return how many
+// bytes they consumed. Each of them writes 4 characters for 3 bytes.
+
+#ifdef XEUS_OCTAVE_BASE64_X86
+
+// The sextets are split and translated to ASCII as described by Wojciech Muła
+// in "Base64 encoding with SIMD instructions"
+
+__attribute__((target("ssse3"))) __m128i split_ssse3(__m128i in)
+{
+  // Each 32 bit lane gets the bytes 1, 0, 2, 1 of a block
+  in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+  auto const t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+  auto const t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  auto const t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+  auto const t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+
+  return _mm_or_si128(t1, t3);
+}
+
+__attribute__((target("ssse3"))) __m128i translate_ssse3(__m128i indices)
+{
+  // The offset to add to each sextet depends on its range: A-Z, a-z, 0-9, +
+  // and /
+  auto const offsets =
+    _mm_setr_epi8(71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 65, 0, 0);
+
+  auto range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+  auto const upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+  range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+
+  return _mm_add_epi8(_mm_shuffle_epi8(offsets, range), indices);
+}
+
+__attribute__((target("ssse3"))) std::size_t encode_ssse3(unsigned char const* in, std::size_t size, char* out)
+{
+  std::size_t done = 0;
+
+  // 16 bytes are loaded for 12 encoded
+  for (; size - done >= 16; done += 12, out += 16)
+  {
+    auto const block = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + done));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), translate_ssse3(split_ssse3(block)));
+  }
+
+  return done;
+}
+
+__attribute__((target("avx2"))) __m256i split_avx2(__m256i in)
+{
+  in = _mm256_shuffle_epi8(
+    in,
+    _mm256_set_epi8(
+      10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1, 10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1
+    )
+  );
+
+  auto const t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+  auto const t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+  auto const t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+  auto const t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+
+  return _mm256_or_si256(t1, t3);
+}
+
+__attribute__((target("avx2"))) __m256i translate_avx2(__m256i indices)
+{
+  auto const offsets = _mm256_setr_epi8(
+    71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 65, 0, 0,
+    71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 65, 0, 0
+  );
+
+  auto range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+  auto const upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+  range = _mm256_or_si256(range, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+
+  return _mm256_add_epi8(_mm256_shuffle_epi8(offsets, range), indices);
+}
+
+__attribute__((target("avx2"))) std::size_t encode_avx2(unsigned char const* in, std::size_t size, char* out)
+{
+  std::size_t done = 0;
+
+  // Each 128 bit lane encodes 12 bytes, loaded with the 4 following ones
+  for (; size - done >= 28; done += 24, out += 32)
+  {
+    auto const low = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + done));
+    auto const high = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + done + 12));
+    auto const block = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), translate_avx2(split_avx2(block)));
+  }
+
+  return done;
+}
+
+using encoder = std::size_t (*)(unsigned char const*, std::size_t, char*);
+
+/**
+ * The best encoder supported by the CPU, chosen once
+ */
+encoder vector_encoder()
+{
+  static encoder const best = []() -> encoder
+  {
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+      return encode_avx2;
+    if (__builtin_cpu_supports("ssse3"))
+      return encode_ssse3;
+    return nullptr;
+  }();
+
+  return best;
+}
+
+#endif
+
+#ifdef XEUS_OCTAVE_BASE64_NEON
+
+std::size_t encode_neon(unsigned char const* in, std::size_t size, char* out)
+{
+  uint8x16x4_t table;
+  for (int i = 0; i < 4; ++i)
+    table.val[i] = vld1q_u8(reinterpret_cast<std::uint8_t const*>(alphabet) + 16 * i);
+
+  auto const mask = vdupq_n_u8(0x3f);
+  std::size_t done = 0;
+
+  // The loads and stores (de)interleave the bytes of the blocks
+  for (; size - done >= 48; done += 48, out += 64)
+  {
+    auto const bytes = vld3q_u8(in + done);
+
+    uint8x16x4_t sextets;
+    sextets.val[0] = vshrq_n_u8(bytes.val[0], 2);
+    sextets.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(bytes.val[0], 4), vshrq_n_u8(bytes.val[1], 4)), mask);
+    sextets.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(bytes.val[1], 2), vshrq_n_u8(bytes.val[2], 6)), mask);
+    sextets.val[3] = vandq_u8(bytes.val[2], mask);
+
+    for (auto& s : sextets.val)
+      s = vqtbl4q_u8(table, s);
+
+    vst4q_u8(reinterpret_cast<std::uint8_t*>(out), sextets);
+  }
+
+  return done;
+}
+
+#endif
+
+}  // namespace
+
+void base64_encode(void const* data, std::size_t size, char* out)
+{
+  auto const* in = static_cast<unsigned char const*>(data);
+  std::size_t done = 0;
+
+#if defined(XEUS_OCTAVE_BASE64_X86)
+  if (auto const vector = vector_encoder())
+    done = vector(in, size, out);
+#elif defined(XEUS_OCTAVE_BASE64_NEON)
+  done = encode_neon(in, size, out);
+#endif
+
+  encode_scalar(in + done, size - done, out + done / 3 * 4);
+}
+
+void base64_append(void const* data, std::size_t size, std::string& out)
+{
+  auto const offset = out.size();
+  out.resize(offset + base64_size(size));
+  base64_encode(data, size, out.data() + offset);
+}
+
+}  // namespace xeus_octave::utils
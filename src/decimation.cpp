@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "xeus-octave/decimation.hpp"
+
+namespace xeus_octave::tk::plotly
+{
+
+namespace
+{
+
+std::vector<std::size_t> all_points(std::size_t size)
+{
+  std::vector<std::size_t> indices(size);
+  std::iota(indices.begin(), indices.end(), std::size_t{0});
+  return indices;
+}
+
+std::vector<std::size_t> decimate_minmax(
+  double const* x, double const* y, std::size_t size, double lo, double hi, bool log, std::size_t columns
+)
+{
+  auto const position = [log](double value) { return log ? std::log10(value) : value; };
+  auto const origin = position(lo);
+  auto const scale = static_cast<double>(columns) / (position(hi) - origin);
+
+  if (!std::isfinite(origin) || !std::isfinite(scale) || scale <= 0)
+    return all_points(size);
+
+  // Column of each point, the points at the left of zero on log axes falling
+  // in the leftmost one
+  auto const column = [&](std::size_t i)
+  {
+    auto const c = std::floor((position(x[i]) - origin) * scale);
+    return std::isnan(c) ? -1e15 : std::clamp(c, -1e15, 1e15);
+  };
+
+  std::vector<std::size_t> indices;
+  std::vector<std::size_t> bucket;
+
+  for (std::size_t first = 0; first < size;)
+  {
+    auto const c = column(first);
+    auto last = first;
+    auto min = size;
+    auto max = size;
+    auto gap = size;
+
+    for (; last < size && column(last) == c; ++last)
+    {
+      // The NaN make gaps in the lines, which must be kept
+      if (std::isnan(y[last]))
+      {
+        if (gap == size)
+          gap = last;
+      }
+      else
+      {
+        if (min == size || y[last] < y[min])
+          min = last;
+        if (max == size || y[last] > y[max])
+          max = last;
+      }
+    }
+
+    bucket = {first, min, max, gap, last - 1};
+    std::sort(bucket.begin(), bucket.end());
+
+    for (auto i : bucket)
+      if (i < size && (indices.empty() || indices.back() != i))
+        indices.push_back(i);
+
+    first = last;
+  }
+
+  return indices;
+}
+
+std::vector<std::size_t> decimate_lttb(double const* x, double const* y, std::size_t size, std::size_t points)
+{
+  if (points >= size || points < 3)
+    return all_points(size);
+
+  std::vector<std::size_t> indices;
+  indices.reserve(points);
+
+  // The first and last points are always kept, the others are split in
+  // buckets of the same size
+  auto const every = static_cast<double>(size - 2) / static_cast<double>(points - 2);
+  auto const bound = [every, size](std::size_t bucket)
+  { return std::min(static_cast<std::size_t>(std::floor(static_cast<double>(bucket) * every)) + 1, size - 1); };
+
+  std::size_t a = 0;
+  indices.push_back(a);
+
+  for (std::size_t bucket = 0; bucket < points - 2; ++bucket)
+  {
+    // Average of the next bucket, the third vertex of the triangles
+    auto const next_start = bound(bucket + 1);
+    auto const next_end = std::max(bound(bucket + 2), next_start + 1);
+    double avg_x = 0;
+    double avg_y = 0;
+
+    for (auto i = next_start; i < next_end; ++i)
+    {
+      avg_x += x[i];
+      avg_y += y[i];
+    }
+
+    avg_x /= static_cast<double>(next_end - next_start);
+    avg_y /= static_cast<double>(next_end - next_start);
+
+    // Point of this bucket making the largest triangle with the last point
+    // kept and the average of the next bucket
+    auto best = bound(bucket);
+    double best_area = -1;
+
+    for (auto i = bound(bucket); i < bound(bucket + 1); ++i)
+    {
+      auto const area = std::abs((x[a] - avg_x) * (y[i] - y[a]) - (x[a] - x[i]) * (avg_y - y[a]));
+
+      if (area > best_area)
+      {
+        best_area = area;
+        best = i;
+      }
+    }
+
+    indices.push_back(best);
+    a = best;
+  }
+
+  indices.push_back(size - 1);
+
+  return indices;
+}
+
+}  // namespace
+
+std::string to_string(decimation method)
+{
+  switch (method)
+  {
+  case decimation::none:
+    return "none";
+  case decimation::minmax:
+    return "minmax";
+  case decimation::lttb:
+    return "lttb";
+  }
+
+  return "";
+}
+
+bool from_string(std::string const& name, decimation& method)
+{
+  for (auto m : {decimation::none, decimation::minmax, decimation::lttb})
+  {
+    if (to_string(m) == name)
+    {
+      method = m;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool is_increasing(double const* x, std::size_t size)
+{
+  for (std::size_t i = 1; i < size; ++i)
+    if (!(x[i] >= x[i - 1]))
+      return false;
+
+  return size == 0 || !std::isnan(x[0]);
+}
+
+std::vector<std::size_t> decimate(
+  decimation method,
+  double const* x,
+  double const* y,
+  std::size_t size,
+  double lo,
+  double hi,
+  bool log,
+  std::size_t columns
+)
+{
+  if (method == decimation::none || size == 0)
+    return all_points(size);
+
+  // LTTB does not keep the gaps of the lines
+  if (method == decimation::lttb && std::none_of(y, y + size, [](double v) { return std::isnan(v); }))
+  {
+    // Two points per column of the range shown, at the same density outside
+    // of it
+    auto const position = [log](double value) { return log ? std::log10(value) : value; };
+    auto const span = (position(x[size - 1]) - position(x[0])) / (position(hi) - position(lo));
+
+    if (!std::isfinite(span))
+      return all_points(size);
+
+    auto const points = std::ceil(std::max(span, 0.0) * 2 * static_cast<double>(columns));
+
+    return decimate_lttb(x, y, size, static_cast<std::size_t>(std::min(points, static_cast<double>(size))));
+  }
+
+  return decimate_minmax(x, y, size, lo, hi, log, columns);
+}
+
+}  // namespace xeus_octave::tk::plotly
@@ -26,6 +26,7 @@
 #include <nlohmann/json.hpp>
 #include <regex>
 
+#include "xeus-octave/output.hpp"
 #include "xeus-octave/utils.hpp"
 #include "xeus-octave/xinterpreter.hpp"
 #include "xeus/xinterpreter.hpp"
@@ -70,6 +71,7 @@ octave_value_list display_data(octave_value_list const& args, int /*nargout*/)
     }
   }
 
+  std::lock_guard<std::mutex> lock(xeus_octave::io::publish_mutex());
   xeus::get_interpreter().display_data(data, metadata, nl::json(nl::json::value_t::object));
 
   return ovl();
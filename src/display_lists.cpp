@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "xeus-octave/opengl.hpp"
+
+#include <octave/gl-render.h>
+#include <octave/graphics.h>
+#include <octave/interpreter-private.h>
+#include <octave/ov.h>
+
+#include "xeus-octave/display_lists.hpp"
+#include "xeus-octave/hash.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+namespace
+{
+
+std::uint64_t hash_value(octave_value const& value, std::uint64_t seed)
+{
+  if (value.is_string())
+  {
+    auto const s = value.string_value();
+    return utils::xxhash64(s.data(), s.size(), seed);
+  }
+
+  auto const m = value.matrix_value();
+  return utils::xxhash64(m.data(), static_cast<std::size_t>(m.numel()) * sizeof(double), seed);
+}
+
+/**
+ * The number of lights of an axes, which enable the lighting of its surfaces
+ * and patches
+ */
+std::size_t count_lights(octave::axes::properties const& props)
+{
+  auto& gh_mgr = octave::__get_gh_manager__();
+  auto const children = props.get_all_children();
+  std::size_t lights = 0;
+
+  for (octave_idx_type i = 0; i < children.numel(); i++)
+    if (gh_mgr.get_object(children(i)).isa("light"))
+      lights++;
+
+  return lights;
+}
+
+}  // namespace
+
+void display_list_cache::touch(double handle)
+{
+  if (auto it = m_entries.find(handle); it != m_entries.end())
+    it->second.generation++;
+}
+
+void display_list_cache::begin(double figure)
+{
+  m_figure = figure;
+  m_frame++;
+}
+
+void display_list_cache::end(octave::opengl_functions& glfcns)
+{
+  for (auto it = m_entries.begin(); it != m_entries.end();)
+  {
+    auto const& e = it->second;
+
+    if (e.figure == m_figure && e.frame != m_frame)
+    {
+      glfcns.glDeleteLists(e.list, 1);
+      m_points -= e.points;
+      it = m_entries.erase(it);
+    }
+    else
+      ++it;
+  }
+}
+
+void display_list_cache::forget(double figure, octave::opengl_functions& glfcns)
+{
+  for (auto it = m_entries.begin(); it != m_entries.end();)
+  {
+    auto const& e = it->second;
+
+    if (e.figure == figure)
+    {
+      glfcns.glDeleteLists(e.list, 1);
+      m_points -= e.points;
+      it = m_entries.erase(it);
+    }
+    else
+      ++it;
+  }
+}
+
+void display_list_cache::clear()
+{
+  m_entries.clear();
+  m_points = 0;
+}
+
+GLuint display_list_cache::find(double handle, std::uint64_t context)
+{
+  auto it = m_entries.find(handle);
+  if (it == m_entries.end())
+    return 0;
+
+  auto& e = it->second;
+
+  // A stale list is left unused, and deleted at the end of the redraw if it
+  // is not replaced
+  if (!(e.compiled == key{e.generation, context}))
+    return 0;
+
+  e.frame = m_frame;
+
+  return e.list;
+}
+
+void display_list_cache::insert(
+  double handle, std::uint64_t context, std::size_t points, GLuint list, octave::opengl_functions& glfcns
+)
+{
+  auto& e = m_entries.try_emplace(handle, entry{m_figure}).first->second;
+
+  if (e.list)
+  {
+    glfcns.glDeleteLists(e.list, 1);
+    m_points -= e.points;
+  }
+
+  e.compiled = {e.generation, context};
+  e.list = list;
+  e.points = points;
+  e.frame = m_frame;
+
+  m_points += points;
+}
+
+caching_renderer::caching_renderer(octave::opengl_functions& glfcns, display_list_cache* cache, double dpr) :
+  octave::opengl_renderer(glfcns), m_functions(glfcns), m_cache(cache), m_dpr(dpr)
+{
+}
+
+void caching_renderer::draw_axes(octave::axes::properties const& props)
+{
+  if (m_cache)
+  {
+    // The geometry of the children is clipped to the axes limits, scaled and
+    // colored through the colormap, while the view only goes in the matrices.
+    // The lighting of the children depends on the lights of the axes, and on
+    // the view direction for their normals.
+    auto context = utils::xxhash64(&m_dpr, sizeof(m_dpr));
+
+    for (auto const* name :
+         {"xlim",
+          "ylim",
+          "zlim",
+          "clim",
+          "alim",
+          "xscale",
+          "yscale",
+          "zscale",
+          "colormap",
+          "cameraposition",
+          "cameratarget"})
+      context = hash_value(props.get(name), context);
+
+    auto const lights = count_lights(props);
+    context = utils::xxhash64(&lights, sizeof(lights), context);
+
+    m_context = context;
+  }
+
+  opengl_renderer::draw_axes(props);
+}
+
+template <typename F>
+void caching_renderer::draw_cached(octave::base_properties const& props, bool cacheable, std::size_t points, F&& draw)
+{
+  // Markers are display lists themselves, which cannot be nested
+  if (!m_cache || !cacheable)
+  {
+    draw();
+    return;
+  }
+
+  auto const handle = props.get___myhandle__().value();
+
+  if (auto const list = m_cache->find(handle, m_context))
+  {
+    m_functions.glCallList(list);
+    return;
+  }
+
+  auto const list = m_cache->fits(points) ? m_functions.glGenLists(1) : 0;
+
+  if (!list)
+  {
+    draw();
+    return;
+  }
+
+  m_functions.glNewList(list, GL_COMPILE_AND_EXECUTE);
+  draw();
+  m_functions.glEndList();
+
+  m_cache->insert(handle, m_context, points, list, m_functions);
+}
+
+void caching_renderer::draw_line(octave::line::properties const& props)
+{
+  draw_cached(
+    props,
+    props.marker_is("none"),
+    static_cast<std::size_t>(props.get_ydata().numel()),
+    [&] { opengl_renderer::draw_line(props); }
+  );
+}
+
+void caching_renderer::draw_surface(octave::surface::properties const& props)
+{
+  draw_cached(
+    props,
+    props.marker_is("none") && !props.facecolor_is("texturemap"),
+    static_cast<std::size_t>(props.get_zdata().numel()),
+    [&] { opengl_renderer::draw_surface(props); }
+  );
+}
+
+void caching_renderer::draw_patch(octave::patch::properties const& props)
+{
+  draw_cached(
+    props,
+    props.marker_is("none"),
+    static_cast<std::size_t>(props.get_vertices().rows()),
+    [&] { opengl_renderer::draw_patch(props); }
+  );
+}
+
+}  // namespace xeus_octave::tk::notebook
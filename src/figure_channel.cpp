@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include <nlohmann/json.hpp>
+#include <xeus/xcomm.hpp>
+#include <xeus/xmessage.hpp>
+
+#include "xeus-octave/figure_channel.hpp"
+#include "xeus-octave/output.hpp"
+
+namespace xeus_octave::io
+{
+
+bool figure_channel::is_open() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return std::any_of(m_connections.begin(), m_connections.end(), [](auto const& c) { return c->open; });
+}
+
+std::size_t figure_channel::generation() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_generation;
+}
+
+bool figure_channel::send(nl::json const& data, xeus::buffer_sequence buffers) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  auto const last =
+    std::find_if(m_connections.rbegin(), m_connections.rend(), [](auto const& c) { return c->open; });
+
+  if (last == m_connections.rend())
+    return false;
+
+  for (auto const& c : m_connections)
+  {
+    if (!c->open)
+      continue;
+
+    std::lock_guard<std::mutex> publish_lock(publish_mutex());
+
+    // The buffers are only copied for the frontends before the last one
+    if (c == *last)
+      c->comm->send(nl::json::object(), data, std::move(buffers));
+    else
+      c->comm->send(nl::json::object(), data, buffers);
+  }
+
+  return true;
+}
+
+void figure_channel::on_message(std::string const& type, handler h)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_handlers.insert_or_assign(type, std::move(h));
+}
+
+void figure_channel::receive(nl::json const& data) const
+{
+  handler h;
+
+  if (!data.is_object())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto const found = m_handlers.find(data.value("type", ""));
+
+    if (found == m_handlers.end())
+      return;
+
+    h = found->second;
+  }
+
+  // The handlers may send messages back
+  h(data);
+}
+
+void figure_channel::register_target(xeus::xcomm_manager& manager)
+{
+  manager.register_comm_target(
+    target_name, [this](xeus::xcomm&& comm, xeus::xmessage const&) { accept(std::move(comm)); }
+  );
+}
+
+void figure_channel::accept(xeus::xcomm&& comm)
+{
+  auto c = std::make_shared<connection>();
+  c->comm = std::make_unique<xeus::xcomm>(std::move(comm));
+
+  c->comm->on_message(
+    [this](xeus::xmessage const& message) { receive(message.content().value("data", nl::json::object())); }
+  );
+
+  // The comm cannot be destroyed from its own handler, it is only marked as
+  // closed until the next frontend connects
+  c->comm->on_close(
+    [this, weak = std::weak_ptr<connection>(c)](xeus::xmessage const&)
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (auto closed = weak.lock())
+        closed->open = false;
+    }
+  );
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_connections.erase(
+    std::remove_if(m_connections.begin(), m_connections.end(), [](auto const& other) { return !other->open; }),
+    m_connections.end()
+  );
+  m_connections.push_back(std::move(c));
+  m_generation++;
+}
+
+figure_channel& get_figure_channel()
+{
+  static figure_channel channel;
+  return channel;
+}
+
+}  // namespace xeus_octave::io
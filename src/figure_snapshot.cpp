@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "xeus-octave/figure_snapshot.hpp"
+#include "xeus-octave/opengl.hpp"
+#include "xeus-octave/render_protocol.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+namespace
+{
+
+// The queries of the renderer on the limits of the driver
+constexpr std::array<GLenum, 14> limit_names = {
+  GL_ALIASED_LINE_WIDTH_RANGE,
+  GL_ALIASED_POINT_SIZE_RANGE,
+  GL_LINE_WIDTH_RANGE,
+  GL_MAX_ATTRIB_STACK_DEPTH,
+  GL_MAX_CLIP_PLANES,
+  GL_MAX_LIGHTS,
+  GL_MAX_LIST_NESTING,
+  GL_MAX_MODELVIEW_STACK_DEPTH,
+  GL_MAX_NAME_STACK_DEPTH,
+  GL_MAX_PROJECTION_STACK_DEPTH,
+  GL_MAX_RENDERBUFFER_SIZE,
+  GL_MAX_TEXTURE_SIZE,
+  GL_MAX_VIEWPORT_DIMS,
+  GL_POINT_SIZE_RANGE,
+};
+
+constexpr std::array<GLenum, 4> string_names = {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_EXTENSIONS};
+
+template <typename T> void put_values(std::vector<GLdouble> const& values, message_writer& result)
+{
+  std::vector<T> converted;
+
+  for (auto const value : values)
+  {
+    if constexpr (std::is_same_v<T, GLboolean>)
+      converted.push_back(value != 0 ? GL_TRUE : GL_FALSE);
+    else
+      converted.push_back(static_cast<T>(value));
+  }
+
+  result.put_array(converted.data(), converted.size());
+}
+
+}  // namespace
+
+driver_limits query_driver_limits()
+{
+  driver_limits limits;
+
+  for (auto const pname : limit_names)
+  {
+    std::array<GLdouble, 16> values = {};
+    glGetDoublev(pname, values.data());
+    limits.values[pname].assign(values.begin(), values.begin() + static_cast<std::ptrdiff_t>(get_value_count(pname)));
+  }
+
+  for (auto const name : string_names)
+  {
+    auto const* string = reinterpret_cast<char const*>(glGetString(name));
+    limits.strings[name] = string ? string : "";
+  }
+
+  // Errors of the queries the driver does not know are of no interest
+  while (glGetError() != GL_NO_ERROR)
+    ;
+
+  return limits;
+}
+
+snapshot_recorder::snapshot_recorder(driver_limits const& limits, int width, int height) :
+  m_limits(limits),
+  m_width(width),
+  m_height(height),
+  m_viewport({0, 0, GLdouble(width), GLdouble(height)})
+{
+}
+
+figure_snapshot snapshot_recorder::take(bool batching)
+{
+  return {m_calls.take(), m_width, m_height, batching};
+}
+
+void snapshot_recorder::glDisable(GLenum cap)
+{
+  recording_opengl_functions::glDisable(cap);
+  m_enabled[cap] = false;
+}
+
+void snapshot_recorder::glEnable(GLenum cap)
+{
+  recording_opengl_functions::glEnable(cap);
+  m_enabled[cap] = true;
+}
+
+void snapshot_recorder::glPopAttrib()
+{
+  recording_opengl_functions::glPopAttrib();
+
+  if (m_attributes.empty())
+  {
+    m_complete = false;
+    return;
+  }
+
+  auto saved = std::move(m_attributes.back());
+  m_attributes.pop_back();
+
+  if (saved.mask & GL_VIEWPORT_BIT)
+    m_viewport = saved.viewport;
+
+  // Most attribute groups hold some of the capabilities, which are only
+  // tracked as a whole
+  if (saved.mask & GL_ENABLE_BIT)
+  {
+    m_enabled = std::move(saved.enabled);
+    m_enabled_known = saved.enabled_known;
+  }
+  else if (saved.mask & ~GLbitfield(GL_VIEWPORT_BIT))
+  {
+    m_enabled.clear();
+    m_enabled_known = false;
+  }
+}
+
+void snapshot_recorder::glPushAttrib(GLbitfield mask)
+{
+  recording_opengl_functions::glPushAttrib(mask);
+  m_attributes.push_back({mask, m_enabled, m_enabled_known, m_viewport});
+}
+
+void snapshot_recorder::glViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+  recording_opengl_functions::glViewport(x, y, width, height);
+  m_viewport = {GLdouble(x), GLdouble(y), GLdouble(width), GLdouble(height)};
+}
+
+bool snapshot_recorder::is_enabled(GLenum cap, GLboolean& enabled) const
+{
+  auto const found = m_enabled.find(cap);
+
+  if (found != m_enabled.end())
+    enabled = found->second ? GL_TRUE : GL_FALSE;
+  else if (m_enabled_known)
+    enabled = cap == GL_DITHER || cap == GL_MULTISAMPLE ? GL_TRUE : GL_FALSE;
+  else
+    return false;
+
+  return true;
+}
+
+bool snapshot_recorder::query(std::vector<char>& result)
+{
+  // The query is answered here and is not part of the snapshot
+  std::vector<char> const last(m_calls.data().begin() + static_cast<std::ptrdiff_t>(m_last_call), m_calls.data().end());
+  m_calls.truncate(m_last_call);
+
+  message_reader reader(last);
+  message_writer answer;
+  auto const function = reader.get<gl_call>();
+
+  switch (function)
+  {
+  case gl_call::get_booleanv:
+  case gl_call::get_doublev:
+  case gl_call::get_floatv:
+  case gl_call::get_integerv:
+  {
+    auto const pname = reader.get<GLenum>();
+    auto values = std::vector<GLdouble>(m_viewport.begin(), m_viewport.end());
+
+    if (pname != GL_VIEWPORT)
+    {
+      auto const found = m_limits.values.find(pname);
+      if (found == m_limits.values.end())
+        break;
+
+      values = found->second;
+    }
+
+    if (function == gl_call::get_booleanv)
+      put_values<GLboolean>(values, answer);
+    else if (function == gl_call::get_doublev)
+      put_values<GLdouble>(values, answer);
+    else if (function == gl_call::get_floatv)
+      put_values<GLfloat>(values, answer);
+    else
+      put_values<GLint>(values, answer);
+
+    result = answer.take();
+    return true;
+  }
+  case gl_call::get_error:
+    answer.put(GLenum(GL_NO_ERROR));
+    result = answer.take();
+    return true;
+  case gl_call::get_string:
+  {
+    auto const found = m_limits.strings.find(reader.get<GLenum>());
+    if (found == m_limits.strings.end())
+      break;
+
+    result.assign(found->second.begin(), found->second.end());
+    return true;
+  }
+  case gl_call::is_enabled:
+  {
+    GLboolean enabled = GL_FALSE;
+    if (!is_enabled(reader.get<GLenum>(), enabled))
+      break;
+
+    answer.put(enabled);
+    result = answer.take();
+    return true;
+  }
+  default:
+    break;
+  }
+
+  // Reading pixels or selecting needs the figure to be drawn
+  m_complete = false;
+  return false;
+}
+
+}  // namespace xeus_octave::tk::notebook
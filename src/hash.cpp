@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "xeus-octave/hash.hpp"
+
+namespace xeus_octave::utils
+{
+
+namespace
+{
+
+constexpr std::uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+constexpr std::uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr std::uint64_t prime3 = 0x165667B19E3779F9ULL;
+constexpr std::uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr std::uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+std::uint64_t rotl(std::uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+// The hash is only compared within the same process, so the byte order of
+// the reads does not matter
+std::uint64_t read64(unsigned char const* p)
+{
+  std::uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+std::uint64_t read32(unsigned char const* p)
+{
+  std::uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+std::uint64_t accumulate(std::uint64_t acc, std::uint64_t input)
+{
+  acc += input * prime2;
+  acc = rotl(acc, 31);
+  return acc * prime1;
+}
+
+std::uint64_t merge(std::uint64_t acc, std::uint64_t v)
+{
+  acc ^= accumulate(0, v);
+  return acc * prime1 + prime4;
+}
+
+}  // namespace
+
+std::uint64_t xxhash64(void const* data, std::size_t size, std::uint64_t seed)
+{
+  auto const* p = static_cast<unsigned char const*>(data);
+  auto const* const end = p + size;
+  std::uint64_t h;
+
+  if (size >= 32)
+  {
+    std::uint64_t v1 = seed + prime1 + prime2;
+    std::uint64_t v2 = seed + prime2;
+    std::uint64_t v3 = seed;
+    std::uint64_t v4 = seed - prime1;
+
+    for (; end - p >= 32; p += 32)
+    {
+      v1 = accumulate(v1, read64(p));
+      v2 = accumulate(v2, read64(p + 8));
+      v3 = accumulate(v3, read64(p + 16));
+      v4 = accumulate(v4, read64(p + 24));
+    }
+
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = merge(h, v1);
+    h = merge(h, v2);
+    h = merge(h, v3);
+    h = merge(h, v4);
+  }
+  else
+    h = seed + prime5;
+
+  h += size;
+
+  for (; end - p >= 8; p += 8)
+  {
+    h ^= accumulate(0, read64(p));
+    h = rotl(h, 27) * prime1 + prime4;
+  }
+
+  if (end - p >= 4)
+  {
+    h ^= read32(p) * prime1;
+    h = rotl(h, 23) * prime2 + prime3;
+    p += 4;
+  }
+
+  for (; p < end; p++)
+  {
+    h ^= *p * prime5;
+    h = rotl(h, 11) * prime1;
+  }
+
+  h ^= h >> 33;
+  h *= prime2;
+  h ^= h >> 29;
+  h *= prime3;
+  h ^= h >> 32;
+
+  return h;
+}
+
+}  // namespace xeus_octave::utils
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "xeus-octave/base64.hpp"
+#include "xeus-octave/json_writer.hpp"
+
+namespace xeus_octave::utils
+{
+
+void json_writer::begin_object()
+{
+  separate();
+  m_buffer.push_back('{');
+  m_empty.push_back(true);
+}
+
+void json_writer::end_object()
+{
+  m_buffer.push_back('}');
+  m_empty.pop_back();
+}
+
+void json_writer::begin_array()
+{
+  separate();
+  m_buffer.push_back('[');
+  m_empty.push_back(true);
+}
+
+void json_writer::end_array()
+{
+  m_buffer.push_back(']');
+  m_empty.pop_back();
+}
+
+void json_writer::key(std::string_view name)
+{
+  separate();
+  append_string(name);
+  m_buffer.push_back(':');
+  m_after_key = true;
+}
+
+void json_writer::number(double value)
+{
+  separate();
+
+  if (!std::isfinite(value))
+  {
+    append("null");
+    return;
+  }
+
+  char text[32];
+
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+  // The shortest text which reads back the same number
+  auto const end = std::to_chars(text, text + sizeof(text), value).ptr;
+  append(std::string_view(text, static_cast<std::size_t>(end - text)));
+#else
+  auto const length = std::snprintf(text, sizeof(text), "%.17g", value);
+  append(std::string_view(text, static_cast<std::size_t>(length)));
+#endif
+}
+
+void json_writer::boolean(bool value)
+{
+  separate();
+  append(value ? "true" : "false");
+}
+
+void json_writer::string(std::string_view value)
+{
+  separate();
+  append_string(value);
+}
+
+void json_writer::value(nl::json const& value)
+{
+  separate();
+  append(value.dump());
+}
+
+void json_writer::members(nl::json const& object)
+{
+  for (auto const& [name, value] : object.items())
+  {
+    key(name);
+    this->value(value);
+  }
+}
+
+void json_writer::number_array(double const* data, std::size_t size)
+{
+  begin_array();
+
+  for (std::size_t i = 0; i < size; ++i)
+    number(data[i]);
+
+  end_array();
+}
+
+void json_writer::typed_array(double const* data, std::size_t size, std::string_view shape)
+{
+  begin_object();
+  key("dtype");
+  string("f8");
+  key("bdata");
+  separate();
+
+  auto const bytes = size * sizeof(double);
+  auto const offset = m_buffer.size() + 1;
+
+  m_buffer.resize(offset + base64_size(bytes) + 1);
+  m_buffer[offset - 1] = '"';
+  base64_encode(data, bytes, m_buffer.data() + offset);
+  m_buffer.back() = '"';
+
+  if (!shape.empty())
+  {
+    key("shape");
+    string(shape);
+  }
+
+  end_object();
+}
+
+std::vector<char> json_writer::take()
+{
+  m_empty.clear();
+  m_after_key = false;
+  return std::move(m_buffer);
+}
+
+void json_writer::separate()
+{
+  // Values following a key, and the first values of the containers, take no
+  // comma
+  if (m_after_key)
+    m_after_key = false;
+  else if (!m_empty.empty() && !m_empty.back())
+    m_buffer.push_back(',');
+
+  if (!m_empty.empty())
+    m_empty.back() = false;
+}
+
+void json_writer::append_string(std::string_view text)
+{
+  static constexpr char hex[] = "0123456789abcdef";
+
+  m_buffer.push_back('"');
+
+  for (auto const c : text)
+  {
+    switch (c)
+    {
+    case '"':
+      append("\\\"");
+      break;
+    case '\\':
+      append("\\\\");
+      break;
+    case '\n':
+      append("\\n");
+      break;
+    case '\r':
+      append("\\r");
+      break;
+    case '\t':
+      append("\\t");
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20)
+      {
+        append("\\u00");
+        m_buffer.push_back(hex[static_cast<unsigned char>(c) >> 4]);
+        m_buffer.push_back(hex[static_cast<unsigned char>(c) & 0xf]);
+      }
+      else
+        m_buffer.push_back(c);
+    }
+  }
+
+  m_buffer.push_back('"');
+}
+
+}  // namespace xeus_octave::utils
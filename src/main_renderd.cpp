@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "xeus-octave/config.hpp"
+#include "xeus-octave/render_daemon.hpp"
+#include "xeus-octave/render_protocol.hpp"
+
+namespace
+{
+
+volatile std::sig_atomic_t stop = 0;
+
+void request_stop(int /*signal*/)
+{
+  stop = 1;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  std::string_view const argument = argc == 2 ? argv[1] : "";
+
+  if (argument == "--version")
+  {
+    std::cout << "xoctave-renderd " << XEUS_OCTAVE_VERSION << '\n';
+    return 0;
+  }
+
+  if (argc > 2 || argument.substr(0, 1) == "-")
+  {
+    std::cerr << "Usage: xoctave-renderd [SOCKET]" << '\n';
+    return 2;
+  }
+
+  auto const socket = !argument.empty() ? std::string(argument) : xeus_octave::tk::notebook::default_render_socket();
+
+  std::signal(SIGINT, request_stop);
+  std::signal(SIGTERM, request_stop);
+  // The clients going away are noticed when sending to them
+  std::signal(SIGPIPE, SIG_IGN);
+
+  xeus_octave::tk::notebook::render_daemon daemon(socket);
+
+  if (!daemon.is_valid())
+    return 1;
+
+  std::clog << "Rendering the figures of the kernels connecting to " << socket << '\n';
+
+  daemon.run(stop);
+
+  return 0;
+}
@@ -0,0 +1,639 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "xeus-octave/opengl.hpp"
+
+#ifdef XEUS_OCTAVE_WITH_GLFW
+#include <GLFW/glfw3.h>
+#endif
+#ifdef XEUS_OCTAVE_WITH_EGL
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+#ifdef XEUS_OCTAVE_WITH_OSMESA
+#include <GL/osmesa.h>
+#endif
+
+#include "xeus-octave/offscreen.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+gl_stats& get_gl_stats()
+{
+  static gl_stats stats;
+  return stats;
+}
+
+namespace
+{
+
+/**
+ * Number of live contexts of each backend. GLFW and the EGL display are
+ * initialized once for all of them, and only terminated with the last one.
+ */
+std::size_t& live_contexts(context_backend backend)
+{
+  static std::array<std::size_t, 3> counts = {};
+  return counts[static_cast<std::size_t>(backend)];
+}
+
+#ifdef XEUS_OCTAVE_WITH_EGL
+/**
+ * Whether a space separated list of EGL extensions has the given one
+ */
+bool has_extension(char const* extensions, std::string const& name)
+{
+  if (!extensions)
+    return false;
+
+  std::istringstream list(extensions);
+  std::istream_iterator<std::string> const end;
+  return std::find(std::istream_iterator<std::string>(list), end, name) != end;
+}
+
+/**
+ * The initialized display to create the contexts on. The default display
+ * needs a display server, so the headless platforms come first: the
+ * surfaceless one of Mesa, then the first device (e.g. with the NVIDIA
+ * drivers).
+ */
+EGLDisplay initialize_egl_display()
+{
+  auto const* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  auto const get_platform_display =
+    reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+  auto const query_devices = reinterpret_cast<PFNEGLQUERYDEVICESEXTPROC>(eglGetProcAddress("eglQueryDevicesEXT"));
+
+  auto const initialize = [](EGLDisplay display)
+  { return display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr) == EGL_TRUE; };
+
+  if (get_platform_display && has_extension(extensions, "EGL_MESA_platform_surfaceless"))
+  {
+    auto display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, nullptr, nullptr);
+    if (initialize(display))
+      return display;
+  }
+
+  if (get_platform_display && query_devices && has_extension(extensions, "EGL_EXT_platform_device"))
+  {
+    EGLDeviceEXT device;
+    EGLint devices = 0;
+
+    if (query_devices(1, &device, &devices) && devices > 0)
+    {
+      auto display = get_platform_display(EGL_PLATFORM_DEVICE_EXT, device, nullptr);
+      if (initialize(display))
+        return display;
+    }
+  }
+
+  // Without these platforms, the display server or the platform chosen with
+  // EGL_PLATFORM
+  auto display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  return initialize(display) ? display : EGL_NO_DISPLAY;
+}
+#endif
+
+}  // namespace
+
+std::string to_string(context_backend backend)
+{
+  switch (backend)
+  {
+  case context_backend::glfw:
+    return "glfw";
+  case context_backend::egl:
+    return "egl";
+  case context_backend::osmesa:
+    return "osmesa";
+  }
+
+  return "";
+}
+
+bool from_string(std::string const& name, context_backend& backend)
+{
+  for (auto b : {context_backend::glfw, context_backend::egl, context_backend::osmesa})
+  {
+    if (to_string(b) == name)
+    {
+      backend = b;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+std::vector<context_backend> available_backends()
+{
+  std::vector<context_backend> backends;
+
+#ifdef XEUS_OCTAVE_WITH_GLFW
+  // A window needs a display server, which is missing on headless hosts
+#if defined(__linux__) || defined(__FreeBSD__)
+  bool const display = std::getenv("DISPLAY") || std::getenv("WAYLAND_DISPLAY");
+#else
+  bool const display = true;
+#endif
+  if (display)
+    backends.push_back(context_backend::glfw);
+#endif
+#ifdef XEUS_OCTAVE_WITH_EGL
+  backends.push_back(context_backend::egl);
+#endif
+#ifdef XEUS_OCTAVE_WITH_OSMESA
+  backends.push_back(context_backend::osmesa);
+#endif
+#ifdef XEUS_OCTAVE_WITH_GLFW
+  // Still worth a try, e.g. when GLFW is built with a null platform
+  if (!display)
+    backends.push_back(context_backend::glfw);
+#endif
+
+  return backends;
+}
+
+offscreen_context::offscreen_context(bool render_thread)
+{
+  auto const start = std::chrono::steady_clock::now();
+
+  auto backends = available_backends();
+
+  // The backend can be chosen when running the kernel
+  if (auto const* name = std::getenv("XEUS_OCTAVE_GL_BACKEND"))
+  {
+    context_backend backend;
+
+    if (!from_string(name, backend))
+      std::clog << "Unknown OpenGL backend " << name << ", expected glfw, egl or osmesa" << '\n';
+    else if (std::find(backends.begin(), backends.end(), backend) == backends.end())
+      std::clog << "OpenGL backend " << name << " is not available" << '\n';
+    else
+      backends = {backend};
+  }
+
+  for (auto backend : backends)
+  {
+    m_backend = backend;
+
+    if (create())
+      break;
+
+    std::clog << "Cannot create an OpenGL context with " << to_string(backend) << '\n';
+  }
+
+  if (!m_valid)
+    return;
+
+  gladLoadGLLoader(proc_address_loader());
+
+  auto const duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+  if (render_thread)
+  {
+    get_gl_stats().thread_contexts_created++;
+    return;
+  }
+
+  get_gl_stats().contexts_created++;
+  get_gl_stats().init_microseconds = static_cast<std::size_t>(duration.count());
+  get_gl_stats().backend = to_string(m_backend);
+
+#ifndef NDEBUG
+  std::clog << "OpenGL backend: " << to_string(m_backend) << '\n';
+  std::clog << "OpenGL vendor: " << glGetString(GL_VENDOR) << '\n';
+  std::clog << "OpenGL renderer: " << glGetString(GL_RENDERER) << '\n';
+  std::clog << "OpenGL version: " << glGetString(GL_VERSION) << '\n';
+  std::clog << "OpenGL init time: " << duration.count() << '\n';
+#endif
+}
+
+offscreen_context::~offscreen_context()
+{
+  destroy();
+}
+
+bool offscreen_context::create()
+{
+  switch (m_backend)
+  {
+  case context_backend::glfw:
+#ifdef XEUS_OCTAVE_WITH_GLFW
+  {
+    glfwSetErrorCallback([](int error, char const* description)
+                         { std::clog << "GLFW Error: " << description << " (" << error << ")" << '\n'; });
+
+    glfwInitHint(GLFW_COCOA_MENUBAR, GLFW_FALSE);
+
+    if (!glfwInit())
+      return false;
+
+    // The window is never shown, and its default framebuffer is never used
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+    m_window = glfwCreateWindow(1, 1, "", NULL, NULL);
+    if (!m_window)
+    {
+      if (live_contexts(m_backend) == 0)
+        glfwTerminate();
+      return false;
+    }
+
+    glfwMakeContextCurrent(m_window);
+    break;
+  }
+#else
+    return false;
+#endif
+
+  case context_backend::egl:
+#ifdef XEUS_OCTAVE_WITH_EGL
+  {
+    auto display = initialize_egl_display();
+    if (display == EGL_NO_DISPLAY)
+      return false;
+
+    m_egl_display = display;
+
+    EGLint const config_attributes[] = {
+      EGL_SURFACE_TYPE,
+      EGL_PBUFFER_BIT,
+      EGL_RENDERABLE_TYPE,
+      EGL_OPENGL_BIT,
+      EGL_RED_SIZE,
+      8,
+      EGL_GREEN_SIZE,
+      8,
+      EGL_BLUE_SIZE,
+      8,
+      EGL_DEPTH_SIZE,
+      24,
+      EGL_STENCIL_SIZE,
+      8,
+      EGL_NONE,
+    };
+    EGLConfig config;
+    EGLint configs = 0;
+
+    if (!eglChooseConfig(display, config_attributes, &config, 1, &configs) || configs == 0)
+    {
+      destroy();
+      return false;
+    }
+
+    // As with GLFW, the pbuffer is only there to make the context current
+    EGLint const surface_attributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+    m_egl_surface = eglCreatePbufferSurface(display, config, surface_attributes);
+
+    // The octave renderer needs the compatibility profile of desktop OpenGL
+    eglBindAPI(EGL_OPENGL_API);
+    m_egl_context = eglCreateContext(display, config, EGL_NO_CONTEXT, nullptr);
+
+    if (m_egl_surface == EGL_NO_SURFACE || m_egl_context == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(display, m_egl_surface, m_egl_surface, m_egl_context))
+    {
+      destroy();
+      return false;
+    }
+
+    break;
+  }
+#else
+    return false;
+#endif
+
+  case context_backend::osmesa:
+#ifdef XEUS_OCTAVE_WITH_OSMESA
+  {
+    auto context = OSMesaCreateContextExt(OSMESA_RGBA, 24, 8, 0, nullptr);
+    if (!context)
+      return false;
+
+    m_osmesa_context = context;
+
+    if (!OSMesaMakeCurrent(context, m_osmesa_buffer.data(), GL_UNSIGNED_BYTE, 1, 1))
+    {
+      destroy();
+      return false;
+    }
+
+    break;
+  }
+#else
+    return false;
+#endif
+  }
+
+  live_contexts(m_backend)++;
+  m_valid = true;
+
+  return true;
+}
+
+void offscreen_context::destroy()
+{
+  // Whether this is the last context of the backend
+  [[maybe_unused]] bool const last = m_valid ? --live_contexts(m_backend) == 0 : live_contexts(m_backend) == 0;
+
+  switch (m_backend)
+  {
+  case context_backend::glfw:
+#ifdef XEUS_OCTAVE_WITH_GLFW
+    if (m_window)
+    {
+      glfwDestroyWindow(m_window);
+
+      if (last)
+        glfwTerminate();
+    }
+#endif
+    break;
+
+  case context_backend::egl:
+#ifdef XEUS_OCTAVE_WITH_EGL
+    if (m_egl_display)
+    {
+      if (eglGetCurrentContext() == m_egl_context)
+        eglMakeCurrent(m_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+      if (m_egl_context)
+        eglDestroyContext(m_egl_display, m_egl_context);
+      if (m_egl_surface)
+        eglDestroySurface(m_egl_display, m_egl_surface);
+
+      if (last)
+        eglTerminate(m_egl_display);
+    }
+#endif
+    break;
+
+  case context_backend::osmesa:
+#ifdef XEUS_OCTAVE_WITH_OSMESA
+    if (m_osmesa_context)
+      OSMesaDestroyContext(static_cast<OSMesaContext>(m_osmesa_context));
+#endif
+    break;
+  }
+
+  m_window = nullptr;
+  m_egl_display = m_egl_surface = m_egl_context = nullptr;
+  m_osmesa_context = nullptr;
+  m_valid = false;
+}
+
+GLADloadproc offscreen_context::proc_address_loader() const
+{
+  switch (m_backend)
+  {
+#ifdef XEUS_OCTAVE_WITH_GLFW
+  case context_backend::glfw:
+    return reinterpret_cast<GLADloadproc>(glfwGetProcAddress);
+#endif
+#ifdef XEUS_OCTAVE_WITH_EGL
+  case context_backend::egl:
+    return reinterpret_cast<GLADloadproc>(eglGetProcAddress);
+#endif
+#ifdef XEUS_OCTAVE_WITH_OSMESA
+  case context_backend::osmesa:
+    return reinterpret_cast<GLADloadproc>(OSMesaGetProcAddress);
+#endif
+  default:
+    return nullptr;
+  }
+}
+
+void offscreen_context::make_current()
+{
+  switch (m_backend)
+  {
+  case context_backend::glfw:
+#ifdef XEUS_OCTAVE_WITH_GLFW
+    if (glfwGetCurrentContext() != m_window)
+      glfwMakeContextCurrent(m_window);
+#endif
+    break;
+
+  case context_backend::egl:
+#ifdef XEUS_OCTAVE_WITH_EGL
+    if (eglGetCurrentContext() != m_egl_context)
+      eglMakeCurrent(m_egl_display, m_egl_surface, m_egl_surface, m_egl_context);
+#endif
+    break;
+
+  case context_backend::osmesa:
+#ifdef XEUS_OCTAVE_WITH_OSMESA
+    if (OSMesaGetCurrentContext() != m_osmesa_context)
+      OSMesaMakeCurrent(static_cast<OSMesaContext>(m_osmesa_context), m_osmesa_buffer.data(), GL_UNSIGNED_BYTE, 1, 1);
+#endif
+    break;
+  }
+
+  get_gl_stats().contexts_reused++;
+}
+
+void offscreen_context::release_current()
+{
+  switch (m_backend)
+  {
+  case context_backend::glfw:
+#ifdef XEUS_OCTAVE_WITH_GLFW
+    if (glfwGetCurrentContext() == m_window)
+      glfwMakeContextCurrent(nullptr);
+#endif
+    break;
+
+  case context_backend::egl:
+#ifdef XEUS_OCTAVE_WITH_EGL
+    if (eglGetCurrentContext() == m_egl_context)
+      eglMakeCurrent(m_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+#endif
+    break;
+
+  case context_backend::osmesa:
+#ifdef XEUS_OCTAVE_WITH_OSMESA
+    if (OSMesaGetCurrentContext() == m_osmesa_context)
+      OSMesaMakeCurrent(nullptr, nullptr, 0, 0, 0);
+#endif
+    break;
+  }
+}
+
+float offscreen_context::content_scale() const
+{
+  // Only GLFW knows about the monitors
+  if (m_backend != context_backend::glfw)
+    return 1;
+
+  float xscale = 1, yscale = 1;
+
+#ifdef XEUS_OCTAVE_WITH_GLFW
+  if (auto* monitor = glfwGetPrimaryMonitor())
+    glfwGetMonitorContentScale(monitor, &xscale, &yscale);
+#endif
+
+  return std::max(xscale, yscale);
+}
+
+framebuffer::framebuffer(int width, int height) : m_width(width), m_height(height)
+{
+  glGenRenderbuffers(1, &m_color);
+  glBindRenderbuffer(GL_RENDERBUFFER, m_color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+  glGenRenderbuffers(1, &m_depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, m_depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, &m_fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_color);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_depth);
+
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    std::clog << "Incomplete framebuffer (" << width << "x" << height << ")" << '\n';
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  get_gl_stats().framebuffers_created++;
+}
+
+framebuffer::~framebuffer()
+{
+  glDeleteFramebuffers(1, &m_fbo);
+  glDeleteRenderbuffers(1, &m_depth);
+  glDeleteRenderbuffers(1, &m_color);
+}
+
+void framebuffer::bind() const
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+}
+
+void framebuffer::unbind()
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+pixel_buffer::~pixel_buffer()
+{
+  // Deleting the buffer also unmaps it
+  if (m_pbo)
+    glDeleteBuffers(1, &m_pbo);
+}
+
+void pixel_buffer::read(int width, int height)
+{
+  m_size = static_cast<std::size_t>(width) * static_cast<std::size_t>(height) * 3;
+
+  // The buffer is created on first use, when the context is known to work
+  if (!m_pbo)
+    glGenBuffers(1, &m_pbo);
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo);
+
+  // The storage only grows, figures usually keep the same size
+  if (m_size > m_capacity)
+  {
+    glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(m_size), nullptr, GL_STREAM_READ);
+    m_capacity = m_size;
+  }
+
+  // With a pack buffer bound, glReadPixels only queues the transfer
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+unsigned char const* pixel_buffer::map()
+{
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo);
+  auto* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(m_size), GL_MAP_READ_BIT);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  if (!pixels)
+  {
+    std::clog << "Cannot map the pixel buffer" << '\n';
+    return nullptr;
+  }
+
+  m_mapped = true;
+
+  return static_cast<unsigned char const*>(pixels);
+}
+
+void pixel_buffer::unmap()
+{
+  if (!m_mapped)
+    return;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo);
+  glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  m_mapped = false;
+}
+
+std::unique_ptr<framebuffer> framebuffer_pool::acquire(int width, int height)
+{
+  // Look for the most recently used framebuffer with the requested size
+  auto it = std::find_if(
+    m_free.rbegin(),
+    m_free.rend(),
+    [width, height](auto const& fb) { return fb->width() == width && fb->height() == height; }
+  );
+
+  if (it == m_free.rend())
+    return std::make_unique<framebuffer>(width, height);
+
+  auto fb = std::move(*it);
+  m_free.erase(std::next(it).base());
+
+  get_gl_stats().framebuffers_reused++;
+
+  return fb;
+}
+
+void framebuffer_pool::release(std::unique_ptr<framebuffer> fb)
+{
+  m_free.push_back(std::move(fb));
+
+  // Destroy the least recently used framebuffers
+  if (m_free.size() > m_capacity)
+    m_free.erase(m_free.begin(), m_free.end() - static_cast<std::ptrdiff_t>(m_capacity));
+}
+
+}  // namespace xeus_octave::tk::notebook
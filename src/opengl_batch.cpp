@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstddef>
+
+#include "xeus-octave/opengl_batch.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+void batched_opengl_functions::glBegin(GLenum mode)
+{
+  if (!m_batching)
+  {
+    flush();
+    ::glBegin(mode);
+
+    // Everything is forwarded until glEnd
+    m_recording = m_immediate = true;
+    return;
+  }
+
+  // Only primitives of the same kind can be drawn together
+  if (mode != m_mode)
+    flush();
+
+  m_mode = mode;
+  m_recording = true;
+  m_firsts.push_back(static_cast<GLint>(m_vertices.size() / 3));
+}
+
+void batched_opengl_functions::glEnd()
+{
+  if (m_immediate)
+  {
+    ::glEnd();
+    m_immediate = false;
+  }
+  else
+  {
+    auto const count = static_cast<GLsizei>(m_vertices.size() / 3) - m_firsts.back();
+
+    if (count > 0)
+      m_counts.push_back(count);
+    else
+      m_firsts.pop_back();
+  }
+
+  m_recording = false;
+}
+
+void batched_opengl_functions::glVertex3d(GLdouble x, GLdouble y, GLdouble z)
+{
+  if (!m_recording || m_immediate)
+  {
+    ::glVertex3d(x, y, z);
+    return;
+  }
+
+  m_vertices.insert(m_vertices.end(), {x, y, z});
+  m_colors.insert(m_colors.end(), m_color.begin(), m_color.end());
+  m_normals.insert(m_normals.end(), m_normal.begin(), m_normal.end());
+  m_texcoords.insert(m_texcoords.end(), m_texcoord.begin(), m_texcoord.end());
+}
+
+void batched_opengl_functions::glColor4d(GLdouble red, GLdouble green, GLdouble blue, GLdouble alpha)
+{
+  glColor4f(
+    static_cast<GLfloat>(red),
+    static_cast<GLfloat>(green),
+    static_cast<GLfloat>(blue),
+    static_cast<GLfloat>(alpha)
+  );
+}
+
+void batched_opengl_functions::glColor4f(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+  m_color = {red, green, blue, alpha};
+
+  // Outside primitives the color is also used by display lists and pixels
+  if (!m_recording || m_immediate)
+    ::glColor4f(red, green, blue, alpha);
+}
+
+void batched_opengl_functions::glNormal3d(GLdouble nx, GLdouble ny, GLdouble nz)
+{
+  m_normal = {static_cast<GLfloat>(nx), static_cast<GLfloat>(ny), static_cast<GLfloat>(nz)};
+
+  if (!m_recording || m_immediate)
+    ::glNormal3d(nx, ny, nz);
+}
+
+void batched_opengl_functions::glTexCoord2d(GLdouble s, GLdouble t)
+{
+  m_texcoord = {static_cast<GLfloat>(s), static_cast<GLfloat>(t)};
+
+  if (!m_recording || m_immediate)
+    ::glTexCoord2d(s, t);
+}
+
+void batched_opengl_functions::flush()
+{
+  if (m_counts.empty())
+    return;
+
+  draw_arrays();
+
+  m_vertices.clear();
+  m_colors.clear();
+  m_normals.clear();
+  m_texcoords.clear();
+  m_firsts.clear();
+  m_counts.clear();
+
+  // The current attributes are undefined after drawing from arrays
+  ::glColor4fv(m_color.data());
+  ::glNormal3fv(m_normal.data());
+  ::glTexCoord2fv(m_texcoord.data());
+}
+
+void batched_opengl_functions::interrupt()
+{
+  if (!m_recording)
+    flush();
+  else if (!m_immediate)
+    fall_back();
+}
+
+void batched_opengl_functions::fall_back()
+{
+  auto const first = static_cast<std::size_t>(m_firsts.back());
+  m_firsts.pop_back();
+
+  // The previous primitives are drawn first, to keep the drawing order
+  auto const vertices = m_vertices.size() / 3;
+  if (!m_counts.empty())
+    draw_arrays();
+
+  ::glBegin(m_mode);
+
+  for (auto i = first; i < vertices; i++)
+  {
+    ::glColor4fv(&m_colors[4 * i]);
+    ::glNormal3fv(&m_normals[3 * i]);
+    ::glTexCoord2fv(&m_texcoords[2 * i]);
+    ::glVertex3dv(&m_vertices[3 * i]);
+  }
+
+  // The attributes set after the last vertex
+  ::glColor4fv(m_color.data());
+  ::glNormal3fv(m_normal.data());
+  ::glTexCoord2fv(m_texcoord.data());
+
+  m_vertices.clear();
+  m_colors.clear();
+  m_normals.clear();
+  m_texcoords.clear();
+  m_firsts.clear();
+  m_counts.clear();
+
+  m_immediate = true;
+}
+
+void batched_opengl_functions::draw_arrays() const
+{
+  ::glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+
+  ::glEnableClientState(GL_VERTEX_ARRAY);
+  ::glEnableClientState(GL_COLOR_ARRAY);
+  ::glEnableClientState(GL_NORMAL_ARRAY);
+  ::glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+  ::glVertexPointer(3, GL_DOUBLE, 0, m_vertices.data());
+  ::glColorPointer(4, GL_FLOAT, 0, m_colors.data());
+  ::glNormalPointer(GL_FLOAT, 0, m_normals.data());
+  ::glTexCoordPointer(2, GL_FLOAT, 0, m_texcoords.data());
+
+  if (m_counts.size() == 1)
+    ::glDrawArrays(m_mode, m_firsts[0], m_counts[0]);
+  else
+    ::glMultiDrawArrays(m_mode, m_firsts.data(), m_counts.data(), static_cast<GLsizei>(m_counts.size()));
+
+  ::glPopClientAttrib();
+}
+
+}  // namespace xeus_octave::tk::notebook
@@ -0,0 +1,579 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "xeus-octave/opengl.hpp"
+#include "xeus-octave/opengl_recording.hpp"
+#include "xeus-octave/render_protocol.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+namespace
+{
+
+// The derived classes are asked to flush the calls once this many bytes are
+// buffered
+constexpr std::size_t calls_batch_size = std::size_t(1) << 20;
+
+}  // namespace
+
+template <typename... T> void recording_opengl_functions::call(gl_call function, T const&... args)
+{
+  if (!is_recording())
+    return;
+
+  // Flushed before the call rather than after, as it may be followed by its
+  // arrays
+  if (m_calls.size() >= calls_batch_size)
+    flush_calls();
+
+  m_last_call = m_calls.size();
+  m_calls.put(function, args...);
+}
+
+template <typename T> void recording_opengl_functions::append(T const* values, std::size_t count)
+{
+  if (is_recording())
+    m_calls.put_array(values, count);
+}
+
+void recording_opengl_functions::reset_pixel_store()
+{
+  m_pack_alignment = 4;
+  m_pack_row_length = 0;
+  m_unpack_alignment = 4;
+  m_unpack_row_length = 0;
+}
+
+template <typename T> void recording_opengl_functions::get_values(gl_call function, GLenum pname, T* data)
+{
+  auto const count = get_value_count(pname);
+  std::vector<char> result;
+
+  // The parameters not known here are not answered by the replayer
+  if (count == 0)
+  {
+    *data = T();
+    return;
+  }
+
+  call(function, pname);
+
+  if (query(result) && result.size() == count * sizeof(T))
+    std::memcpy(data, result.data(), result.size());
+  else
+    std::fill(data, data + count, T());
+}
+
+void recording_opengl_functions::glAlphaFunc(GLenum func, GLclampf ref)
+{
+  call(gl_call::alpha_func, func, ref);
+}
+
+void recording_opengl_functions::glBegin(GLenum mode)
+{
+  call(gl_call::begin, mode);
+}
+
+void recording_opengl_functions::glBindTexture(GLenum target, GLuint texture)
+{
+  call(gl_call::bind_texture, target, texture);
+}
+
+void recording_opengl_functions::glBitmap(
+  GLsizei width, GLsizei height, GLfloat xorig, GLfloat yorig, GLfloat xmove, GLfloat ymove, GLubyte const* bitmap
+)
+{
+  auto const size = bitmap ? pixel_data_size(width, height, GL_COLOR_INDEX, GL_BITMAP, m_unpack_alignment,
+                                             m_unpack_row_length)
+                           : 0;
+
+  call(gl_call::bitmap, width, height, xorig, yorig, xmove, ymove, std::uint64_t(size));
+  append(bitmap, size);
+}
+
+void recording_opengl_functions::glBlendFunc(GLenum sfactor, GLenum dfactor)
+{
+  call(gl_call::blend_func, sfactor, dfactor);
+}
+
+void recording_opengl_functions::glCallList(GLuint list)
+{
+  call(gl_call::call_list, list);
+}
+
+void recording_opengl_functions::glClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha)
+{
+  call(gl_call::clear_color, red, green, blue, alpha);
+}
+
+void recording_opengl_functions::glClear(GLbitfield mask)
+{
+  call(gl_call::clear, mask);
+}
+
+void recording_opengl_functions::glClipPlane(GLenum plane, GLdouble const* equation)
+{
+  call(gl_call::clip_plane, plane);
+  append(equation, 4);
+}
+
+void recording_opengl_functions::glColor3dv(GLdouble const* v)
+{
+  call(gl_call::color3dv, v[0], v[1], v[2]);
+}
+
+void recording_opengl_functions::glColor3f(GLfloat red, GLfloat green, GLfloat blue)
+{
+  call(gl_call::color3f, red, green, blue);
+}
+
+void recording_opengl_functions::glColor3fv(GLfloat const* v)
+{
+  call(gl_call::color3fv, v[0], v[1], v[2]);
+}
+
+void recording_opengl_functions::glColor4d(GLdouble red, GLdouble green, GLdouble blue, GLdouble alpha)
+{
+  call(gl_call::color4d, red, green, blue, alpha);
+}
+
+void recording_opengl_functions::glColor4f(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+  call(gl_call::color4f, red, green, blue, alpha);
+}
+
+void recording_opengl_functions::glColor4fv(GLfloat const* v)
+{
+  call(gl_call::color4fv, v[0], v[1], v[2], v[3]);
+}
+
+void recording_opengl_functions::glDeleteLists(GLuint list, GLsizei range)
+{
+  call(gl_call::delete_lists, list, range);
+}
+
+void recording_opengl_functions::glDeleteTextures(GLsizei n, GLuint const* textures)
+{
+  call(gl_call::delete_textures, n);
+  append(textures, static_cast<std::size_t>(std::max(n, 0)));
+}
+
+void recording_opengl_functions::glDepthFunc(GLenum func)
+{
+  call(gl_call::depth_func, func);
+}
+
+void recording_opengl_functions::glDisable(GLenum cap)
+{
+  call(gl_call::disable, cap);
+}
+
+void recording_opengl_functions::glDrawPixels(
+  GLsizei width, GLsizei height, GLenum format, GLenum type, GLvoid const* pixels
+)
+{
+  auto const size = pixels ? pixel_data_size(width, height, format, type, m_unpack_alignment, m_unpack_row_length) : 0;
+
+  call(gl_call::draw_pixels, width, height, format, type, std::uint64_t(size));
+  append(static_cast<char const*>(pixels), size);
+}
+
+void recording_opengl_functions::glEdgeFlag(GLboolean flag)
+{
+  call(gl_call::edge_flag, flag);
+}
+
+void recording_opengl_functions::glEnable(GLenum cap)
+{
+  call(gl_call::enable, cap);
+}
+
+void recording_opengl_functions::glEndList()
+{
+  call(gl_call::end_list);
+}
+
+void recording_opengl_functions::glEnd()
+{
+  call(gl_call::end);
+}
+
+void recording_opengl_functions::glFinish()
+{
+  call(gl_call::finish);
+}
+
+GLuint recording_opengl_functions::glGenLists(GLsizei range)
+{
+  if (range <= 0)
+    return 0;
+
+  auto const list = m_next_list;
+  m_next_list += static_cast<GLuint>(range);
+
+  call(gl_call::gen_lists, list, range);
+
+  return list;
+}
+
+void recording_opengl_functions::glGenTextures(GLsizei n, GLuint* textures)
+{
+  for (GLsizei i = 0; i < n; ++i)
+    textures[i] = m_next_texture++;
+
+  call(gl_call::gen_textures, n);
+  append(textures, static_cast<std::size_t>(std::max(n, 0)));
+}
+
+void recording_opengl_functions::glGetBooleanv(GLenum pname, GLboolean* data)
+{
+  get_values(gl_call::get_booleanv, pname, data);
+}
+
+void recording_opengl_functions::glGetDoublev(GLenum pname, GLdouble* data)
+{
+  get_values(gl_call::get_doublev, pname, data);
+}
+
+GLenum recording_opengl_functions::glGetError()
+{
+  GLenum error = GL_NO_ERROR;
+  std::vector<char> result;
+
+  call(gl_call::get_error);
+
+  if (query(result) && result.size() == sizeof(error))
+    std::memcpy(&error, result.data(), sizeof(error));
+
+  return error;
+}
+
+void recording_opengl_functions::glGetFloatv(GLenum pname, GLfloat* data)
+{
+  get_values(gl_call::get_floatv, pname, data);
+}
+
+void recording_opengl_functions::glGetIntegerv(GLenum pname, GLint* data)
+{
+  get_values(gl_call::get_integerv, pname, data);
+}
+
+GLubyte const* recording_opengl_functions::glGetString(GLenum name)
+{
+  auto string = m_strings.find(name);
+
+  if (string == m_strings.end())
+  {
+    std::vector<char> result;
+
+    call(gl_call::get_string, name);
+    if (!query(result))
+      return reinterpret_cast<GLubyte const*>("");
+
+    string = m_strings.emplace(name, std::string(result.begin(), result.end())).first;
+  }
+
+  return reinterpret_cast<GLubyte const*>(string->second.c_str());
+}
+
+void recording_opengl_functions::glHint(GLenum target, GLenum mode)
+{
+  call(gl_call::hint, target, mode);
+}
+
+void recording_opengl_functions::glInitNames()
+{
+  call(gl_call::init_names);
+}
+
+GLboolean recording_opengl_functions::glIsEnabled(GLenum cap)
+{
+  GLboolean enabled = GL_FALSE;
+  std::vector<char> result;
+
+  call(gl_call::is_enabled, cap);
+
+  if (query(result) && result.size() == sizeof(enabled))
+    std::memcpy(&enabled, result.data(), sizeof(enabled));
+
+  return enabled;
+}
+
+void recording_opengl_functions::glLightfv(GLenum light, GLenum pname, GLfloat const* params)
+{
+  call(gl_call::lightfv, light, pname);
+  append(params, light_value_count(pname));
+}
+
+void recording_opengl_functions::glLineStipple(GLint factor, GLushort pattern)
+{
+  call(gl_call::line_stipple, factor, pattern);
+}
+
+void recording_opengl_functions::glLineWidth(GLfloat width)
+{
+  call(gl_call::line_width, width);
+}
+
+void recording_opengl_functions::glLoadIdentity()
+{
+  call(gl_call::load_identity);
+}
+
+void recording_opengl_functions::glMaterialf(GLenum face, GLenum pname, GLfloat param)
+{
+  call(gl_call::materialf, face, pname, param);
+}
+
+void recording_opengl_functions::glMaterialfv(GLenum face, GLenum pname, GLfloat const* params)
+{
+  call(gl_call::materialfv, face, pname);
+  append(params, light_value_count(pname));
+}
+
+void recording_opengl_functions::glMatrixMode(GLenum mode)
+{
+  call(gl_call::matrix_mode, mode);
+}
+
+void recording_opengl_functions::glMultMatrixd(GLdouble const* m)
+{
+  call(gl_call::mult_matrixd);
+  append(m, 16);
+}
+
+void recording_opengl_functions::glNewList(GLuint list, GLenum mode)
+{
+  call(gl_call::new_list, list, mode);
+}
+
+void recording_opengl_functions::glNormal3d(GLdouble nx, GLdouble ny, GLdouble nz)
+{
+  call(gl_call::normal3d, nx, ny, nz);
+}
+
+void recording_opengl_functions::glNormal3dv(GLdouble const* v)
+{
+  call(gl_call::normal3dv, v[0], v[1], v[2]);
+}
+
+void recording_opengl_functions::glOrtho(
+  GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdouble near_val, GLdouble far_val
+)
+{
+  call(gl_call::ortho, left, right, bottom, top, near_val, far_val);
+}
+
+void recording_opengl_functions::glPixelStorei(GLenum pname, GLint param)
+{
+  if (pname == GL_PACK_ALIGNMENT)
+    m_pack_alignment = param;
+  else if (pname == GL_PACK_ROW_LENGTH)
+    m_pack_row_length = param;
+  else if (pname == GL_UNPACK_ALIGNMENT)
+    m_unpack_alignment = param;
+  else if (pname == GL_UNPACK_ROW_LENGTH)
+    m_unpack_row_length = param;
+
+  call(gl_call::pixel_storei, pname, param);
+}
+
+void recording_opengl_functions::glPixelZoom(GLfloat xfactor, GLfloat yfactor)
+{
+  call(gl_call::pixel_zoom, xfactor, yfactor);
+}
+
+void recording_opengl_functions::glPolygonMode(GLenum face, GLenum mode)
+{
+  call(gl_call::polygon_mode, face, mode);
+}
+
+void recording_opengl_functions::glPolygonOffset(GLfloat factor, GLfloat units)
+{
+  call(gl_call::polygon_offset, factor, units);
+}
+
+void recording_opengl_functions::glPopAttrib()
+{
+  call(gl_call::pop_attrib);
+}
+
+void recording_opengl_functions::glPopMatrix()
+{
+  call(gl_call::pop_matrix);
+}
+
+void recording_opengl_functions::glPopName()
+{
+  call(gl_call::pop_name);
+}
+
+void recording_opengl_functions::glPushAttrib(GLbitfield mask)
+{
+  call(gl_call::push_attrib, mask);
+}
+
+void recording_opengl_functions::glPushMatrix()
+{
+  call(gl_call::push_matrix);
+}
+
+void recording_opengl_functions::glPushName(GLuint name)
+{
+  call(gl_call::push_name, name);
+}
+
+void recording_opengl_functions::glRasterPos3d(GLdouble x, GLdouble y, GLdouble z)
+{
+  call(gl_call::raster_pos3d, x, y, z);
+}
+
+void recording_opengl_functions::glReadPixels(
+  GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, GLvoid* pixels
+)
+{
+  auto const size = pixel_data_size(width, height, format, type, m_pack_alignment, m_pack_row_length);
+  std::vector<char> result;
+
+  call(gl_call::read_pixels, x, y, width, height, format, type);
+
+  if (query(result) && result.size() == size)
+    std::memcpy(pixels, result.data(), size);
+}
+
+GLint recording_opengl_functions::glRenderMode(GLenum mode)
+{
+  GLint hits = 0;
+  std::vector<char> result;
+
+  call(gl_call::render_mode, mode);
+
+  // The result is followed by the content of the selection buffer
+  if (!query(result) || result.size() < sizeof(hits))
+    return 0;
+
+  std::memcpy(&hits, result.data(), sizeof(hits));
+
+  auto const names = std::min((result.size() - sizeof(hits)) / sizeof(GLuint), std::size_t(std::max(m_select_size, 0)));
+  if (m_select_buffer && names > 0)
+    std::memcpy(m_select_buffer, result.data() + sizeof(hits), names * sizeof(GLuint));
+
+  return hits;
+}
+
+void recording_opengl_functions::glRotated(GLdouble angle, GLdouble x, GLdouble y, GLdouble z)
+{
+  call(gl_call::rotated, angle, x, y, z);
+}
+
+void recording_opengl_functions::glScaled(GLdouble x, GLdouble y, GLdouble z)
+{
+  call(gl_call::scaled, x, y, z);
+}
+
+void recording_opengl_functions::glScalef(GLfloat x, GLfloat y, GLfloat z)
+{
+  call(gl_call::scalef, x, y, z);
+}
+
+void recording_opengl_functions::glSelectBuffer(GLsizei size, GLuint* buffer)
+{
+  // The replayer selects in a buffer of its own, which is copied back here
+  // when leaving the selection mode
+  m_select_buffer = buffer;
+  m_select_size = size;
+
+  call(gl_call::select_buffer, size);
+}
+
+void recording_opengl_functions::glShadeModel(GLenum mode)
+{
+  call(gl_call::shade_model, mode);
+}
+
+void recording_opengl_functions::glTexCoord2d(GLdouble s, GLdouble t)
+{
+  call(gl_call::tex_coord2d, s, t);
+}
+
+void recording_opengl_functions::glTexImage2D(
+  GLenum target,
+  GLint level,
+  GLint internalFormat,
+  GLsizei width,
+  GLsizei height,
+  GLint border,
+  GLenum format,
+  GLenum type,
+  GLvoid const* pixels
+)
+{
+  // Textures may be allocated without pixels
+  auto const size = pixels ? pixel_data_size(width, height, format, type, m_unpack_alignment, m_unpack_row_length) : 0;
+
+  call(
+    gl_call::tex_image2d, target, level, internalFormat, width, height, border, format, type, std::uint64_t(size)
+  );
+  append(static_cast<char const*>(pixels), size);
+}
+
+void recording_opengl_functions::glTexParameteri(GLenum target, GLenum pname, GLint param)
+{
+  call(gl_call::tex_parameteri, target, pname, param);
+}
+
+void recording_opengl_functions::glTranslated(GLdouble x, GLdouble y, GLdouble z)
+{
+  call(gl_call::translated, x, y, z);
+}
+
+void recording_opengl_functions::glTranslatef(GLfloat x, GLfloat y, GLfloat z)
+{
+  call(gl_call::translatef, x, y, z);
+}
+
+void recording_opengl_functions::glVertex2d(GLdouble x, GLdouble y)
+{
+  call(gl_call::vertex2d, x, y);
+}
+
+void recording_opengl_functions::glVertex3d(GLdouble x, GLdouble y, GLdouble z)
+{
+  call(gl_call::vertex3d, x, y, z);
+}
+
+void recording_opengl_functions::glVertex3dv(GLdouble const* v)
+{
+  call(gl_call::vertex3dv, v[0], v[1], v[2]);
+}
+
+void recording_opengl_functions::glViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+  call(gl_call::viewport, x, y, width, height);
+}
+
+}  // namespace xeus_octave::tk::notebook
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "xeus-octave/opengl.hpp"
+#include "xeus-octave/opengl_remote.hpp"
+#include "xeus-octave/render_protocol.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+namespace
+{
+
+// A daemon not answering within this time is considered gone
+constexpr time_t reply_timeout_seconds = 10;
+
+int connect_socket(std::string const& path)
+{
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+
+  if (path.size() >= sizeof(address.sun_path))
+    return -1;
+
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+  auto const fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+
+  if (::connect(fd, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) != 0)
+  {
+    ::close(fd);
+    return -1;
+  }
+
+  timeval const timeout = {reply_timeout_seconds, 0};
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+#ifdef SO_NOSIGPIPE
+  int const on = 1;
+  ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+  return fd;
+}
+
+}  // namespace
+
+remote_opengl_functions::remote_opengl_functions(std::string const& socket) : m_socket(connect_socket(socket))
+{
+  if (m_socket < 0)
+    return;
+
+  std::vector<char> payload;
+  m_calls.put(render_protocol_version);
+
+  if (!exchange(render_message::hello, render_message::hello, payload))
+    return;
+
+  try
+  {
+    message_reader reader(payload);
+
+    if (reader.get<std::uint32_t>() != render_protocol_version)
+    {
+      std::clog << "The render daemon speaks another protocol version" << '\n';
+      disconnect();
+      return;
+    }
+
+    m_max_size = reader.get<std::int32_t>();
+  }
+  catch (std::exception const&)
+  {
+    disconnect();
+  }
+}
+
+remote_opengl_functions::~remote_opengl_functions()
+{
+  disconnect();
+}
+
+bool remote_opengl_functions::begin_frame(int width, int height)
+{
+  // Calls made in between the frames (deleting lists) go first
+  send_calls();
+
+  m_calls.put(std::int32_t(width), std::int32_t(height));
+  if (!is_valid() || !send_message(m_socket, render_message::begin_frame, m_calls.data()))
+  {
+    disconnect();
+    return false;
+  }
+
+  m_calls.clear();
+
+  // The daemon starts each frame with the default pixel store state
+  reset_pixel_store();
+
+  return true;
+}
+
+bool remote_opengl_functions::end_frame(std::vector<unsigned char>& pixels)
+{
+  std::vector<char> payload;
+
+  if (!exchange(render_message::end_frame, render_message::pixels, payload))
+    return false;
+
+  pixels.assign(payload.begin(), payload.end());
+  return true;
+}
+
+void remote_opengl_functions::send_calls()
+{
+  if (!is_valid() || m_calls.size() == 0)
+    return;
+
+  if (!send_message(m_socket, render_message::calls, m_calls.data()))
+    disconnect();
+
+  m_calls.clear();
+}
+
+bool remote_opengl_functions::query(std::vector<char>& result)
+{
+  return exchange(render_message::query, render_message::result, result);
+}
+
+bool remote_opengl_functions::exchange(render_message type, render_message reply, std::vector<char>& payload)
+{
+  if (!is_valid())
+    return false;
+
+  auto received = render_message::failure;
+  auto const ok = send_message(m_socket, type, m_calls.data()) && receive_message(m_socket, received, payload);
+  m_calls.clear();
+
+  if (!ok)
+  {
+    disconnect();
+    return false;
+  }
+
+  if (received == reply)
+    return true;
+
+  // The daemon could not serve this request, but can still serve the next
+  if (received == render_message::failure)
+  {
+#ifndef NDEBUG
+    std::clog << "Render daemon: " << std::string(payload.begin(), payload.end()) << '\n';
+#endif
+    return false;
+  }
+
+  disconnect();
+  return false;
+}
+
+void remote_opengl_functions::disconnect()
+{
+  if (m_socket < 0)
+    return;
+
+  ::close(m_socket);
+  m_socket = -1;
+  m_calls.clear();
+}
+
+}  // namespace xeus_octave::tk::notebook
@@ -0,0 +1,605 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "xeus-octave/opengl.hpp"
+#include "xeus-octave/opengl_batch.hpp"
+#include "xeus-octave/opengl_replay.hpp"
+#include "xeus-octave/render_protocol.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+namespace
+{
+
+using gl = octave::opengl_functions;
+
+// Limit of the selection buffers, in names
+constexpr GLsizei max_select_size = 1 << 20;
+
+// Limits of the display lists created or deleted by a call, and of the
+// display lists and textures of a client
+constexpr GLsizei max_list_range = 1 << 16;
+constexpr std::size_t max_names = std::size_t(1) << 20;
+
+/**
+ * Read the arguments of a function taking only scalars from a message, and
+ * call it
+ */
+template <typename... T>
+void replay_call(message_reader& reader, gl& functions, void (gl::*function)(T...))
+{
+  // The elements of a braced initializer are evaluated in order
+  std::apply([&](auto... args) { (functions.*function)(args...); }, std::tuple<T...>{reader.get<T>()...});
+}
+
+template <typename T, std::size_t N> std::array<T, N> read_array(message_reader& reader)
+{
+  std::array<T, N> values;
+  for (auto& value : values)
+    value = reader.get<T>();
+  return values;
+}
+
+/**
+ * The name an object of a client has here, or 0
+ */
+GLuint translate(std::unordered_map<GLuint, GLuint> const& names, GLuint name)
+{
+  auto const found = names.find(name);
+  return found != names.end() ? found->second : 0;
+}
+
+/**
+ * Read the values of a glGet*, for the parameters whose count is known
+ */
+template <typename T>
+void get_values(message_reader& reader, message_writer& result, void (gl::*function)(GLenum, T*), gl& functions)
+{
+  auto const pname = reader.get<GLenum>();
+  auto const count = get_value_count(pname);
+
+  if (count == 0)
+    throw unanswered_query("unknown glGet parameter " + std::to_string(pname));
+
+  std::vector<T> values(count);
+  (functions.*function)(pname, values.data());
+  result.put_array(values.data(), values.size());
+}
+
+/**
+ * The values of a glLightfv or glMaterialfv, for the parameters whose count
+ * is known
+ */
+GLfloat const* get_light_values(message_reader& reader, GLenum pname)
+{
+  auto const count = light_value_count(pname);
+
+  if (count == 0)
+    throw std::runtime_error("unknown light parameter " + std::to_string(pname));
+
+  return reader.get_array<GLfloat>(count);
+}
+
+GLsizei get_list_range(message_reader& reader)
+{
+  auto const range = reader.get<GLsizei>();
+
+  if (range < 0 || range > max_list_range)
+    throw std::runtime_error("invalid display list range " + std::to_string(range));
+
+  return range;
+}
+
+}  // namespace
+
+GLvoid const* opengl_replayer::get_pixels(
+  message_reader& reader, GLsizei width, GLsizei height, GLenum format, GLenum type, bool optional
+) const
+{
+  auto const size = reader.get<std::uint64_t>();
+  auto const expected = pixel_data_size(width, height, format, type, m_unpack_alignment, m_unpack_row_length);
+
+  // An image opengl reads but whose size is not known here could be read
+  // past its end
+  if (width > 0 && height > 0 && expected == 0 && !(optional && size == 0))
+    throw std::runtime_error("unsupported pixel format or type");
+
+  if (size == 0 && (expected == 0 || optional))
+    return nullptr;
+
+  if (size != expected)
+    throw std::runtime_error(
+      "image of " + std::to_string(size) + " bytes instead of " + std::to_string(expected)
+    );
+
+  return reader.get_array<char>(size);
+}
+
+void opengl_replayer::begin_frame(int width, int height)
+{
+  begin_calls();
+
+  // Each frame starts with the default matrices
+  for (GLenum const mode : std::array<GLenum, 3>{GL_TEXTURE, GL_PROJECTION, GL_MODELVIEW})
+  {
+    glMatrixMode(mode);
+    glLoadIdentity();
+  }
+
+  glViewport(0, 0, width, height);
+}
+
+void opengl_replayer::begin_calls()
+{
+  // The state left by the previous frames is restored after the calls, which
+  // start with the default pixel store
+  glPushAttrib(GL_ALL_ATTRIB_BITS);
+  glPushClientAttrib(GL_CLIENT_ALL_ATTRIB_BITS);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  m_unpack_alignment = 4;
+  m_unpack_row_length = 0;
+
+  // The attributes pushed above are not popped by the calls
+  glGetIntegerv(GL_ATTRIB_STACK_DEPTH, &m_attrib_depth);
+}
+
+void opengl_replayer::end_frame()
+{
+  // A frame cut in the middle of a primitive must not leave it open
+  if (m_glfcns.is_recording())
+    m_glfcns.glEnd();
+
+  m_glfcns.flush();
+
+  // Nor leave a display list being compiled, the selection mode, or the
+  // attributes pushed by the calls
+  GLint list = 0;
+  GLint mode = GL_RENDER;
+  GLint depth = 0;
+  glGetIntegerv(GL_LIST_INDEX, &list);
+  glGetIntegerv(GL_RENDER_MODE, &mode);
+  glGetIntegerv(GL_ATTRIB_STACK_DEPTH, &depth);
+
+  if (list != 0)
+    glEndList();
+  if (mode != GL_RENDER)
+    glRenderMode(GL_RENDER);
+  for (; depth > m_attrib_depth; --depth)
+    glPopAttrib();
+
+  glPopClientAttrib();
+  glPopAttrib();
+}
+
+void opengl_replayer::replay(message_reader& reader, message_writer& result)
+{
+  while (!reader.at_end())
+  {
+    switch (reader.get<gl_call>())
+    {
+    case gl_call::alpha_func:
+      replay_call(reader, m_glfcns, &gl::glAlphaFunc);
+      break;
+    case gl_call::begin:
+      replay_call(reader, m_glfcns, &gl::glBegin);
+      break;
+    case gl_call::bind_texture:
+    {
+      auto const target = reader.get<GLenum>();
+      m_glfcns.glBindTexture(target, translate(m_textures, reader.get<GLuint>()));
+      break;
+    }
+    case gl_call::bitmap:
+    {
+      auto const width = reader.get<GLsizei>();
+      auto const height = reader.get<GLsizei>();
+      auto const [xorig, yorig, xmove, ymove] = read_array<GLfloat, 4>(reader);
+      auto const* bitmap = get_pixels(reader, width, height, GL_COLOR_INDEX, GL_BITMAP, false);
+      m_glfcns.glBitmap(width, height, xorig, yorig, xmove, ymove, static_cast<GLubyte const*>(bitmap));
+      break;
+    }
+    case gl_call::blend_func:
+      replay_call(reader, m_glfcns, &gl::glBlendFunc);
+      break;
+    case gl_call::call_list:
+      m_glfcns.glCallList(translate(m_lists, reader.get<GLuint>()));
+      break;
+    case gl_call::clear_color:
+      replay_call(reader, m_glfcns, &gl::glClearColor);
+      break;
+    case gl_call::clear:
+      replay_call(reader, m_glfcns, &gl::glClear);
+      break;
+    case gl_call::clip_plane:
+    {
+      auto const plane = reader.get<GLenum>();
+      m_glfcns.glClipPlane(plane, reader.get_array<GLdouble>(4));
+      break;
+    }
+    case gl_call::color3dv:
+      m_glfcns.glColor3dv(read_array<GLdouble, 3>(reader).data());
+      break;
+    case gl_call::color3f:
+      replay_call(reader, m_glfcns, &gl::glColor3f);
+      break;
+    case gl_call::color3fv:
+      m_glfcns.glColor3fv(read_array<GLfloat, 3>(reader).data());
+      break;
+    case gl_call::color4d:
+      replay_call(reader, m_glfcns, &gl::glColor4d);
+      break;
+    case gl_call::color4f:
+      replay_call(reader, m_glfcns, &gl::glColor4f);
+      break;
+    case gl_call::color4fv:
+      m_glfcns.glColor4fv(read_array<GLfloat, 4>(reader).data());
+      break;
+    case gl_call::delete_lists:
+    {
+      auto const list = reader.get<GLuint>();
+      auto const range = get_list_range(reader);
+
+      for (GLsizei i = 0; i < range; ++i)
+      {
+        auto const found = m_lists.find(list + static_cast<GLuint>(i));
+        if (found != m_lists.end())
+        {
+          m_glfcns.glDeleteLists(found->second, 1);
+          m_lists.erase(found);
+        }
+      }
+      break;
+    }
+    case gl_call::delete_textures:
+    {
+      auto const n = reader.get<GLsizei>();
+      auto const* names = reader.get_array<GLuint>(static_cast<std::size_t>(std::max(n, 0)));
+
+      for (GLsizei i = 0; i < n; ++i)
+      {
+        auto const found = m_textures.find(names[i]);
+        if (found != m_textures.end())
+        {
+          m_glfcns.glDeleteTextures(1, &found->second);
+          m_textures.erase(found);
+        }
+      }
+      break;
+    }
+    case gl_call::depth_func:
+      replay_call(reader, m_glfcns, &gl::glDepthFunc);
+      break;
+    case gl_call::disable:
+      replay_call(reader, m_glfcns, &gl::glDisable);
+      break;
+    case gl_call::draw_pixels:
+    {
+      auto const width = reader.get<GLsizei>();
+      auto const height = reader.get<GLsizei>();
+      auto const format = reader.get<GLenum>();
+      auto const type = reader.get<GLenum>();
+      m_glfcns.glDrawPixels(width, height, format, type, get_pixels(reader, width, height, format, type, false));
+      break;
+    }
+    case gl_call::edge_flag:
+      replay_call(reader, m_glfcns, &gl::glEdgeFlag);
+      break;
+    case gl_call::enable:
+      replay_call(reader, m_glfcns, &gl::glEnable);
+      break;
+    case gl_call::end_list:
+      m_glfcns.glEndList();
+      break;
+    case gl_call::end:
+      if (m_glfcns.is_recording())
+        m_glfcns.glEnd();
+      break;
+    case gl_call::finish:
+      m_glfcns.glFinish();
+      break;
+    case gl_call::gen_lists:
+    {
+      auto const list = reader.get<GLuint>();
+      auto const range = get_list_range(reader);
+
+      // The lists are already there when the calls are replayed again
+      if (range == 0 || m_lists.find(list) != m_lists.end())
+        break;
+
+      if (m_lists.size() + static_cast<std::size_t>(range) > max_names)
+        throw std::runtime_error("too many display lists");
+
+      auto const names = m_glfcns.glGenLists(range);
+
+      for (GLsizei i = 0; names != 0 && i < range; ++i)
+        m_lists[list + static_cast<GLuint>(i)] = names + static_cast<GLuint>(i);
+      break;
+    }
+    case gl_call::gen_textures:
+    {
+      auto const n = static_cast<std::size_t>(std::max(reader.get<GLsizei>(), 0));
+      auto const* names = reader.get_array<GLuint>(n);
+
+      if (m_textures.size() + n > max_names)
+        throw std::runtime_error("too many textures");
+
+      // As are the textures
+      for (std::size_t i = 0; i < n; ++i)
+        if (m_textures.find(names[i]) == m_textures.end())
+          m_glfcns.glGenTextures(1, &m_textures[names[i]]);
+      break;
+    }
+    case gl_call::get_booleanv:
+      get_values(reader, result, &gl::glGetBooleanv, m_glfcns);
+      break;
+    case gl_call::get_doublev:
+      get_values(reader, result, &gl::glGetDoublev, m_glfcns);
+      break;
+    case gl_call::get_error:
+      result.put(m_glfcns.glGetError());
+      break;
+    case gl_call::get_floatv:
+      get_values(reader, result, &gl::glGetFloatv, m_glfcns);
+      break;
+    case gl_call::get_integerv:
+      get_values(reader, result, &gl::glGetIntegerv, m_glfcns);
+      break;
+    case gl_call::get_string:
+    {
+      auto const* string = reinterpret_cast<char const*>(m_glfcns.glGetString(reader.get<GLenum>()));
+      result.put_array(string, string ? std::strlen(string) : 0);
+      break;
+    }
+    case gl_call::hint:
+      replay_call(reader, m_glfcns, &gl::glHint);
+      break;
+    case gl_call::init_names:
+      m_glfcns.glInitNames();
+      break;
+    case gl_call::is_enabled:
+      result.put(m_glfcns.glIsEnabled(reader.get<GLenum>()));
+      break;
+    case gl_call::lightfv:
+    {
+      auto const light = reader.get<GLenum>();
+      auto const pname = reader.get<GLenum>();
+      m_glfcns.glLightfv(light, pname, get_light_values(reader, pname));
+      break;
+    }
+    case gl_call::line_stipple:
+      replay_call(reader, m_glfcns, &gl::glLineStipple);
+      break;
+    case gl_call::line_width:
+      replay_call(reader, m_glfcns, &gl::glLineWidth);
+      break;
+    case gl_call::load_identity:
+      m_glfcns.glLoadIdentity();
+      break;
+    case gl_call::materialf:
+      replay_call(reader, m_glfcns, &gl::glMaterialf);
+      break;
+    case gl_call::materialfv:
+    {
+      auto const face = reader.get<GLenum>();
+      auto const pname = reader.get<GLenum>();
+      m_glfcns.glMaterialfv(face, pname, get_light_values(reader, pname));
+      break;
+    }
+    case gl_call::matrix_mode:
+      replay_call(reader, m_glfcns, &gl::glMatrixMode);
+      break;
+    case gl_call::mult_matrixd:
+      m_glfcns.glMultMatrixd(reader.get_array<GLdouble>(16));
+      break;
+    case gl_call::new_list:
+    {
+      auto const list = translate(m_lists, reader.get<GLuint>());
+      m_glfcns.glNewList(list, reader.get<GLenum>());
+      break;
+    }
+    case gl_call::normal3d:
+      replay_call(reader, m_glfcns, &gl::glNormal3d);
+      break;
+    case gl_call::normal3dv:
+      m_glfcns.glNormal3dv(read_array<GLdouble, 3>(reader).data());
+      break;
+    case gl_call::ortho:
+      replay_call(reader, m_glfcns, &gl::glOrtho);
+      break;
+    case gl_call::pixel_storei:
+    {
+      auto const pname = reader.get<GLenum>();
+      auto const param = reader.get<GLint>();
+      auto const alignment = param == 1 || param == 2 || param == 4 || param == 8;
+
+      // The skipped pixels and rows would make opengl read past the images
+      if (pname == GL_UNPACK_ALIGNMENT && alignment)
+        m_unpack_alignment = param;
+      else if (pname == GL_UNPACK_ROW_LENGTH && param >= 0)
+        m_unpack_row_length = param;
+      else if (pname != GL_PACK_ALIGNMENT && pname != GL_PACK_ROW_LENGTH)
+        throw std::runtime_error("unsupported pixel store parameter " + std::to_string(pname));
+
+      m_glfcns.glPixelStorei(pname, param);
+      break;
+    }
+    case gl_call::pixel_zoom:
+      replay_call(reader, m_glfcns, &gl::glPixelZoom);
+      break;
+    case gl_call::polygon_mode:
+      replay_call(reader, m_glfcns, &gl::glPolygonMode);
+      break;
+    case gl_call::polygon_offset:
+      replay_call(reader, m_glfcns, &gl::glPolygonOffset);
+      break;
+    case gl_call::pop_attrib:
+    {
+      GLint depth = 0;
+      glGetIntegerv(GL_ATTRIB_STACK_DEPTH, &depth);
+
+      // The attributes saved by begin_calls are popped by end_frame only
+      if (depth <= m_attrib_depth)
+        throw std::runtime_error("glPopAttrib without glPushAttrib");
+
+      m_glfcns.glPopAttrib();
+      break;
+    }
+    case gl_call::pop_matrix:
+      m_glfcns.glPopMatrix();
+      break;
+    case gl_call::pop_name:
+      m_glfcns.glPopName();
+      break;
+    case gl_call::push_attrib:
+      replay_call(reader, m_glfcns, &gl::glPushAttrib);
+      break;
+    case gl_call::push_matrix:
+      m_glfcns.glPushMatrix();
+      break;
+    case gl_call::push_name:
+      replay_call(reader, m_glfcns, &gl::glPushName);
+      break;
+    case gl_call::raster_pos3d:
+      replay_call(reader, m_glfcns, &gl::glRasterPos3d);
+      break;
+    case gl_call::read_pixels:
+    {
+      auto const x = reader.get<GLint>();
+      auto const y = reader.get<GLint>();
+      auto const width = reader.get<GLsizei>();
+      auto const height = reader.get<GLsizei>();
+      auto const format = reader.get<GLenum>();
+      auto const type = reader.get<GLenum>();
+
+      GLint alignment = 4;
+      GLint row_length = 0;
+      m_glfcns.glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+      m_glfcns.glGetIntegerv(GL_PACK_ROW_LENGTH, &row_length);
+
+      auto const size = pixel_data_size(width, height, format, type, alignment, row_length);
+      if (size > max_message_size)
+        throw std::runtime_error("too many pixels read");
+
+      std::vector<char> pixels(size);
+      m_glfcns.glReadPixels(x, y, width, height, format, type, pixels.data());
+      result.put_array(pixels.data(), pixels.size());
+      break;
+    }
+    case gl_call::render_mode:
+    {
+      // The selection buffer follows the result
+      result.put(m_glfcns.glRenderMode(reader.get<GLenum>()));
+      for (auto const name : m_select_buffer)
+        result.put(name);
+      break;
+    }
+    case gl_call::rotated:
+      replay_call(reader, m_glfcns, &gl::glRotated);
+      break;
+    case gl_call::scaled:
+      replay_call(reader, m_glfcns, &gl::glScaled);
+      break;
+    case gl_call::scalef:
+      replay_call(reader, m_glfcns, &gl::glScalef);
+      break;
+    case gl_call::select_buffer:
+    {
+      auto const size = std::clamp(reader.get<GLsizei>(), 0, max_select_size);
+      m_select_buffer.assign(static_cast<std::size_t>(size), 0);
+      m_glfcns.glSelectBuffer(size, m_select_buffer.data());
+      break;
+    }
+    case gl_call::shade_model:
+      replay_call(reader, m_glfcns, &gl::glShadeModel);
+      break;
+    case gl_call::tex_coord2d:
+      replay_call(reader, m_glfcns, &gl::glTexCoord2d);
+      break;
+    case gl_call::tex_image2d:
+    {
+      auto const target = reader.get<GLenum>();
+      auto const level = reader.get<GLint>();
+      auto const internal_format = reader.get<GLint>();
+      auto const width = reader.get<GLsizei>();
+      auto const height = reader.get<GLsizei>();
+      auto const border = reader.get<GLint>();
+      auto const format = reader.get<GLenum>();
+      auto const type = reader.get<GLenum>();
+      // Textures may be allocated without pixels
+      auto const* pixels = get_pixels(reader, width, height, format, type, true);
+      m_glfcns.glTexImage2D(target, level, internal_format, width, height, border, format, type, pixels);
+      break;
+    }
+    case gl_call::tex_parameteri:
+      replay_call(reader, m_glfcns, &gl::glTexParameteri);
+      break;
+    case gl_call::translated:
+      replay_call(reader, m_glfcns, &gl::glTranslated);
+      break;
+    case gl_call::translatef:
+      replay_call(reader, m_glfcns, &gl::glTranslatef);
+      break;
+    case gl_call::vertex2d:
+      replay_call(reader, m_glfcns, &gl::glVertex2d);
+      break;
+    case gl_call::vertex3d:
+      replay_call(reader, m_glfcns, &gl::glVertex3d);
+      break;
+    case gl_call::vertex3dv:
+      m_glfcns.glVertex3dv(read_array<GLdouble, 3>(reader).data());
+      break;
+    case gl_call::viewport:
+      replay_call(reader, m_glfcns, &gl::glViewport);
+      break;
+    default:
+      throw std::runtime_error("unknown opengl call");
+    }
+  }
+}
+
+void opengl_replayer::release()
+{
+  for (auto const& [name, list] : m_lists)
+    m_glfcns.glDeleteLists(list, 1);
+
+  for (auto const& [name, texture] : m_textures)
+    m_glfcns.glDeleteTextures(1, &texture);
+
+  m_lists.clear();
+  m_textures.clear();
+  m_select_buffer.clear();
+}
+
+}  // namespace xeus_octave::tk::notebook
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "xeus-octave/opengl_tiles.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+void tiled_opengl_functions::set_tile(int x, int y, int width, int height, int full_width, int full_height)
+{
+  m_tiled = true;
+  m_tile = {x, y, width, height};
+  m_viewport = {0, 0, full_width, full_height};
+}
+
+void tiled_opengl_functions::glViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+  if (!m_tiled)
+  {
+    batched_opengl_functions::glViewport(x, y, width, height);
+    return;
+  }
+
+  // The viewport may be larger than the maximum the driver supports, only
+  // the tile is given to it
+  m_viewport = {x, y, width, height};
+  batched_opengl_functions::glViewport(0, 0, m_tile[2], m_tile[3]);
+}
+
+void tiled_opengl_functions::glGetIntegerv(GLenum pname, GLint* data)
+{
+  batched_opengl_functions::glGetIntegerv(pname, data);
+
+  if (m_tiled && pname == GL_VIEWPORT)
+    std::copy(m_viewport.begin(), m_viewport.end(), data);
+}
+
+void tiled_opengl_functions::glMatrixMode(GLenum mode)
+{
+  m_matrix_mode = mode;
+  batched_opengl_functions::glMatrixMode(mode);
+}
+
+void tiled_opengl_functions::glLoadIdentity()
+{
+  batched_opengl_functions::glLoadIdentity();
+
+  // The renderer always builds its projections from the identity
+  if (m_tiled && m_matrix_mode == GL_PROJECTION)
+    batched_opengl_functions::glMultMatrixd(tile_matrix().data());
+}
+
+void tiled_opengl_functions::glRasterPos3d(GLdouble x, GLdouble y, GLdouble z)
+{
+  if (!m_tiled)
+  {
+    batched_opengl_functions::glRasterPos3d(x, y, z);
+    return;
+  }
+
+  // A raster position outside of the tile is invalid, which would drop the
+  // text starting in another tile: the position is projected here, and set
+  // in window coordinates which are always valid
+  std::array<GLdouble, 16> modelview, projection;
+  batched_opengl_functions::glGetDoublev(GL_MODELVIEW_MATRIX, modelview.data());
+  batched_opengl_functions::glGetDoublev(GL_PROJECTION_MATRIX, projection.data());
+
+  auto const transform = [](std::array<GLdouble, 16> const& m, std::array<GLdouble, 4> const& v)
+  {
+    std::array<GLdouble, 4> r = {};
+    for (std::size_t i = 0; i < 4; i++)
+      r[i] = m[i] * v[0] + m[4 + i] * v[1] + m[8 + i] * v[2] + m[12 + i] * v[3];
+    return r;
+  };
+
+  auto const clip = transform(projection, transform(modelview, {x, y, z, 1}));
+
+  // Positions outside the whole viewport stay invalid
+  auto const tile = tile_matrix();
+  auto const inside = [&](GLdouble ndc, GLdouble scale, GLdouble offset)
+  { return std::abs((ndc - offset) / scale) <= 1; };
+
+  if (clip[3] <= 0 || !inside(clip[0] / clip[3], tile[0], tile[12]) || !inside(clip[1] / clip[3], tile[5], tile[13]) ||
+      std::abs(clip[2] / clip[3]) > 1)
+  {
+    batched_opengl_functions::glRasterPos3d(x, y, z);
+    return;
+  }
+
+  ::glWindowPos3d(
+    (clip[0] / clip[3] + 1) / 2 * m_tile[2], (clip[1] / clip[3] + 1) / 2 * m_tile[3], (clip[2] / clip[3] + 1) / 2
+  );
+}
+
+std::array<GLdouble, 16> tiled_opengl_functions::tile_matrix() const
+{
+  // A window coordinate w of the viewport is w - tile in the tile
+  auto const scale = [](GLint viewport, GLint tile) { return static_cast<GLdouble>(viewport) / tile; };
+  auto const offset = [](GLint viewport_origin, GLint viewport, GLint tile_origin, GLint tile)
+  {
+    return static_cast<GLdouble>(viewport) / tile - 1 + 2 * static_cast<GLdouble>(viewport_origin - tile_origin) / tile;
+  };
+
+  std::array<GLdouble, 16> m = {};
+  m[0] = scale(m_viewport[2], m_tile[2]);
+  m[5] = scale(m_viewport[3], m_tile[3]);
+  m[10] = 1;
+  m[12] = offset(m_viewport[0], m_viewport[2], m_tile[0], m_tile[2]);
+  m[13] = offset(m_viewport[1], m_viewport[3], m_tile[1], m_tile[3]);
+  m[15] = 1;
+
+  return m;
+}
+
+}  // namespace xeus_octave::tk::notebook
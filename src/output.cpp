@@ -52,10 +52,17 @@ xoctave_output::int_type xoctave_output::sync()
   // Called in case of flush.
   if (!m_output.empty())
   {
+    std::lock_guard<std::mutex> publish_lock(publish_mutex());
     xeus::get_interpreter().publish_stream(m_channel, m_output);
     m_output.clear();
   }
   return 0;
 }
 
+std::mutex& publish_mutex()
+{
+  static std::mutex mutex;
+  return mutex;
+}
+
 }  // namespace xeus_octave::io
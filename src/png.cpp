@@ -0,0 +1,748 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <array>
+#include <csetjmp>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <png.h>
+#include <zlib.h>
+
+#include "xeus-octave/png.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+namespace
+{
+
+/**
+ * Pixels read back from opengl, possibly reduced to a palette
+ */
+struct raw_image
+{
+  unsigned char const* pixels;
+  std::size_t width;
+  std::size_t height;
+  // One of PNG_COLOR_TYPE_RGB, PNG_COLOR_TYPE_GRAY or PNG_COLOR_TYPE_PALETTE
+  int color_type = PNG_COLOR_TYPE_RGB;
+  // RGB triplets, with PNG_COLOR_TYPE_PALETTE
+  std::vector<unsigned char> palette = {};
+
+  std::size_t bpp() const { return color_type == PNG_COLOR_TYPE_RGB ? 3 : 1; }
+
+  std::size_t stride() const { return width * bpp(); }
+
+  /**
+   * Row y from the top of the image (opengl stores the bottom row first)
+   */
+  unsigned char const* row(std::size_t y) const { return pixels + (height - 1 - y) * stride(); }
+};
+
+struct deflate_params
+{
+  int level;
+  int strategy;
+  // Choose the filter of each row, instead of always using the "up" filter
+  bool adaptive;
+  // Second byte of the zlib header, advertising the compression level
+  unsigned char flags;
+};
+
+deflate_params get_params(png_preset preset)
+{
+  switch (preset)
+  {
+  case png_preset::fast:
+    return {1, Z_DEFAULT_STRATEGY, false, 0x01};
+  case png_preset::small:
+    return {9, Z_DEFAULT_STRATEGY, true, 0xDA};
+  case png_preset::balanced:
+    break;
+  }
+
+  return {6, Z_DEFAULT_STRATEGY, true, 0x9C};
+}
+
+int paeth(int a, int b, int c)
+{
+  int const p = a + b - c;
+  int const pa = std::abs(p - a);
+  int const pb = std::abs(p - b);
+  int const pc = std::abs(p - c);
+
+  if (pa <= pb && pa <= pc)
+    return a;
+  if (pb <= pc)
+    return b;
+  return c;
+}
+
+/**
+ * Apply one of the five PNG filters to a row, returning the sum of the
+ * absolute values of the filtered bytes
+ */
+template <int type>
+std::size_t
+apply_filter(unsigned char const* cur, unsigned char const* prev, std::size_t n, std::size_t bpp, unsigned char* out)
+{
+  std::size_t cost = 0;
+
+  auto const filter = [&](std::size_t i, [[maybe_unused]] int a, [[maybe_unused]] int b, [[maybe_unused]] int c)
+  {
+    int p = 0;
+
+    if constexpr (type == 1)
+      p = a;
+    else if constexpr (type == 2)
+      p = b;
+    else if constexpr (type == 3)
+      p = (a + b) / 2;
+    else if constexpr (type == 4)
+      p = paeth(a, b, c);
+
+    out[i] = static_cast<unsigned char>(cur[i] - p);
+    cost += static_cast<std::size_t>(std::abs(static_cast<signed char>(out[i])));
+  };
+
+  // The first pixel has no left neighbour
+  for (std::size_t i = 0; i < bpp && i < n; i++)
+    filter(i, 0, prev[i], 0);
+  for (std::size_t i = bpp; i < n; i++)
+    filter(i, cur[i - bpp], prev[i], prev[i - bpp]);
+
+  return cost;
+}
+
+/**
+ * Produces the filtered rows of an image, each one prefixed by its filter
+ * type. In adaptive mode the filter minimizing the sum of absolute
+ * differences is chosen, which is the heuristic used by libpng. Palette
+ * indices are never filtered, as advised by the PNG specification.
+ */
+class row_filter
+{
+public:
+
+  row_filter(raw_image const& image, bool adaptive) :
+    m_image(image),
+    m_adaptive(adaptive && image.color_type != PNG_COLOR_TYPE_PALETTE),
+    m_fixed(image.color_type == PNG_COLOR_TYPE_PALETTE ? 0 : 2),
+    m_zero(image.stride())
+  {
+    for (auto& line : m_lines)
+      line.resize(image.stride() + 1);
+  }
+
+  /**
+   * Filter row y, returning stride + 1 bytes valid until the next call
+   */
+  unsigned char const* operator()(std::size_t y)
+  {
+    using filter_fn =
+      std::size_t (*)(unsigned char const*, unsigned char const*, std::size_t, std::size_t, unsigned char*);
+    static constexpr std::array<filter_fn, 5> filters = {
+      apply_filter<0>, apply_filter<1>, apply_filter<2>, apply_filter<3>, apply_filter<4>
+    };
+
+    auto const n = m_image.stride();
+    auto const* cur = m_image.row(y);
+    auto const* prev = y > 0 ? m_image.row(y - 1) : m_zero.data();
+
+    if (!m_adaptive)
+    {
+      m_lines[0][0] = static_cast<unsigned char>(m_fixed);
+      filters[m_fixed](cur, prev, n, m_image.bpp(), m_lines[0].data() + 1);
+      return m_lines[0].data();
+    }
+
+    // Rows equal to the previous one, which are common in plots, are all
+    // zeros with the "up" filter
+    if (std::memcmp(cur, prev, n) == 0)
+    {
+      m_lines[0][0] = 2;
+      filters[2](cur, prev, n, m_image.bpp(), m_lines[0].data() + 1);
+      return m_lines[0].data();
+    }
+
+    // Each candidate is written over the worst of the two lines
+    std::size_t best = 1;
+    std::size_t best_cost = std::numeric_limits<std::size_t>::max();
+
+    for (std::size_t type = 0; type < filters.size(); type++)
+    {
+      auto& line = m_lines[1 - best];
+      line[0] = static_cast<unsigned char>(type);
+      auto const cost = filters[type](cur, prev, n, m_image.bpp(), line.data() + 1);
+
+      if (cost < best_cost)
+      {
+        best_cost = cost;
+        best = 1 - best;
+      }
+    }
+
+    return m_lines[best].data();
+  }
+
+private:
+
+  raw_image const& m_image;
+  bool m_adaptive;
+  std::size_t m_fixed;
+  std::vector<unsigned char> m_zero;
+  std::array<std::vector<unsigned char>, 2> m_lines;
+};
+
+/**
+ * Reduce an RGB image with at most 256 colours to palette indices, or to
+ * grayscale when all the colours are gray. Returns false as soon as more
+ * colours are found, in which case the image must be written as RGB.
+ */
+bool reduce_colors(raw_image const& image, std::vector<unsigned char>& indices, raw_image& reduced)
+{
+  constexpr std::size_t max_colors = 256;
+  // Open addressing hash table of the colours, at most a quarter full
+  constexpr std::size_t table_bits = 10;
+  constexpr std::uint32_t empty = 0xFFFFFFFF;
+
+  std::array<std::uint32_t, std::size_t{1} << table_bits> keys;
+  std::array<unsigned char, std::size_t{1} << table_bits> values;
+  keys.fill(empty);
+
+  auto const count = image.width * image.height;
+  indices.resize(count);
+  reduced.palette.clear();
+
+  // Plots have long runs of the same colour, which skip the lookup
+  auto last = empty;
+  unsigned char last_index = 0;
+
+  for (std::size_t i = 0; i < count; i++)
+  {
+    auto const* p = image.pixels + 3 * i;
+    auto const key = static_cast<std::uint32_t>(p[0] << 16 | p[1] << 8 | p[2]);
+
+    if (key != last)
+    {
+      auto slot = (key * 2654435761u) >> (32 - table_bits);
+
+      while (keys[slot] != key && keys[slot] != empty)
+        slot = (slot + 1) & (keys.size() - 1);
+
+      if (keys[slot] == empty)
+      {
+        if (reduced.palette.size() == 3 * max_colors)
+          return false;
+
+        keys[slot] = key;
+        values[slot] = static_cast<unsigned char>(reduced.palette.size() / 3);
+        reduced.palette.insert(reduced.palette.end(), p, p + 3);
+      }
+
+      last = key;
+      last_index = values[slot];
+    }
+
+    indices[i] = last_index;
+  }
+
+  reduced.pixels = indices.data();
+  reduced.width = image.width;
+  reduced.height = image.height;
+  reduced.color_type = PNG_COLOR_TYPE_PALETTE;
+
+  auto const& palette = reduced.palette;
+  bool gray = true;
+  for (std::size_t i = 0; gray && i < palette.size(); i += 3)
+    gray = palette[i] == palette[i + 1] && palette[i] == palette[i + 2];
+
+  if (gray)
+  {
+    for (auto& index : indices)
+      index = palette[3 * index];
+
+    reduced.color_type = PNG_COLOR_TYPE_GRAY;
+    reduced.palette.clear();
+  }
+
+  return true;
+}
+
+/**
+ * Encode with libpng
+ */
+std::vector<char> encode_libpng(raw_image const& image, deflate_params const& params)
+{
+  // A RAII structure to manage the lifetime of PNG structures
+  struct PngManager
+  {
+    png_structp png;
+    png_infop info;
+
+    PngManager()
+    {
+      png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+      info = png_create_info_struct(png);
+    }
+
+    ~PngManager() { png_destroy_write_struct(&png, &info); }
+  };
+
+  auto m = PngManager();
+
+  setjmp(png_jmpbuf(m.png));
+
+  png_set_IHDR(
+    m.png,
+    m.info,
+    static_cast<png_uint_32>(image.width),
+    static_cast<png_uint_32>(image.height),
+    8,
+    image.color_type,
+    PNG_INTERLACE_NONE,
+    PNG_COMPRESSION_TYPE_DEFAULT,
+    PNG_FILTER_TYPE_DEFAULT
+  );
+
+  std::vector<png_color> colors(image.palette.size() / 3);
+  for (std::size_t i = 0; i < colors.size(); i++)
+    colors[i] = {image.palette[3 * i], image.palette[3 * i + 1], image.palette[3 * i + 2]};
+
+  if (image.color_type == PNG_COLOR_TYPE_PALETTE)
+    png_set_PLTE(m.png, m.info, colors.data(), static_cast<int>(colors.size()));
+
+  png_set_compression_level(m.png, params.level);
+  png_set_compression_strategy(m.png, params.strategy);
+
+  if (image.color_type == PNG_COLOR_TYPE_PALETTE)
+    png_set_filter(m.png, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+  else
+    png_set_filter(m.png, PNG_FILTER_TYPE_BASE, params.adaptive ? PNG_ALL_FILTERS : PNG_FILTER_UP);
+
+  // libpng does not write to the rows, even if they are not const
+  std::vector<png_bytep> rows(image.height);
+  for (std::size_t y = 0; y < image.height; y++)
+    rows[y] = const_cast<png_bytep>(image.row(y));
+  png_set_rows(m.png, m.info, rows.data());
+
+  std::vector<char> out;
+
+  // Avoid growing the vector at each of the first write callbacks
+  out.reserve(image.height * image.stride() / 8 + 1024);
+
+  png_set_write_fn(
+    m.png,
+    &out,
+    [](png_structp png_, png_bytep d, png_size_t l)
+    {
+      std::vector<char>* img_ptr = static_cast<std::vector<char>*>(png_get_io_ptr(png_));
+      img_ptr->insert(img_ptr->end(), d, d + l);
+    },
+    nullptr
+  );
+
+  png_write_png(m.png, m.info, PNG_TRANSFORM_IDENTITY, NULL);
+
+  return out;
+}
+
+/**
+ * A horizontal strip of the image, deflated as a sequence of raw deflate
+ * blocks which can be concatenated to the ones of the other strips
+ */
+struct strip
+{
+  std::vector<char> data;
+  uLong adler = adler32(0L, Z_NULL, 0);
+  std::size_t length = 0;
+};
+
+/**
+ * Run deflate until all the input is consumed, growing the output as needed
+ */
+void run_deflate(z_stream& z, std::vector<char>& out, int flush)
+{
+  while (true)
+  {
+    auto const written = static_cast<std::size_t>(z.total_out);
+
+    if (out.size() == written)
+      out.resize(std::max<std::size_t>(out.size() * 2, 4096));
+
+    z.next_out = reinterpret_cast<Bytef*>(out.data() + written);
+    z.avail_out = static_cast<uInt>(std::min<std::size_t>(out.size() - written, std::numeric_limits<uInt>::max()));
+
+    auto const ret = deflate(&z, flush);
+
+    if (ret == Z_STREAM_ERROR)
+      throw std::runtime_error("Cannot deflate the image");
+
+    if (flush == Z_FINISH ? ret == Z_STREAM_END : (z.avail_in == 0 && z.avail_out != 0))
+      return;
+  }
+}
+
+strip deflate_strip(
+  raw_image const& image, std::size_t first, std::size_t last, deflate_params const& params, bool final
+)
+{
+  auto const n = image.stride() + 1;
+  auto filter = row_filter(image, params.adaptive);
+
+  z_stream z{};
+  if (deflateInit2(&z, params.level, Z_DEFLATED, -15, 9, params.strategy) != Z_OK)
+    throw std::runtime_error("Cannot initialize the deflate stream");
+
+  auto guard = std::unique_ptr<z_stream, decltype(&deflateEnd)>(&z, deflateEnd);
+
+  // Prime the window with the end of the previous strip, so that the strips
+  // compress almost as well as a single stream
+  if (first > 0)
+  {
+    constexpr std::size_t window = 32768;
+    auto const rows = std::min(first, (window + n - 1) / n);
+
+    std::vector<unsigned char> dictionary;
+    dictionary.reserve(rows * n);
+
+    for (auto y = first - rows; y < first; y++)
+    {
+      auto const* line = filter(y);
+      dictionary.insert(dictionary.end(), line, line + n);
+    }
+
+    auto const size = std::min(dictionary.size(), window);
+    deflateSetDictionary(&z, dictionary.data() + dictionary.size() - size, static_cast<uInt>(size));
+  }
+
+  strip s;
+  s.length = (last - first) * n;
+  s.data.resize(std::max<std::size_t>(s.length / 8, 4096));
+
+  for (auto y = first; y < last; y++)
+  {
+    auto const* line = filter(y);
+    s.adler = adler32(s.adler, line, static_cast<uInt>(n));
+
+    // zlib does not write to the input, even if it is not const
+    z.next_in = const_cast<Bytef*>(line);
+    z.avail_in = static_cast<uInt>(n);
+
+    // A sync flush ends the strip on a byte boundary without ending the
+    // stream, so that the next strip can be appended
+    run_deflate(z, s.data, y + 1 < last ? Z_NO_FLUSH : (final ? Z_FINISH : Z_SYNC_FLUSH));
+  }
+
+  s.data.resize(static_cast<std::size_t>(z.total_out));
+
+  return s;
+}
+
+void put_u32(std::vector<char>& out, std::uint32_t value)
+{
+  out.push_back(static_cast<char>((value >> 24) & 0xFF));
+  out.push_back(static_cast<char>((value >> 16) & 0xFF));
+  out.push_back(static_cast<char>((value >> 8) & 0xFF));
+  out.push_back(static_cast<char>(value & 0xFF));
+}
+
+/**
+ * Append a PNG chunk whose data is the concatenation of parts
+ */
+void write_chunk(
+  std::vector<char>& out, char const* type, std::initializer_list<std::pair<char const*, std::size_t>> parts
+)
+{
+  std::size_t length = 0;
+  for (auto const& part : parts)
+    length += part.second;
+
+  put_u32(out, static_cast<std::uint32_t>(length));
+
+  auto const start = out.size();
+  out.insert(out.end(), type, type + 4);
+  for (auto const& [data, size] : parts)
+    out.insert(out.end(), data, data + size);
+
+  auto const crc = crc32(0L, reinterpret_cast<Bytef const*>(out.data() + start), static_cast<uInt>(out.size() - start));
+  put_u32(out, static_cast<std::uint32_t>(crc));
+}
+
+/**
+ * Write the PNG stream of an image from its deflated strips
+ */
+std::vector<char> write_png(raw_image const& image, std::vector<strip> const& strips, deflate_params const& params)
+{
+  // The checksum of the whole stream is combined from the ones of the strips
+  uLong adler = strips[0].adler;
+  for (std::size_t i = 1; i < strips.size(); i++)
+    adler = adler32_combine(adler, strips[i].adler, static_cast<z_off_t>(strips[i].length));
+
+  std::array<char, 2> header = {0x78, static_cast<char>(params.flags)};
+  std::vector<char> trailer;
+  put_u32(trailer, static_cast<std::uint32_t>(adler));
+
+  std::vector<char> ihdr;
+  put_u32(ihdr, static_cast<std::uint32_t>(image.width));
+  put_u32(ihdr, static_cast<std::uint32_t>(image.height));
+  // Bit depth, color type, compression, filter and interlace methods
+  ihdr.insert(ihdr.end(), {8, static_cast<char>(image.color_type), 0, 0, 0});
+
+  // Compute the final size to write the image without reallocations
+  constexpr std::size_t signature_size = 8;
+  constexpr std::size_t chunk_overhead = 12;
+  std::size_t size = signature_size + chunk_overhead + ihdr.size() + chunk_overhead + header.size() + trailer.size();
+  if (image.color_type == PNG_COLOR_TYPE_PALETTE)
+    size += chunk_overhead + image.palette.size();
+  for (auto const& s : strips)
+    size += chunk_overhead + s.data.size();
+
+  std::vector<char> out;
+  out.reserve(size);
+
+  constexpr std::array<unsigned char, signature_size> signature = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  out.insert(out.end(), signature.begin(), signature.end());
+
+  write_chunk(out, "IHDR", {{ihdr.data(), ihdr.size()}});
+
+  if (image.color_type == PNG_COLOR_TYPE_PALETTE)
+    write_chunk(out, "PLTE", {{reinterpret_cast<char const*>(image.palette.data()), image.palette.size()}});
+
+  // One IDAT chunk per strip, with the zlib header in the first one and the
+  // checksum in the last one
+  for (std::size_t i = 0; i < strips.size(); i++)
+    write_chunk(
+      out,
+      "IDAT",
+      {
+        {header.data(), i == 0 ? header.size() : 0},
+        {strips[i].data.data(), strips[i].data.size()},
+        {trailer.data(), i + 1 == strips.size() ? trailer.size() : 0},
+      }
+    );
+
+  write_chunk(out, "IEND", {});
+
+  return out;
+}
+
+/**
+ * Encode with zlib, deflating large images as parallel strips
+ */
+std::vector<char> encode_zlib(raw_image const& image, deflate_params const& params)
+{
+  // Strips are at least 1MiB of filtered data, and there are no more strips
+  // than cores
+  constexpr std::size_t strip_size = 1 << 20;
+  auto const raw_size = image.height * (image.stride() + 1);
+  auto const cores = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+  auto const count = std::max<std::size_t>(std::min({raw_size / strip_size, cores, image.height}), 1);
+  auto const first_row = [&](std::size_t i) { return image.height * i / count; };
+
+  std::vector<std::future<strip>> jobs;
+  for (std::size_t i = 1; i < count; i++)
+    jobs.push_back(std::async(
+      std::launch::async,
+      deflate_strip,
+      std::cref(image),
+      first_row(i),
+      first_row(i + 1),
+      std::cref(params),
+      i + 1 == count
+    ));
+
+  std::vector<strip> strips;
+  strips.push_back(deflate_strip(image, 0, first_row(1), params, count == 1));
+  for (auto& job : jobs)
+    strips.push_back(job.get());
+
+  return write_png(image, strips, params);
+}
+
+}  // namespace
+
+std::string to_string(png_backend backend)
+{
+  switch (backend)
+  {
+  case png_backend::libpng:
+    return "libpng";
+  case png_backend::zlib:
+    break;
+  }
+
+  return "zlib";
+}
+
+std::string to_string(png_preset preset)
+{
+  switch (preset)
+  {
+  case png_preset::fast:
+    return "fast";
+  case png_preset::small:
+    return "small";
+  case png_preset::balanced:
+    break;
+  }
+
+  return "balanced";
+}
+
+bool from_string(std::string const& name, png_backend& backend)
+{
+  if (name == "libpng")
+    backend = png_backend::libpng;
+  else if (name == "zlib")
+    backend = png_backend::zlib;
+  else
+    return false;
+
+  return true;
+}
+
+bool from_string(std::string const& name, png_preset& preset)
+{
+  if (name == "fast")
+    preset = png_preset::fast;
+  else if (name == "balanced")
+    preset = png_preset::balanced;
+  else if (name == "small")
+    preset = png_preset::small;
+  else
+    return false;
+
+  return true;
+}
+
+std::vector<char>
+png_encode(unsigned char const* pixels, unsigned int width, unsigned int height, png_options const& options)
+{
+  auto image = raw_image{pixels, width, height};
+  auto const params = get_params(options.preset);
+
+  // Most plots have few colours, which are written as 8 bit palette indices
+  // instead of 24 bit pixels
+  std::vector<unsigned char> indices;
+  raw_image reduced{};
+  if (reduce_colors(image, indices, reduced))
+    image = std::move(reduced);
+
+  if (options.backend == png_backend::libpng)
+    return encode_libpng(image, params);
+
+  return encode_zlib(image, params);
+}
+
+struct png_band_encoder::state
+{
+  raw_image image;
+  deflate_params params;
+  // Rows added so far
+  std::size_t rows = 0;
+  // The last rows added, which precede the next band
+  std::vector<unsigned char> context = {};
+  // Bands being deflated, the oldest first
+  std::deque<std::future<strip>> running = {};
+  std::vector<strip> strips = {};
+};
+
+png_band_encoder::png_band_encoder(unsigned int width, unsigned int height, png_options const& options) :
+  m_state(std::make_unique<state>(state{raw_image{nullptr, width, height}, get_params(options.preset)}))
+{
+}
+
+png_band_encoder::~png_band_encoder() = default;
+
+void png_band_encoder::add(std::vector<unsigned char> pixels)
+{
+  auto& s = *m_state;
+  auto const stride = s.image.stride();
+  auto const band_rows = pixels.size() / stride;
+  auto const context_rows = s.context.size() / stride;
+
+  // The filters need the row before the band, and the deflate dictionary
+  // the 32KiB before it
+  auto const keep = (32768 + stride) / (stride + 1) + 1;
+
+  // The bottom rows come first, both in the band and in the context
+  std::vector<unsigned char> context;
+  auto const from_band = std::min(keep, band_rows);
+  auto const from_context = std::min(keep - from_band, context_rows);
+  context.reserve((from_band + from_context) * stride);
+  context.insert(context.end(), pixels.begin(), pixels.begin() + static_cast<std::ptrdiff_t>(from_band * stride));
+  context.insert(
+    context.end(), s.context.begin(), s.context.begin() + static_cast<std::ptrdiff_t>(from_context * stride)
+  );
+
+  // The band is deflated after the previous rows, which sit above it
+  pixels.insert(pixels.end(), s.context.begin(), s.context.end());
+  s.context = std::move(context);
+
+  auto const final = s.rows + band_rows == s.image.height;
+  s.rows += band_rows;
+
+  // Bound the number of bands in memory
+  auto const cores = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+  while (s.running.size() >= std::min<std::size_t>(cores, 4))
+  {
+    s.strips.push_back(s.running.front().get());
+    s.running.pop_front();
+  }
+
+  s.running.push_back(std::async(
+    std::launch::async,
+    [data = std::move(pixels), width = s.image.width, band_rows, context_rows, params = s.params, final]
+    {
+      auto const image = raw_image{data.data(), width, band_rows + context_rows};
+      return deflate_strip(image, context_rows, context_rows + band_rows, params, final);
+    }
+  ));
+}
+
+std::vector<char> png_band_encoder::finish()
+{
+  auto& s = *m_state;
+
+  for (auto& job : s.running)
+    s.strips.push_back(job.get());
+  s.running.clear();
+
+  if (s.rows != s.image.height || s.strips.empty())
+    throw std::runtime_error("The bands do not cover the image");
+
+  return write_png(s.image, s.strips, s.params);
+}
+
+}  // namespace xeus_octave::tk::notebook
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <exception>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <utility>
+
+#include "xeus-octave/publisher.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+figure_publisher::figure_publisher() : m_thread([this] { run(); }) {}
+
+figure_publisher::~figure_publisher()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+
+  m_work.notify_one();
+  m_thread.join();
+}
+
+std::future<void> figure_publisher::submit(job j)
+{
+  std::promise<void> done;
+  auto result = done.get_future();
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_jobs.emplace_back(std::move(j), std::move(done));
+  }
+
+  m_work.notify_one();
+
+  return result;
+}
+
+void figure_publisher::flush()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_idle.wait(lock, [this] { return m_jobs.empty() && !m_busy; });
+}
+
+void figure_publisher::run()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  while (true)
+  {
+    m_work.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+
+    // Pending jobs are still run when stopping
+    if (m_jobs.empty())
+      return;
+
+    auto [j, done] = std::move(m_jobs.front());
+    m_jobs.pop_front();
+    m_busy = true;
+
+    lock.unlock();
+
+    try
+    {
+      j();
+    }
+    catch (std::exception const& e)
+    {
+      std::clog << "Cannot publish figure: " << e.what() << '\n';
+    }
+
+    done.set_value();
+
+    lock.lock();
+
+    m_busy = false;
+
+    if (m_jobs.empty())
+      m_idle.notify_all();
+  }
+}
+
+}  // namespace xeus_octave::tk::notebook
@@ -0,0 +1,410 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "xeus-octave/offscreen.hpp"
+#include "xeus-octave/opengl.hpp"
+#include "xeus-octave/opengl_replay.hpp"
+#include "xeus-octave/render_daemon.hpp"
+#include "xeus-octave/render_protocol.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+namespace
+{
+
+// A client not reading its replies for this long is disconnected, so that
+// it does not block the others
+constexpr time_t client_timeout_seconds = 10;
+
+// Largest size of the calls of a frame, which are kept until its end
+constexpr std::size_t max_frame_size = max_message_size;
+
+sockaddr_un socket_address(std::string const& path)
+{
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, path.c_str(), std::min(path.size() + 1, sizeof(address.sun_path) - 1));
+  return address;
+}
+
+bool send_failure(int socket, std::string const& reason)
+{
+  return send_message(socket, render_message::failure, {reason.begin(), reason.end()});
+}
+
+void set_timeout(int socket)
+{
+  // The messages are received without waiting
+  timeval const timeout = {client_timeout_seconds, 0};
+  ::setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+}  // namespace
+
+render_daemon::render_daemon(std::string const& socket) : m_path(socket)
+{
+  if (m_path.size() >= sizeof(sockaddr_un::sun_path))
+  {
+    std::clog << "The socket path is too long: " << m_path << '\n';
+    return;
+  }
+
+  auto const address = socket_address(m_path);
+  auto const fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return;
+
+  // A socket left by a daemon which did not exit cleanly is replaced, but
+  // not the one of a running daemon
+  if (::connect(fd, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) == 0)
+  {
+    std::clog << "A render daemon already listens on " << m_path << '\n';
+    ::close(fd);
+    return;
+  }
+
+  ::unlink(m_path.c_str());
+
+  if (::bind(fd, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) != 0 || ::listen(fd, 16) != 0)
+  {
+    std::clog << "Cannot listen on " << m_path << ": " << std::strerror(errno) << '\n';
+    ::close(fd);
+    return;
+  }
+
+  m_socket = fd;
+  m_context = std::make_unique<offscreen_context>();
+
+  if (!m_context->is_valid())
+  {
+    std::clog << "No OpenGL context available" << '\n';
+    return;
+  }
+
+  m_context->make_current();
+  m_glfcns.set_batching(true);
+
+  std::array<GLint, 2> viewport = {};
+  GLint renderbuffer = 0;
+  glGetIntegerv(GL_MAX_VIEWPORT_DIMS, viewport.data());
+  glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &renderbuffer);
+  m_max_size = std::max(std::min({viewport[0], viewport[1], renderbuffer}), 1);
+}
+
+render_daemon::~render_daemon()
+{
+  for (auto& c : m_clients)
+    disconnect(*c);
+
+  if (m_socket >= 0)
+  {
+    ::close(m_socket);
+    ::unlink(m_path.c_str());
+  }
+}
+
+void render_daemon::run(volatile std::sig_atomic_t const& stop)
+{
+  std::vector<pollfd> fds;
+
+  while (!stop)
+  {
+    fds.assign(1, pollfd{m_socket, POLLIN, 0});
+    for (auto const& c : m_clients)
+      fds.push_back(pollfd{c->socket, POLLIN, 0});
+
+    if (::poll(fds.data(), fds.size(), 1000) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      std::clog << "Cannot wait for the clients: " << std::strerror(errno) << '\n';
+      return;
+    }
+
+    // The clients are served in turn, with what they sent so far
+    for (std::size_t i = 1; i < fds.size(); ++i)
+      if (fds[i].revents != 0 && !serve(*m_clients[i - 1]))
+        disconnect(*m_clients[i - 1]);
+
+    m_clients.erase(
+      std::remove_if(m_clients.begin(), m_clients.end(), [](auto const& c) { return c->socket < 0; }),
+      m_clients.end()
+    );
+
+    if (fds[0].revents & POLLIN)
+    {
+      auto const socket = ::accept(m_socket, nullptr, nullptr);
+
+      if (socket >= 0)
+      {
+        set_timeout(socket);
+        m_clients.push_back(std::make_unique<client>(socket, m_glfcns));
+      }
+    }
+  }
+}
+
+bool render_daemon::serve(client& c)
+{
+  if (!c.input.receive(c.socket))
+    return false;
+
+  render_message type;
+  std::vector<char> payload;
+
+  try
+  {
+    while (c.input.next(type, payload))
+      if (!handle(c, type, std::move(payload)))
+        return false;
+  }
+  catch (std::exception const& e)
+  {
+    std::clog << "Dropping a client: " << e.what() << '\n';
+    return false;
+  }
+
+  return true;
+}
+
+bool render_daemon::handle(client& c, render_message type, std::vector<char> payload)
+{
+  message_reader reader(payload);
+  message_writer result;
+
+  if (type == render_message::hello)
+  {
+    if (reader.get<std::uint32_t>() != render_protocol_version)
+    {
+      send_failure(c.socket, "unsupported protocol version");
+      return false;
+    }
+
+    result.put(render_protocol_version, std::int32_t(m_max_size));
+    return send_message(c.socket, render_message::hello, result.data());
+  }
+
+  if (!c.in_frame)
+  {
+    switch (type)
+    {
+    case render_message::calls:
+      replay_calls(c, payload, result);
+      return true;
+
+    case render_message::query:
+      try
+      {
+        replay_calls(c, payload, result);
+      }
+      catch (unanswered_query const& e)
+      {
+        return send_failure(c.socket, e.what());
+      }
+
+      return send_message(c.socket, render_message::result, result.data());
+
+    case render_message::begin_frame:
+      c.width = reader.get<std::int32_t>();
+      c.height = reader.get<std::int32_t>();
+      c.in_frame = true;
+      // The frames which cannot be drawn are still read to the end, and fail
+      c.frame_valid = c.width > 0 && c.height > 0 && c.width <= m_max_size && c.height <= m_max_size;
+      return true;
+
+    default:
+      return false;
+    }
+  }
+
+  auto const reason = "cannot draw a frame of " + std::to_string(c.width) + "x" + std::to_string(c.height);
+
+  switch (type)
+  {
+  case render_message::calls:
+  case render_message::query:
+  case render_message::end_frame:
+    break;
+
+  default:
+    return false;
+  }
+
+  if (c.frame_valid)
+  {
+    c.frame_size += payload.size();
+    if (c.frame_size > max_frame_size)
+      throw std::runtime_error("too many calls in a frame");
+
+    c.frame.push_back(std::move(payload));
+  }
+
+  if (type == render_message::calls)
+    return true;
+
+  if (type == render_message::end_frame)
+  {
+    if (c.frame_valid)
+      return end_frame(c);
+
+    c.in_frame = false;
+    return send_failure(c.socket, reason);
+  }
+
+  if (!c.frame_valid)
+    return send_failure(c.socket, reason);
+
+  try
+  {
+    resume(c, result);
+  }
+  catch (unanswered_query const& e)
+  {
+    // The queries which the replayer does not answer fail, but the frame goes
+    // on
+    return send_failure(c.socket, e.what());
+  }
+
+  return send_message(c.socket, render_message::result, result.data());
+}
+
+void render_daemon::resume(client& c, message_writer& result)
+{
+  if (m_drawing != &c)
+  {
+    suspend();
+
+    m_framebuffer = m_framebuffers.acquire(c.width, c.height);
+    m_framebuffer->bind();
+    c.replayer.begin_frame(c.width, c.height);
+    c.replayed = 0;
+    m_drawing = &c;
+  }
+
+  while (c.replayed < c.frame.size())
+  {
+    message_reader reader(c.frame[c.replayed++]);
+    result.clear();
+
+    try
+    {
+      c.replayer.replay(reader, result);
+    }
+    catch (unanswered_query const&)
+    {
+      // The queries replayed again were already answered
+      if (c.replayed == c.frame.size())
+        throw;
+    }
+  }
+}
+
+void render_daemon::suspend()
+{
+  if (!m_drawing)
+    return;
+
+  m_drawing->replayer.end_frame();
+  framebuffer::unbind();
+  m_framebuffers.release(std::move(m_framebuffer));
+
+  // Its calls are replayed again from the start of the frame
+  m_drawing->replayed = 0;
+  m_drawing = nullptr;
+}
+
+void render_daemon::replay_calls(client& c, std::vector<char> const& payload, message_writer& result)
+{
+  suspend();
+
+  message_reader reader(payload);
+  c.replayer.begin_calls();
+
+  try
+  {
+    c.replayer.replay(reader, result);
+  }
+  catch (...)
+  {
+    c.replayer.end_frame();
+    throw;
+  }
+
+  c.replayer.end_frame();
+}
+
+bool render_daemon::end_frame(client& c)
+{
+  message_writer ignored;
+  resume(c, ignored);
+  m_glfcns.flush();
+
+  std::vector<char> pixels(static_cast<std::size_t>(c.width) * static_cast<std::size_t>(c.height) * 3);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+  glReadPixels(0, 0, c.width, c.height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+  suspend();
+  c.in_frame = false;
+  c.frame.clear();
+  c.frame_size = 0;
+
+  return send_message(c.socket, render_message::pixels, pixels);
+}
+
+void render_daemon::disconnect(client& c)
+{
+  if (c.socket < 0)
+    return;
+
+  if (m_drawing == &c)
+    suspend();
+
+  ::close(c.socket);
+  c.socket = -1;
+
+  // The lists and textures of the client are of no use to the others
+  c.replayer.release();
+}
+
+}  // namespace xeus_octave::tk::notebook
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "xeus-octave/figure_snapshot.hpp"
+#include "xeus-octave/offscreen.hpp"
+#include "xeus-octave/opengl.hpp"
+#include "xeus-octave/render_pool.hpp"
+#include "xeus-octave/render_protocol.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+namespace
+{
+
+std::size_t microseconds_since(std::chrono::steady_clock::time_point start)
+{
+  auto const duration = std::chrono::steady_clock::now() - start;
+  return static_cast<std::size_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+}
+
+}  // namespace
+
+render_pool::render_pool(std::size_t threads, offscreen_context& current) : m_threads(threads)
+{
+  current.make_current();
+  m_limits = query_driver_limits();
+
+  // The contexts are created here, as some windowing systems only allow it
+  // on the main thread, and each one is current on its thread only
+  for (std::size_t i = 0; i < threads; ++i)
+  {
+    auto const& context = m_workers.emplace_back(std::make_unique<worker>())->context;
+    m_valid = m_valid && context.is_valid() && context.backend() == current.backend();
+  }
+
+  current.make_current();
+
+  if (!m_valid)
+  {
+    std::clog << "Cannot create the OpenGL contexts of the render threads" << '\n';
+    m_workers.clear();
+    return;
+  }
+
+  for (auto& w : m_workers)
+    w->thread = std::thread([this, &w = *w] { run(w); });
+}
+
+render_pool::~render_pool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+
+  for (auto& w : m_workers)
+  {
+    w->work.notify_one();
+    w->thread.join();
+  }
+}
+
+void render_pool::submit(std::size_t key, figure_snapshot snapshot, callback done)
+{
+  auto& w = *m_workers[key % m_workers.size()];
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    w.jobs.emplace_back(std::move(snapshot), std::move(done));
+  }
+
+  w.work.notify_one();
+}
+
+void render_pool::flush()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_idle.wait(
+    lock,
+    [this]
+    {
+      for (auto const& w : m_workers)
+        if (w->busy || !w->jobs.empty())
+          return false;
+      return true;
+    }
+  );
+}
+
+void render_pool::run(worker& w)
+{
+  w.context.make_current();
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  while (true)
+  {
+    w.work.wait(lock, [this, &w] { return m_stop || !w.jobs.empty(); });
+
+    // Pending snapshots are still drawn when stopping
+    if (w.jobs.empty())
+      break;
+
+    auto [snapshot, done] = std::move(w.jobs.front());
+    w.jobs.pop_front();
+    w.busy = true;
+
+    lock.unlock();
+
+    try
+    {
+      draw(w, snapshot, done);
+    }
+    catch (std::exception const& e)
+    {
+      std::clog << "Cannot draw figure: " << e.what() << '\n';
+    }
+
+    lock.lock();
+
+    w.busy = false;
+    m_idle.notify_all();
+  }
+
+  lock.unlock();
+
+  // The context is destroyed on the interpreter thread
+  w.framebuffers.clear();
+  w.context.release_current();
+}
+
+void render_pool::draw(worker& w, figure_snapshot const& snapshot, callback& done)
+{
+  auto const start = std::chrono::steady_clock::now();
+
+  auto fb = w.framebuffers.acquire(snapshot.width, snapshot.height);
+  fb->bind();
+
+  w.glfcns.set_batching(snapshot.batching);
+  w.replayer.begin_frame(snapshot.width, snapshot.height);
+
+  try
+  {
+    message_reader reader(snapshot.calls);
+    message_writer result;
+
+    w.replayer.replay(reader, result);
+    w.glfcns.flush();
+  }
+  catch (...)
+  {
+    w.replayer.end_frame();
+    w.replayer.release();
+    framebuffer::unbind();
+    w.framebuffers.release(std::move(fb));
+    throw;
+  }
+
+  auto const render_us = microseconds_since(start);
+  auto const readback_start = std::chrono::steady_clock::now();
+
+  auto const size = static_cast<std::size_t>(snapshot.width) * static_cast<std::size_t>(snapshot.height) * 3;
+  std::vector<unsigned char> pixels(size);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+  glReadPixels(0, 0, snapshot.width, snapshot.height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+  auto const readback_us = microseconds_since(readback_start);
+
+  // The display lists and textures of a snapshot are not shared with the
+  // next ones
+  w.replayer.end_frame();
+  w.replayer.release();
+  framebuffer::unbind();
+  w.framebuffers.release(std::move(fb));
+  get_gl_stats().snapshots_drawn++;
+
+  done(pixels, render_us, readback_us);
+}
+
+}  // namespace xeus_octave::tk::notebook
@@ -0,0 +1,397 @@
+/*
+ * Copyright (C) 2022 Giulio Girardi.
+ *
+ * This file is part of xeus-octave.
+ *
+ * xeus-octave is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * xeus-octave is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xeus-octave.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include "xeus-octave/opengl.hpp"
+#include "xeus-octave/render_protocol.hpp"
+
+namespace xeus_octave::tk::notebook
+{
+
+namespace
+{
+
+#ifdef MSG_NOSIGNAL
+// A daemon going away must not kill the kernel with a SIGPIPE
+constexpr int send_flags = MSG_NOSIGNAL;
+#else
+constexpr int send_flags = 0;
+#endif
+
+struct message_header
+{
+  std::uint32_t type;
+  std::uint32_t size;
+};
+
+// Bytes read at once from a socket, unless more are missing from the
+// message being received
+constexpr std::size_t receive_chunk_size = std::size_t(1) << 16;
+
+bool is_valid(message_header const& header)
+{
+  return header.size <= max_message_size && header.type <= static_cast<std::uint32_t>(render_message::failure);
+}
+
+bool send_all(int socket, char const* data, std::size_t size)
+{
+  while (size > 0)
+  {
+    auto const sent = ::send(socket, data, size, send_flags);
+
+    if (sent < 0 && errno == EINTR)
+      continue;
+    if (sent <= 0)
+      return false;
+
+    data += sent;
+    size -= static_cast<std::size_t>(sent);
+  }
+
+  return true;
+}
+
+bool receive_all(int socket, char* data, std::size_t size)
+{
+  while (size > 0)
+  {
+    auto const received = ::recv(socket, data, size, 0);
+
+    if (received < 0 && errno == EINTR)
+      continue;
+    if (received <= 0)
+      return false;
+
+    data += received;
+    size -= static_cast<std::size_t>(received);
+  }
+
+  return true;
+}
+
+std::size_t components(GLenum format)
+{
+  switch (format)
+  {
+  case GL_RGBA:
+  case GL_BGRA:
+    return 4;
+  case GL_RGB:
+  case GL_BGR:
+    return 3;
+  case GL_LUMINANCE_ALPHA:
+    return 2;
+  case GL_ALPHA:
+  case GL_BLUE:
+  case GL_COLOR_INDEX:
+  case GL_DEPTH_COMPONENT:
+  case GL_GREEN:
+  case GL_LUMINANCE:
+  case GL_RED:
+  case GL_STENCIL_INDEX:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+std::size_t component_size(GLenum type)
+{
+  switch (type)
+  {
+  case GL_BYTE:
+  case GL_UNSIGNED_BYTE:
+    return 1;
+  case GL_SHORT:
+  case GL_UNSIGNED_SHORT:
+    return 2;
+  case GL_INT:
+  case GL_UNSIGNED_INT:
+  case GL_FLOAT:
+    return 4;
+  default:
+    return 0;
+  }
+}
+
+}  // namespace
+
+char const* message_reader::take(std::size_t size)
+{
+  if (m_position > m_data.size() || size > m_data.size() - m_position)
+    truncated();
+
+  auto const* data = m_data.data() + m_position;
+  m_position += size;
+  return data;
+}
+
+void message_reader::truncated()
+{
+  throw std::runtime_error("truncated render message");
+}
+
+bool message_receiver::receive(int socket)
+{
+  message_header header = {};
+  auto wanted = receive_chunk_size;
+
+  // The rest of the message being received is read at once
+  if (m_data.size() >= sizeof(header))
+  {
+    std::memcpy(&header, m_data.data(), sizeof(header));
+
+    if (!is_valid(header))
+      return false;
+
+    auto const end = sizeof(header) + header.size;
+    wanted = std::max(wanted, end - std::min(end, m_data.size()));
+  }
+
+  auto const offset = m_data.size();
+  m_data.resize(offset + wanted);
+
+  auto received = ::recv(socket, m_data.data() + offset, wanted, MSG_DONTWAIT);
+  while (received < 0 && errno == EINTR)
+    received = ::recv(socket, m_data.data() + offset, wanted, MSG_DONTWAIT);
+
+  m_data.resize(offset + static_cast<std::size_t>(std::max<ssize_t>(received, 0)));
+
+  return received > 0 || (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+}
+
+bool message_receiver::next(render_message& type, std::vector<char>& payload)
+{
+  message_header header = {};
+
+  if (m_data.size() < sizeof(header))
+    return false;
+
+  std::memcpy(&header, m_data.data(), sizeof(header));
+
+  if (!is_valid(header))
+    throw std::runtime_error("invalid render message");
+
+  auto const end = sizeof(header) + header.size;
+  if (m_data.size() < end)
+    return false;
+
+  type = static_cast<render_message>(header.type);
+  payload.assign(m_data.begin() + sizeof(header), m_data.begin() + static_cast<std::ptrdiff_t>(end));
+  m_data.erase(m_data.begin(), m_data.begin() + static_cast<std::ptrdiff_t>(end));
+
+  return true;
+}
+
+bool send_message(int socket, render_message type, std::vector<char> const& payload)
+{
+  if (payload.size() > max_message_size)
+    return false;
+
+  message_header const header = {static_cast<std::uint32_t>(type), static_cast<std::uint32_t>(payload.size())};
+
+  return send_all(socket, reinterpret_cast<char const*>(&header), sizeof(header)) &&
+         send_all(socket, payload.data(), payload.size());
+}
+
+bool receive_message(int socket, render_message& type, std::vector<char>& payload)
+{
+  message_header header = {};
+
+  if (!receive_all(socket, reinterpret_cast<char*>(&header), sizeof(header)) || !is_valid(header))
+    return false;
+
+  type = static_cast<render_message>(header.type);
+  payload.resize(header.size);
+
+  return receive_all(socket, payload.data(), payload.size());
+}
+
+std::string default_render_socket()
+{
+  auto const* runtime = std::getenv("XDG_RUNTIME_DIR");
+
+  return std::string(runtime && *runtime ? runtime : "/tmp") + "/xoctave-renderd.sock";
+}
+
+std::size_t pixel_data_size(
+  GLsizei width, GLsizei height, GLenum format, GLenum type, GLint alignment, GLint row_length
+)
+{
+  if (width <= 0 || height <= 0)
+    return 0;
+
+  auto const pixels_per_row = static_cast<std::size_t>(row_length > 0 ? row_length : width);
+  auto const align = static_cast<std::size_t>(std::max(alignment, 1));
+
+  // Bitmaps have one bit per pixel
+  auto const bitmap = type == GL_BITMAP && (format == GL_COLOR_INDEX || format == GL_STENCIL_INDEX);
+  auto const pixel = components(format) * component_size(type);
+
+  if (!bitmap && pixel == 0)
+    return 0;
+
+  // The sizes which do not fit in a message are not computed, since they
+  // could overflow
+  auto const too_large = max_message_size + 1;
+  auto const row = bitmap ? (pixels_per_row + 7) / 8 : pixels_per_row * pixel;
+  auto const stride = (row + align - 1) / align * align;
+  auto const rows = static_cast<std::size_t>(height - 1);
+
+  if (stride > max_message_size || (rows > 0 && stride > (max_message_size - row) / rows))
+    return too_large;
+
+  // The last row is not padded
+  return stride * rows + row;
+}
+
+std::size_t get_value_count(GLenum pname)
+{
+  switch (pname)
+  {
+  case GL_MODELVIEW_MATRIX:
+  case GL_PROJECTION_MATRIX:
+  case GL_TEXTURE_MATRIX:
+    return 16;
+  case GL_VIEWPORT:
+  case GL_SCISSOR_BOX:
+  case GL_COLOR_CLEAR_VALUE:
+  case GL_COLOR_WRITEMASK:
+  case GL_CURRENT_COLOR:
+  case GL_CURRENT_RASTER_COLOR:
+  case GL_CURRENT_RASTER_POSITION:
+  case GL_CURRENT_TEXTURE_COORDS:
+  case GL_FOG_COLOR:
+  case GL_LIGHT_MODEL_AMBIENT:
+    return 4;
+  case GL_CURRENT_NORMAL:
+    return 3;
+  case GL_ALIASED_LINE_WIDTH_RANGE:
+  case GL_ALIASED_POINT_SIZE_RANGE:
+  case GL_DEPTH_RANGE:
+  case GL_LINE_WIDTH_RANGE:
+  case GL_MAX_VIEWPORT_DIMS:
+  case GL_POINT_SIZE_RANGE:
+  case GL_POLYGON_MODE:
+    return 2;
+  case GL_ALPHA_BITS:
+  case GL_ALPHA_TEST:
+  case GL_ALPHA_TEST_FUNC:
+  case GL_ALPHA_TEST_REF:
+  case GL_ATTRIB_STACK_DEPTH:
+  case GL_BLEND:
+  case GL_BLEND_DST:
+  case GL_BLEND_SRC:
+  case GL_BLUE_BITS:
+  case GL_CULL_FACE:
+  case GL_CURRENT_RASTER_DISTANCE:
+  case GL_CURRENT_RASTER_POSITION_VALID:
+  case GL_DEPTH_BITS:
+  case GL_DEPTH_FUNC:
+  case GL_DEPTH_TEST:
+  case GL_DEPTH_WRITEMASK:
+  case GL_GREEN_BITS:
+  case GL_LIGHTING:
+  case GL_LINE_SMOOTH:
+  case GL_LINE_STIPPLE:
+  case GL_LINE_STIPPLE_PATTERN:
+  case GL_LINE_STIPPLE_REPEAT:
+  case GL_LINE_WIDTH:
+  case GL_LIST_INDEX:
+  case GL_LIST_MODE:
+  case GL_MATRIX_MODE:
+  case GL_MAX_ATTRIB_STACK_DEPTH:
+  case GL_MAX_CLIP_PLANES:
+  case GL_MAX_LIGHTS:
+  case GL_MAX_LIST_NESTING:
+  case GL_MAX_MODELVIEW_STACK_DEPTH:
+  case GL_MAX_NAME_STACK_DEPTH:
+  case GL_MAX_PROJECTION_STACK_DEPTH:
+  case GL_MAX_RENDERBUFFER_SIZE:
+  case GL_MAX_TEXTURE_SIZE:
+  case GL_MAX_TEXTURE_STACK_DEPTH:
+  case GL_MODELVIEW_STACK_DEPTH:
+  case GL_NAME_STACK_DEPTH:
+  case GL_NORMALIZE:
+  case GL_PACK_ALIGNMENT:
+  case GL_PACK_ROW_LENGTH:
+  case GL_POINT_SIZE:
+  case GL_POLYGON_OFFSET_FACTOR:
+  case GL_POLYGON_OFFSET_FILL:
+  case GL_POLYGON_OFFSET_LINE:
+  case GL_POLYGON_OFFSET_UNITS:
+  case GL_PROJECTION_STACK_DEPTH:
+  case GL_RED_BITS:
+  case GL_RENDER_MODE:
+  case GL_SAMPLE_BUFFERS:
+  case GL_SAMPLES:
+  case GL_SHADE_MODEL:
+  case GL_STENCIL_BITS:
+  case GL_TEXTURE_2D:
+  case GL_TEXTURE_BINDING_2D:
+  case GL_UNPACK_ALIGNMENT:
+  case GL_UNPACK_ROW_LENGTH:
+  case GL_ZOOM_X:
+  case GL_ZOOM_Y:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+std::size_t light_value_count(GLenum pname)
+{
+  switch (pname)
+  {
+  case GL_AMBIENT:
+  case GL_AMBIENT_AND_DIFFUSE:
+  case GL_DIFFUSE:
+  case GL_EMISSION:
+  case GL_POSITION:
+  case GL_SPECULAR:
+    return 4;
+  case GL_COLOR_INDEXES:
+  case GL_SPOT_DIRECTION:
+    return 3;
+  case GL_CONSTANT_ATTENUATION:
+  case GL_LINEAR_ATTENUATION:
+  case GL_QUADRATIC_ATTENUATION:
+  case GL_SHININESS:
+  case GL_SPOT_CUTOFF:
+  case GL_SPOT_EXPONENT:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+}  // namespace xeus_octave::tk::notebook
@@ -20,31 +20,45 @@
 #include <algorithm>
 #include <chrono>
 #include <cmath>
-#include <csetjmp>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <functional>
 #include <iostream>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <ostream>
 #include <string>
 #include <vector>
 
 #include "xeus-octave/opengl.hpp"
 
-#include <GLFW/glfw3.h>
 #include <nlohmann/json.hpp>
 #include <nlohmann/json_fwd.hpp>
+#include <octave/defun-int.h>
+#include <octave/error.h>
 #include <octave/gl-render.h>
 #include <octave/graphics-toolkit.h>
 #include <octave/graphics.h>
 #include <octave/interpreter.h>
+#include <octave/oct-map.h>
 #include <octave/ov.h>
-#include <png.h>
-#include <xeus/xbase64.hpp>
 
+#include "xeus-octave/base64.hpp"
+#include "xeus-octave/display_lists.hpp"
+#include "xeus-octave/figure_snapshot.hpp"
+#include "xeus-octave/figure_channel.hpp"
+#include "xeus-octave/hash.hpp"
+#include "xeus-octave/offscreen.hpp"
+#include "xeus-octave/opengl_remote.hpp"
+#include "xeus-octave/opengl_tiles.hpp"
+#include "xeus-octave/output.hpp"
 #include "xeus-octave/plotstream.hpp"
+#include "xeus-octave/png.hpp"
+#include "xeus-octave/publisher.hpp"
 #include "xeus-octave/tk_notebook.hpp"
+#include "xeus-octave/utils.hpp"
 #include "xeus-octave/xinterpreter.hpp"
 
 namespace nl = nlohmann;
@@ -57,104 +71,386 @@ namespace
 {
 
 /**
- * Encode a set of opengl pixels to a PNG stream stored in a std::vector
+ * Settings of the toolkit, changed with notebook_options
  */
-auto png_encode(std::vector<unsigned char>& data, unsigned int width, unsigned int height)
+struct toolkit_options
 {
-  // A RAII structure to manage the lifetime of PNG structures
-  struct PngManager
+  png_options png;
+  // Publish each frame at the next redraw (or at the end of the cell), so
+  // that its readback overlaps with the next render
+  bool async_readback = true;
+  // Draw the immediate mode primitives from client side arrays
+  bool batch_vertices = true;
+  // Replay the geometry of the objects which did not change from the
+  // display lists compiled in the previous redraws
+  bool display_lists = true;
+  // Maximum number of redraws per second of each figure (0 for no limit).
+  // Redraws coming faster are merged, and the last one happens at the
+  // latest at the end of the cell.
+  double max_fps = 0;
+  // Figures larger than this in pixels (or than what the driver supports,
+  // with 0) are drawn in tiles
+  int max_tile_size = 4096;
+  // Send a quarter resolution preview before the figures whose last render
+  // took longer than preview_ms (or which are very large)
+  bool preview = false;
+  double preview_ms = 300;
+  // Send the frames drawn while a cell runs over the figure channel, to the
+  // frontends listening to it
+  bool comm = true;
+  // Only send the tiles which changed in the frames sent over the figure
+  // channel
+  bool dirty_tiles = true;
+  // Number of threads drawing and encoding figure snapshots at once, each
+  // with its own context (0 to draw the figures on the interpreter thread)
+  int render_threads = 0;
+};
+
+toolkit_options& get_options()
+{
+  static toolkit_options options;
+  return options;
+}
+
+/**
+ * The statistics sent along with a frame (the time to publish it is not
+ * known yet)
+ */
+nl::json to_json(figure_stats const& stats)
+{
+  return {
+    {"render_us", stats.render_us},
+    {"readback_us", stats.readback_us},
+    {"encode_us", stats.encode_us},
+    {"bytes", stats.bytes},
+    {"pixels", stats.pixels},
+  };
+}
+
+// Size of the tiles compared between the frames sent over the comm
+constexpr int dirty_tile_size = 64;
+
+/**
+ * The hashes of the tiles of a frame, row by row from the bottom
+ */
+std::vector<std::uint64_t> tile_hashes(unsigned char const* pixels, int width, int height)
+{
+  auto const columns = (width + dirty_tile_size - 1) / dirty_tile_size;
+  auto const rows = (height + dirty_tile_size - 1) / dirty_tile_size;
+  auto const stride = static_cast<std::size_t>(width) * 3;
+  std::vector<std::uint64_t> hashes(static_cast<std::size_t>(columns) * static_cast<std::size_t>(rows));
+
+  for (int y = 0; y < height; ++y)
   {
-    png_structp png;
-    png_infop info;
+    auto const* row = pixels + static_cast<std::size_t>(y) * stride;
+    auto* hash = hashes.data() + static_cast<std::size_t>(y / dirty_tile_size) * static_cast<std::size_t>(columns);
 
-    PngManager()
+    // Each row of a tile is hashed with the hash of the previous ones as seed
+    for (int x = 0; x < width; x += dirty_tile_size, ++hash)
     {
-      png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-      info = png_create_info_struct(png);
+      auto const length = static_cast<std::size_t>(std::min(dirty_tile_size, width - x)) * 3;
+      *hash = utils::xxhash64(row + static_cast<std::size_t>(x) * 3, length, *hash);
     }
+  }
 
-    ~PngManager() { png_destroy_write_struct(&png, &info); }
-  };
+  return hashes;
+}
 
-  auto m = PngManager();
+/**
+ * The rectangles covering the tiles which differ between two frames of the
+ * same size, with the changed tiles of a row merged when they are contiguous
+ */
+std::vector<dirty_rect> changed_rects(
+  std::vector<std::uint64_t> const& before, std::vector<std::uint64_t> const& after, int width, int height
+)
+{
+  auto const columns = (width + dirty_tile_size - 1) / dirty_tile_size;
+  std::vector<dirty_rect> rects;
 
-  setjmp(png_jmpbuf(m.png));
+  for (std::size_t i = 0; i < after.size(); ++i)
+  {
+    if (before[i] == after[i])
+      continue;
 
-  png_set_IHDR(
-    m.png,
-    m.info,
-    width,
-    height,
-    8,
-    PNG_COLOR_TYPE_RGB,
-    PNG_INTERLACE_NONE,
-    PNG_COMPRESSION_TYPE_DEFAULT,
-    PNG_FILTER_TYPE_DEFAULT
-  );
+    auto const column = static_cast<int>(i % static_cast<std::size_t>(columns));
+    auto const row = static_cast<int>(i / static_cast<std::size_t>(columns));
+    auto const x = column * dirty_tile_size;
+    auto const y = row * dirty_tile_size;
+    auto const w = std::min(dirty_tile_size, width - x);
+    auto const h = std::min(dirty_tile_size, height - y);
 
-  std::vector<unsigned char*> rows(height);
-  for (std::size_t y = 0; y < height; y++)
-    rows[height - 1 - y] = data.data() + y * width * 3;
-  png_set_rows(m.png, m.info, &rows[0]);
+    if (column > 0 && !rects.empty() && rects.back().y == y && rects.back().x + rects.back().width == x)
+      rects.back().width += w;
+    else
+      rects.push_back(dirty_rect{x, y, w, h});
+  }
 
-  std::vector<char> out;
+  return rects;
+}
 
-  png_set_write_fn(
-    m.png,
-    &out,
-    [](png_structp png_, png_bytep d, png_size_t l)
-    {
-      std::vector<char>* img_ptr = static_cast<std::vector<char>*>(png_get_io_ptr(png_));
-      img_ptr->insert(img_ptr->end(), d, d + l);
-    },
-    nullptr
-  );
+/**
+ * Microseconds elapsed since start
+ */
+std::size_t microseconds_since(high_resolution_clock::time_point start)
+{
+  return static_cast<std::size_t>(duration_cast<microseconds>(high_resolution_clock::now() - start).count());
+}
 
-  png_write_png(m.png, m.info, PNG_TRANSFORM_IDENTITY, NULL);
+/**
+ * The toolkits whose frames are published at the end of each cell
+ */
+std::vector<glfw_graphics_toolkit const*>& toolkits()
+{
+  static std::vector<glfw_graphics_toolkit const*> t;
+  return t;
+}
 
-  return out;
+/**
+ * The publisher shared by all the figures
+ */
+figure_publisher& publisher()
+{
+  static figure_publisher p;
+  return p;
 }
 
-}  // namespace
+/**
+ * Native binding returning how many OpenGL contexts and framebuffers were
+ * created and reused by the toolkit
+ */
+octave_value_list notebook_gl_stats(octave_value_list const& args, int /*nargout*/)
+{
+  if (args.length() != 0)
+    print_usage();
+
+  auto const& stats = get_gl_stats();
+  octave_scalar_map result;
+
+  result.assign("contexts_created", static_cast<double>(stats.contexts_created));
+  result.assign("thread_contexts_created", static_cast<double>(stats.thread_contexts_created));
+  result.assign("contexts_reused", static_cast<double>(stats.contexts_reused));
+  result.assign("framebuffers_created", static_cast<double>(stats.framebuffers_created));
+  result.assign("framebuffers_reused", static_cast<double>(stats.framebuffers_reused));
+  result.assign("snapshots_drawn", static_cast<double>(stats.snapshots_drawn));
+  result.assign("init_microseconds", static_cast<double>(stats.init_microseconds));
+  result.assign("backend", stats.backend);
+
+  return ovl(result);
+}
 
-glfw_graphics_toolkit::glfw_graphics_toolkit(std::string const& nm) : octave::base_graphics_toolkit(nm)
+/**
+ * Native binding returning the timings and sizes of the last frame of each
+ * figure, or of the given figure
+ */
+octave_value_list figure_stats_binding(octave_value_list const& args, int /*nargout*/)
 {
-  glfwSetErrorCallback([](int error, char const* description)
-                       { std::clog << "GLFW Error: " << description << " (" << error << ")" << '\n'; });
+  if (args.length() > 1)
+    print_usage();
+
+  auto const all = args.length() == 0;
+  auto const figure = all ? 0 : args(0).xdouble_value("__figure_stats__: H must be a figure handle");
 
-  glfwInitHint(GLFW_COCOA_MENUBAR, GLFW_FALSE);
+  // The frames still being read back or encoded are accounted for
+  flush();
 
-  if (!glfwInit())
+  std::vector<figure_stats> found;
+  for (auto const* toolkit : toolkits())
+    for (auto const& stats : toolkit->stats())
+      if (all || stats.figure == figure)
+        found.push_back(stats);
+
+  if (!all && found.empty())
+    error("__figure_stats__: no frame was drawn for this figure");
+
+  // A struct array, with a single element for a single figure
+  octave_map result;
+  auto const field = [&](std::string const& name, auto get)
   {
-    std::clog << "Cannot initialize GLFW" << '\n';
-    return;
+    Cell values(1, static_cast<octave_idx_type>(found.size()));
+    for (std::size_t i = 0; i < found.size(); ++i)
+      values(static_cast<octave_idx_type>(i)) = static_cast<double>(get(found[i]));
+    result.assign(name, values);
+  };
+
+  field("figure", [](figure_stats const& s) { return s.figure; });
+  field("render_us", [](figure_stats const& s) { return s.render_us; });
+  field("readback_us", [](figure_stats const& s) { return s.readback_us; });
+  field("encode_us", [](figure_stats const& s) { return s.encode_us; });
+  field("publish_us", [](figure_stats const& s) { return s.publish_us; });
+  field("bytes", [](figure_stats const& s) { return s.bytes; });
+  field("pixels", [](figure_stats const& s) { return s.pixels; });
+
+  return ovl(result);
+}
+
+/**
+ * Native binding to get and set the options of the notebook toolkit:
+ * notebook_options() returns all of them, notebook_options(name) returns one
+ * and notebook_options(name, value) sets it
+ */
+octave_value_list notebook_options(octave_value_list const& args, int /*nargout*/)
+{
+  auto& options = get_options();
+  auto& png = options.png;
+
+  if (args.length() == 0)
+  {
+    octave_scalar_map result;
+
+    result.assign("png_backend", to_string(png.backend));
+    result.assign("png_preset", to_string(png.preset));
+    result.assign("async_readback", options.async_readback);
+    result.assign("batch_vertices", options.batch_vertices);
+    result.assign("display_lists", options.display_lists);
+    result.assign("max_fps", options.max_fps);
+    result.assign("max_tile_size", options.max_tile_size);
+    result.assign("preview", options.preview);
+    result.assign("preview_ms", options.preview_ms);
+    result.assign("comm", options.comm);
+    result.assign("dirty_tiles", options.dirty_tiles);
+    result.assign("render_threads", options.render_threads);
+
+    return ovl(result);
   }
 
-  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  if (args.length() > 2)
+    print_usage();
+
+  auto const name = args(0).xstring_value("notebook_options: NAME must be a string");
+  auto const set = args.length() == 2;
 
-  GLFWwindow* window = glfwCreateWindow(1, 1, "", NULL, NULL);
-  if (!window)
+  if (name == "png_backend")
   {
-    glfwTerminate();
-    return;
+    if (set && !from_string(args(1).xstring_value("notebook_options: VALUE must be a string"), png.backend))
+      error("notebook_options: png_backend must be \"libpng\" or \"zlib\"");
+
+    return ovl(to_string(png.backend));
   }
+  else if (name == "png_preset")
+  {
+    if (set && !from_string(args(1).xstring_value("notebook_options: VALUE must be a string"), png.preset))
+      error("notebook_options: png_preset must be \"fast\", \"balanced\" or \"small\"");
 
-  glfwMakeContextCurrent(window);
+    return ovl(to_string(png.preset));
+  }
+  else if (name == "async_readback")
+  {
+    if (set)
+      options.async_readback = args(1).xbool_value("notebook_options: async_readback must be a boolean");
 
-  gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress));
+    return ovl(options.async_readback);
+  }
+  else if (name == "batch_vertices")
+  {
+    if (set)
+      options.batch_vertices = args(1).xbool_value("notebook_options: batch_vertices must be a boolean");
 
-#ifndef NDEBUG
-  std::clog << "OpenGL vendor: " << glGetString(GL_VENDOR) << '\n';
-  std::clog << "OpenGL renderer: " << glGetString(GL_RENDERER) << '\n';
-  std::clog << "OpenGL version: " << glGetString(GL_VERSION) << '\n';
-#endif
+    return ovl(options.batch_vertices);
+  }
+  else if (name == "display_lists")
+  {
+    if (set)
+      options.display_lists = args(1).xbool_value("notebook_options: display_lists must be a boolean");
 
-  glfwDestroyWindow(window);
+    return ovl(options.display_lists);
+  }
+  else if (name == "max_fps")
+  {
+    if (set)
+    {
+      auto const fps = args(1).xdouble_value("notebook_options: max_fps must be a number");
+
+      if (!(fps >= 0))
+        error("notebook_options: max_fps must be positive, or 0 for no limit");
+
+      options.max_fps = fps;
+    }
+
+    return ovl(options.max_fps);
+  }
+  else if (name == "max_tile_size")
+  {
+    if (set)
+    {
+      auto const size = args(1).xint_value("notebook_options: max_tile_size must be an integer");
+
+      if (size < 0)
+        error("notebook_options: max_tile_size must be positive, or 0 for the driver limit");
+
+      options.max_tile_size = size;
+    }
+
+    return ovl(options.max_tile_size);
+  }
+  else if (name == "preview")
+  {
+    if (set)
+      options.preview = args(1).xbool_value("notebook_options: preview must be a boolean");
+
+    return ovl(options.preview);
+  }
+  else if (name == "preview_ms")
+  {
+    if (set)
+    {
+      auto const ms = args(1).xdouble_value("notebook_options: preview_ms must be a number");
+
+      if (!(ms >= 0))
+        error("notebook_options: preview_ms must be positive");
+
+      options.preview_ms = ms;
+    }
+
+    return ovl(options.preview_ms);
+  }
+  else if (name == "comm")
+  {
+    if (set)
+      options.comm = args(1).xbool_value("notebook_options: comm must be a boolean");
+
+    return ovl(options.comm);
+  }
+  else if (name == "dirty_tiles")
+  {
+    if (set)
+      options.dirty_tiles = args(1).xbool_value("notebook_options: dirty_tiles must be a boolean");
+
+    return ovl(options.dirty_tiles);
+  }
+  else if (name == "render_threads")
+  {
+    if (set)
+    {
+      auto const threads = args(1).xint_value("notebook_options: render_threads must be an integer");
+
+      if (threads < 0 || threads > 64)
+        error("notebook_options: render_threads must be between 0 and 64");
+
+      options.render_threads = threads;
+    }
+
+    return ovl(options.render_threads);
+  }
+
+  error("notebook_options: unknown option \"%s\"", name.c_str());
+}
+
+}  // namespace
+
+glfw_graphics_toolkit::glfw_graphics_toolkit(std::string const& nm) :
+  octave::base_graphics_toolkit(nm)
+{
+  toolkits().push_back(this);
 }
 
 glfw_graphics_toolkit::~glfw_graphics_toolkit()
 {
-  glfwTerminate();
+  toolkits().erase(std::find(toolkits().begin(), toolkits().end(), this));
+
+  // Pending jobs may still reference this toolkit and its buffers, and the
+  // render threads queue more of them
+  m_pool.reset();
+  publisher().flush();
 }
 
 bool glfw_graphics_toolkit::initialize(octave::graphics_object const& go)
@@ -165,15 +461,32 @@ bool glfw_graphics_toolkit::initialize(octave::graphics_object const& go)
     // Set the pixel ratio
     auto& figureProperties = dynamic_cast<octave::figure::properties&>(octave::graphics_object(go).get_properties());
 
-    // Get monitor scale
-    float xscale, yscale;
+    // The context is only created for the first figure, most kernels never
+    // plot anything. A render daemon draws the figures instead, if one is
+    // configured and reachable.
+    if (!m_context && !m_remote)
+    {
+      auto const* socket = std::getenv("XEUS_OCTAVE_RENDER_SOCKET");
 
-    if (auto* monitor = glfwGetPrimaryMonitor())
-      glfwGetMonitorContentScale(monitor, &xscale, &yscale);
-    else
-      xscale = yscale = 1;
+      if (socket && *socket)
+      {
+        m_remote = std::make_unique<remote_opengl_functions>(socket);
+
+        if (m_remote->is_valid())
+          get_gl_stats().backend = "daemon";
+        else
+        {
+          std::clog << "Cannot reach the render daemon at " << socket << ", drawing the figures locally" << '\n';
+          m_remote.reset();
+        }
+      }
+
+      if (!m_remote)
+        m_context = std::make_unique<offscreen_context>();
+    }
 
-    float dpr = std::max(xscale, yscale);
+    // Get monitor scale (the daemon has no monitor)
+    float dpr = !m_remote && has_local_context() ? m_context->content_scale() : 1;
 
 #ifndef NDEBUG
     std::clog << "Device pixel ratio: " << dpr << '\n';
@@ -189,6 +502,39 @@ bool glfw_graphics_toolkit::initialize(octave::graphics_object const& go)
 }
 
 void glfw_graphics_toolkit::redraw_figure(octave::graphics_object const& go) const
+{
+  auto const handle = go.get_handle().value();
+  auto const max_fps = get_options().max_fps;
+
+  if (max_fps > 0)
+  {
+    auto const now = steady_clock::now();
+    auto const last = m_last_redraws.find(handle);
+
+    // Too early: the figure will be drawn at the next redraw, or at the end
+    // of the cell, with its latest state
+    if (last != m_last_redraws.end() && now - last->second < duration<double>(1 / max_fps))
+    {
+      m_deferred.insert_or_assign(handle, go);
+
+      // In the meantime the frame read back at the last redraw can go
+      if (has_local_context())
+      {
+        m_context->make_current();
+        publish_pending();
+      }
+
+      return;
+    }
+
+    m_last_redraws[handle] = now;
+  }
+
+  m_deferred.erase(handle);
+  draw_figure(go);
+}
+
+void glfw_graphics_toolkit::draw_figure(octave::graphics_object const& go) const
 {
 #ifndef NDEBUG
   auto start = high_resolution_clock::now();
@@ -207,64 +553,723 @@ void glfw_graphics_toolkit::redraw_figure(octave::graphics_object const& go) con
   };
   auto const width = int_cast(figurePosition(2) * dpr);
   auto const height = int_cast(figurePosition(3) * dpr);
-  assert(width >= 0);
-  auto const uwidth = static_cast<unsigned int>(width);
-  assert(width >= 0);
-  auto const uheight = static_cast<unsigned int>(height);
+  assert(width >= 0 && height >= 0);
+
+  if (width == 0 || height == 0)
+    return;
+
+  if (m_remote)
+  {
+    if (draw_remote(go, width, height, dpr))
+      return;
+
+    // The figures which the daemon cannot draw are drawn locally, and all of
+    // them once the daemon is gone
+    if (!m_remote->is_valid())
+    {
+      std::clog << "Lost the render daemon, drawing the figures locally" << '\n';
+      m_remote.reset();
 
-  // Use the octave renderer to draw the plot on the EGL context
-  octave::opengl_functions m_glfcns;
-  octave::opengl_renderer m_renderer(m_glfcns);
+      // The display lists were in the context of the daemon
+      m_display_lists.clear();
+    }
+  }
+
+  if (!make_local_current())
+  {
+    std::clog << "No OpenGL context available, cannot draw the figure" << '\n';
+    return;
+  }
+
+  m_glfcns.set_batching(get_options().batch_vertices);
 
-  // Create a hidden GLFW window
-  auto window = glfwCreateWindow(width, height, "", NULL, NULL);
-  glfwMakeContextCurrent(window);
+  // Show a coarse version of the figures which take long to draw
+  if (needs_preview(go, width, height))
+    draw_preview(go, width, height, dpr);
+
+  // Figures larger than the framebuffers of the driver are drawn in tiles
+  auto const tile = max_tile_size();
+  if (width > tile || height > tile)
+  {
+    draw_tiled(go, width, height, dpr, tile);
+    return;
+  }
+
+  // Several figures can be drawn at once by the render threads
+  if (get_options().render_threads == 0)
+    m_pool.reset();
+  else if (draw_parallel(go, width, height, dpr))
+    return;
+
+  // Use the octave renderer to draw the plot on the offscreen context. The
+  // display lists are those of the render daemon, when there is one.
+  auto const cache = get_options().display_lists && !m_remote;
+  caching_renderer m_renderer(m_glfcns, cache ? &m_display_lists : nullptr, dpr);
+
+  // Draw on a framebuffer object of the right size
+  auto fb = m_framebuffers.acquire(width, height);
+  fb->bind();
 
   // Render
   m_renderer.set_viewport(width, height);
   m_renderer.set_device_pixel_ratio(dpr);
-#ifndef NDEBUG
   auto render_start = high_resolution_clock::now();
-#endif
+
+  if (!m_remote)
+    m_display_lists.begin(go.get_handle().value());
 
   m_renderer.draw(go);
+  m_glfcns.flush();
+
+  // Drop the lists of the objects which are gone
+  if (!m_remote)
+    m_display_lists.end(m_glfcns);
 
+  figure_stats stats;
+  stats.figure = go.get_handle().value();
+  stats.render_us = microseconds_since(render_start);
+  stats.pixels = static_cast<std::size_t>(width) * static_cast<std::size_t>(height);
+  m_render_costs[stats.figure] = static_cast<double>(stats.render_us) / static_cast<double>(stats.pixels);
 #ifndef NDEBUG
-  auto render_stop = high_resolution_clock::now();
-  auto render_duration = duration_cast<microseconds>(render_stop - render_start);
-  std::clog << "Render time: " << render_duration.count() << '\n';
+  std::clog << "Render time: " << stats.render_us << '\n';
 #endif
 
-  // Get pixels
-  auto screen = std::vector<unsigned char>(uwidth * uheight * 3);
-  glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, screen.data());
+  // Queue the readback of the pixels, in the buffer which is no more read
+  // by the job of the frame before the previous one
+  auto const buffer = m_next_buffer;
+  release_buffer(buffer);
+  auto const readback_start = high_resolution_clock::now();
+  m_buffers[buffer].read(width, height);
+  stats.readback_us = microseconds_since(readback_start);
+  m_next_buffer = 1 - buffer;
+
+  // Give back the framebuffer for the next redraw
+  framebuffer::unbind();
+  m_framebuffers.release(std::move(fb));
+
+  // The snapshots of the figure still queued on the render threads come first
+  flush_snapshots(stats.figure);
+
+  // The previous frame had the time of this render to be read back
+  publish_pending();
+  m_pending = pending_frame{getPlotStream<std::string>(go), width, height, dpr, get_options().png, buffer, stats};
+
+  if (!get_options().async_readback)
+    publish_pending();
 
 #ifndef NDEBUG
-  auto encode_start = high_resolution_clock::now();
+  auto stop = high_resolution_clock::now();
+  auto duration = duration_cast<microseconds>(stop - start);
+  std::clog << "Draw time: " << duration.count() << '\n';
 #endif
-  auto img = png_encode(screen, uwidth, uheight);
+}
+
+bool glfw_graphics_toolkit::draw_remote(
+  octave::graphics_object const& go, int width, int height, double dpr
+) const
+{
+  auto const option = get_options().max_tile_size;
+  auto const limit = option > 0 ? std::min(option, m_remote->max_size()) : m_remote->max_size();
+
+  // Larger figures are drawn locally, in tiles
+  if (width > limit || height > limit || !m_remote->begin_frame(width, height))
+    return false;
+
+  caching_renderer renderer(*m_remote, get_options().display_lists ? &m_display_lists : nullptr, dpr);
+
+  figure_stats stats;
+  stats.figure = go.get_handle().value();
+  stats.pixels = static_cast<std::size_t>(width) * static_cast<std::size_t>(height);
+
+  // The calls are buffered and sent to the daemon, which draws the frame
+  // while its pixels are awaited
+  auto const render_start = high_resolution_clock::now();
+  renderer.set_viewport(width, height);
+  renderer.set_device_pixel_ratio(dpr);
+
+  m_display_lists.begin(stats.figure);
+
+  try
+  {
+    renderer.draw(go);
+  }
+  catch (...)
+  {
+    // The daemon still waits for the end of the frame
+    std::vector<unsigned char> ignored;
+    m_remote->end_frame(ignored);
+    throw;
+  }
+
+  m_display_lists.end(*m_remote);
+  stats.render_us = microseconds_since(render_start);
+
+  auto const readback_start = high_resolution_clock::now();
+  std::vector<unsigned char> pixels;
+  if (!m_remote->end_frame(pixels) || pixels.size() != stats.pixels * 3)
+    return false;
+
+  stats.readback_us = microseconds_since(readback_start);
+  m_render_costs[stats.figure] =
+    static_cast<double>(stats.render_us + stats.readback_us) / static_cast<double>(stats.pixels);
+
+  // Keep the order of the frames, after the snapshots of the figure still
+  // queued on the render threads
+  flush_snapshots(stats.figure);
+  publish_pending();
+
+  publisher().submit(
+    [this,
+     id = getPlotStream<std::string>(go),
+     width,
+     height,
+     dpr,
+     options = get_options().png,
+     pixels = std::move(pixels),
+     stats,
+     delivery = current_delivery()]()
+    { publish_frame(id, pixels.data(), width, height, dpr, options, stats, delivery); }
+  );
+
+  return true;
+}
+
+bool glfw_graphics_toolkit::draw_parallel(
+  octave::graphics_object const& go, int width, int height, double dpr
+) const
+{
+  auto const threads = static_cast<std::size_t>(get_options().render_threads);
+
+  if (!m_pool || m_pool->threads() != threads)
+  {
+    // The snapshots still queued are drawn before the threads go
+    m_pool.reset();
+    m_pool = std::make_unique<render_pool>(threads, *m_context);
+  }
+
+  if (!m_pool->is_valid() || m_direct_figures.count(go.get_handle().value()))
+    return false;
+
+  figure_stats stats;
+  stats.figure = go.get_handle().value();
+  stats.pixels = static_cast<std::size_t>(width) * static_cast<std::size_t>(height);
+
+  // Only the opengl calls are recorded here, as the graphics objects cannot
+  // be read from the render threads. The display lists would live in the
+  // context of a single thread.
+  auto const render_start = high_resolution_clock::now();
+  snapshot_recorder recorder(m_pool->limits(), width, height);
+  caching_renderer renderer(recorder, nullptr, dpr);
+  renderer.set_viewport(width, height);
+  renderer.set_device_pixel_ratio(dpr);
+  renderer.draw(go);
+
+  if (!recorder.is_complete())
+  {
+    // The figure needs the pixels while it is drawn, it is drawn directly
+    // from now on, once its previous snapshots are done
+    m_direct_figures.insert(stats.figure);
+    m_pool->flush();
+    return false;
+  }
+
+  stats.render_us = microseconds_since(render_start);
+  m_render_costs[stats.figure] = static_cast<double>(stats.render_us) / static_cast<double>(stats.pixels);
+
+  // Keep the order of the frames
+  publish_pending();
+
+  m_pooled_figures.insert(stats.figure);
+  m_pool->submit(
+    std::hash<double>{}(stats.figure),
+    recorder.take(get_options().batch_vertices),
+    [this,
+     id = getPlotStream<std::string>(go),
+     width,
+     height,
+     dpr,
+     options = get_options().png,
+     stats,
+     delivery = current_delivery()](
+      std::vector<unsigned char>& pixels, std::size_t render_us, std::size_t readback_us
+    ) mutable
+    {
+      stats.render_us += render_us;
+      stats.readback_us = readback_us;
+
+      // The changed tiles are found on the publisher thread, which knows
+      // the last frame
+      if (delivery.live && delivery.comm && delivery.dirty_tiles)
+      {
+        publisher().submit(
+          [this, id, width, height, dpr, options, stats, delivery, pixels = std::move(pixels)]()
+          { publish_frame(id, pixels.data(), width, height, dpr, options, stats, delivery); }
+        );
+        return;
+      }
+
+      // Otherwise the frame is encoded here, along with the other figures
+      auto const current = frame{utils::xxhash64(pixels.data(), pixels.size()), width, height, dpr};
+      auto const encode_start = high_resolution_clock::now();
+      auto img =
+        png_encode(pixels.data(), static_cast<unsigned int>(width), static_cast<unsigned int>(height), options);
+      stats.encode_us = microseconds_since(encode_start);
+
+      publisher().submit(
+        [this, id, width, height, dpr, current, img = std::move(img), stats, delivery]() mutable
+        {
+          auto const last = m_last_frames.find(id);
+
+          if (last != m_last_frames.end() && last->second == current)
+          {
+            m_stats[id] = stats;
+            return;
+          }
+
+          stats.bytes = img.size();
+
+          auto const publish_start = high_resolution_clock::now();
+          send_figure(id, img, width, height, dpr, stats, delivery);
+          stats.publish_us = microseconds_since(publish_start);
+
+          m_last_frames[id] = current;
+          m_stats[id] = stats;
+        }
+      );
+    }
+  );
+
+  return true;
+}
+
+void glfw_graphics_toolkit::flush_snapshots(double figure) const
+{
+  if (!m_pool || m_pooled_figures.count(figure) == 0)
+    return;
+
+  m_pool->flush();
+  m_pooled_figures.clear();
+}
+
+void glfw_graphics_toolkit::draw_tiled(
+  octave::graphics_object const& go, int width, int height, double dpr, int tile
+) const
+{
+  auto const cache = get_options().display_lists && !m_remote;
+  caching_renderer renderer(m_glfcns, cache ? &m_display_lists : nullptr, dpr);
+  renderer.set_device_pixel_ratio(dpr);
+
+  // The figure is read back in bands of about 16M pixels, which are encoded
+  // while the next ones are drawn
+  auto const band_height = std::clamp((1 << 24) / width, 1, tile);
+  auto const stride = static_cast<std::size_t>(width) * 3;
+  auto encoder = std::make_shared<png_band_encoder>(
+    static_cast<unsigned int>(width), static_cast<unsigned int>(height), get_options().png
+  );
+
+  figure_stats stats;
+  stats.figure = go.get_handle().value();
+  stats.pixels = static_cast<std::size_t>(width) * static_cast<std::size_t>(height);
+
+  auto const render_start = high_resolution_clock::now();
+  if (!m_remote)
+    m_display_lists.begin(go.get_handle().value());
+
+  // The PNG starts with the top rows, which opengl stores last
+  for (int top = height; top > 0; top -= band_height)
+  {
+    auto const bottom = std::max(top - band_height, 0);
+    std::vector<unsigned char> band(stride * static_cast<std::size_t>(top - bottom));
+
+    for (int left = 0; left < width; left += tile)
+    {
+      auto const columns = std::min(tile, width - left);
+      auto fb = m_framebuffers.acquire(columns, top - bottom);
+      fb->bind();
+
+      // Everything but the first tile comes from the display lists
+      m_glfcns.set_tile(left, bottom, columns, top - bottom, width, height);
+      renderer.set_viewport(width, height);
+      renderer.draw(go);
+      m_glfcns.flush();
+
+      auto const readback_start = high_resolution_clock::now();
+      glPixelStorei(GL_PACK_ALIGNMENT, 1);
+      glPixelStorei(GL_PACK_ROW_LENGTH, width);
+      glReadPixels(0, 0, columns, top - bottom, GL_RGB, GL_UNSIGNED_BYTE, band.data() + left * 3);
+      glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+      stats.readback_us += microseconds_since(readback_start);
+
+      framebuffer::unbind();
+      m_framebuffers.release(std::move(fb));
+    }
+
+    encoder->add(std::move(band));
+  }
+
+  m_glfcns.reset_tile();
+  if (!m_remote)
+    m_display_lists.end(m_glfcns);
+
+  // The bands were read back and queued for encoding in between the tiles
+  stats.render_us = microseconds_since(render_start) - stats.readback_us;
+  m_render_costs[stats.figure] = static_cast<double>(stats.render_us) / static_cast<double>(stats.pixels);
+
+  // Keep the order of the frames, after the snapshots of the figure still
+  // queued on the render threads
+  flush_snapshots(stats.figure);
+  publish_pending();
+
+  publisher().submit(
+    [this, id = getPlotStream<std::string>(go), width, height, dpr, encoder, stats, delivery = current_delivery()]() mutable
+    {
+      // Most of the bands are already encoded
+      auto const encode_start = high_resolution_clock::now();
+      auto img = encoder->finish();
+      stats.encode_us = microseconds_since(encode_start);
+
+      // The pixels are never held at once, so the frame is identified by its
+      // encoding, which is deterministic
+      auto const current = frame{utils::xxhash64(img.data(), img.size()), width, height, dpr};
+      auto const last = m_last_frames.find(id);
+
+      if (last != m_last_frames.end() && last->second == current)
+      {
+        m_stats[id] = stats;
+        return;
+      }
+
+      stats.bytes = img.size();
+
+      auto const publish_start = high_resolution_clock::now();
+      send_figure(id, img, width, height, dpr, stats, delivery);
+      stats.publish_us = microseconds_since(publish_start);
+
+      m_last_frames[id] = current;
+      m_stats[id] = stats;
+    }
+  );
+}
+
+bool glfw_graphics_toolkit::needs_preview(octave::graphics_object const& go, int width, int height) const
+{
+  auto const& options = get_options();
+
+  if (!options.preview)
+    return false;
+
+  // Large figures take long to read back and encode, whatever their content
+  constexpr double large = 1 << 23;
+  auto const pixels = static_cast<double>(width) * height;
+  if (pixels >= large)
+    return true;
+
+  // Otherwise the cost of the last render tells how long this one will take
+  auto const cost = m_render_costs.find(go.get_handle().value());
+  return cost != m_render_costs.end() && cost->second * pixels >= options.preview_ms * 1000;
+}
+
+void glfw_graphics_toolkit::draw_preview(octave::graphics_object const& go, int width, int height, double dpr) const
+{
+  // A quarter of the resolution, which must fit in a single tile
+  auto const scale = std::min(0.25, static_cast<double>(max_tile_size()) / std::max(width, height));
+  auto const preview_width = std::max(static_cast<int>(width * scale), 1);
+  auto const preview_height = std::max(static_cast<int>(height * scale), 1);
+  auto const preview_dpr = dpr * preview_width / width;
+
+  // The display lists are compiled for the full resolution only
+  caching_renderer renderer(m_glfcns, nullptr, preview_dpr);
+
+  figure_stats stats;
+  stats.figure = go.get_handle().value();
+  stats.pixels = static_cast<std::size_t>(preview_width) * static_cast<std::size_t>(preview_height);
+  auto const render_start = high_resolution_clock::now();
+
+  auto fb = m_framebuffers.acquire(preview_width, preview_height);
+  fb->bind();
+
+  renderer.set_viewport(preview_width, preview_height);
+  renderer.set_device_pixel_ratio(preview_dpr);
+  renderer.draw(go);
+  m_glfcns.flush();
+  stats.render_us = microseconds_since(render_start);
+
+  // The preview is small, it is read back right away
+  auto const readback_start = high_resolution_clock::now();
+  std::vector<unsigned char> pixels(stats.pixels * 3);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, preview_width, preview_height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+  stats.readback_us = microseconds_since(readback_start);
+
+  framebuffer::unbind();
+  m_framebuffers.release(std::move(fb));
+
+  // Keep the order of the frames, after the snapshots of the figure still
+  // queued on the render threads
+  flush_snapshots(stats.figure);
+  publish_pending();
+
+  // The preview is always followed by the full resolution frame
+  auto delivery = current_delivery();
+  delivery.live = true;
+
+  publisher().submit(
+    [this,
+     id = getPlotStream<std::string>(go),
+     width = preview_width,
+     height = preview_height,
+     dpr = preview_dpr,
+     pixels = std::move(pixels),
+     options = get_options().png,
+     stats,
+     delivery]() mutable
+    {
+      options.preset = png_preset::fast;
+
+      auto const encode_start = high_resolution_clock::now();
+      auto img =
+        png_encode(pixels.data(), static_cast<unsigned int>(width), static_cast<unsigned int>(height), options);
+      stats.encode_us = microseconds_since(encode_start);
+      stats.bytes = img.size();
+
+      auto const publish_start = high_resolution_clock::now();
+      send_figure(id, img, width, height, dpr, stats, delivery);
+      stats.publish_us = microseconds_since(publish_start);
+      m_stats[id] = stats;
+
+      // The full resolution frame must replace the preview, even if it is
+      // the same as the last one
+      m_last_frames.erase(id);
+    }
+  );
+}
+
+frame_delivery glfw_graphics_toolkit::current_delivery() const
+{
+  return {!m_flushing, get_options().comm, get_options().dirty_tiles};
+}
+
+bool glfw_graphics_toolkit::make_local_current() const
+{
+  // Created on demand, when the render daemon cannot draw a figure
+  if (!m_context)
+    m_context = std::make_unique<offscreen_context>();
+
+  if (!m_context->is_valid())
+    return false;
+
+  m_context->make_current();
+  return true;
+}
+
+int glfw_graphics_toolkit::max_tile_size() const
+{
+  if (!m_max_tile_size)
+  {
+    std::array<GLint, 2> viewport = {};
+    GLint renderbuffer = 0;
+
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, viewport.data());
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &renderbuffer);
+
+    m_max_tile_size = std::max(std::min({viewport[0], viewport[1], renderbuffer}), 1);
+  }
+
+  auto const option = get_options().max_tile_size;
+
+  return option > 0 ? std::min(option, m_max_tile_size) : m_max_tile_size;
+}
+
+void glfw_graphics_toolkit::publish_pending() const
+{
+  if (!m_pending)
+    return;
+
+  auto pending = std::move(*m_pending);
+  m_pending.reset();
+
+  // Mapping waits for the end of the transfer
+  auto const readback_start = high_resolution_clock::now();
+  auto const* pixels = m_buffers[pending.buffer].map();
+  if (!pixels)
+    return;
+
+  pending.stats.readback_us += microseconds_since(readback_start);
+
+  auto& reader = m_readers[pending.buffer];
+
+  // Encoding and publishing happen on the publisher thread, which reads the
+  // mapped buffer until the job is done
+  reader = publisher().submit(
+    [this,
+     id = std::move(pending.id),
+     width = pending.width,
+     height = pending.height,
+     dpr = pending.dpr,
+     options = pending.options,
+     stats = pending.stats,
+     delivery = current_delivery(),
+     pixels]() { publish_frame(id, pixels, width, height, dpr, options, stats, delivery); }
+  );
+}
+
+void glfw_graphics_toolkit::publish_frame(
+  std::string const& id,
+  unsigned char const* pixels,
+  int width,
+  int height,
+  double dpr,
+  png_options const& options,
+  figure_stats stats,
+  frame_delivery delivery
+) const
+{
+  auto const size = static_cast<std::size_t>(width) * static_cast<std::size_t>(height) * 3;
+
+  // Skip figures whose pixels did not change since they were last sent
+  auto current = frame{utils::xxhash64(pixels, size), width, height, dpr};
+  auto const last = m_last_frames.find(id);
+
+  if (last != m_last_frames.end() && last->second == current)
+  {
+    m_stats[id] = stats;
+    return;
+  }
+
+  // Live frames sent over the figure channel may be sent as the tiles which
+  // changed since the last one
+  if (delivery.live && delivery.comm && delivery.dirty_tiles)
+  {
+    current.tiles = tile_hashes(pixels, width, height);
+
+    if (last != m_last_frames.end() && last->second.width == width && last->second.height == height &&
+        last->second.dpr == dpr && last->second.tiles.size() == current.tiles.size())
+    {
+      auto const rects = changed_rects(last->second.tiles, current.tiles, width, height);
+
+      std::size_t area = 0;
+      for (auto const& rect : rects)
+        area += static_cast<std::size_t>(rect.width) * static_cast<std::size_t>(rect.height);
+
+      // Beyond half of the frame, the whole of it compresses better
+      auto const publish_start = high_resolution_clock::now();
+      if (2 * area <= size / 3 && send_tiles(id, pixels, width, height, dpr, rects, options, stats))
+      {
+        stats.publish_us = microseconds_since(publish_start) - stats.encode_us;
+        m_last_frames[id] = std::move(current);
+        m_stats[id] = stats;
+        return;
+      }
+    }
+  }
+
+  auto const encode_start = high_resolution_clock::now();
+  auto img = png_encode(pixels, static_cast<unsigned int>(width), static_cast<unsigned int>(height), options);
+  stats.encode_us = microseconds_since(encode_start);
+  stats.bytes = img.size();
 #ifndef NDEBUG
-  auto encode_stop = high_resolution_clock::now();
-  auto encode_duration = duration_cast<microseconds>(encode_stop - encode_start);
-  std::clog << "Encode time: " << encode_duration.count() << '\n';
+  std::clog << "Encode time: " << stats.encode_us << '\n';
 #endif
+
+  auto const publish_start = high_resolution_clock::now();
+  send_figure(id, img, width, height, dpr, stats, delivery);
+  stats.publish_us = microseconds_since(publish_start);
 #ifndef NDEBUG
-  auto send_start = high_resolution_clock::now();
+  std::clog << "Send time: " << stats.publish_us << '\n';
 #endif
 
-  send_figure(go, img, width, height, dpr);
+  m_last_frames[id] = std::move(current);
+  m_stats[id] = stats;
+}
 
-#ifndef NDEBUG
-  auto send_stop = high_resolution_clock::now();
-  auto send_duration = duration_cast<microseconds>(send_stop - send_start);
-  std::clog << "Send time: " << send_duration.count() << '\n';
-  auto stop = high_resolution_clock::now();
-  auto duration = duration_cast<microseconds>(stop - start);
-  std::clog << "Draw time: " << duration.count() << '\n';
-#endif
+void glfw_graphics_toolkit::release_buffer(std::size_t buffer) const
+{
+  if (m_readers[buffer].valid())
+    m_readers[buffer].get();
 
-  // Destroy window
-  glfwDestroyWindow(window);
+  m_buffers[buffer].unmap();
+}
+
+std::vector<figure_stats> glfw_graphics_toolkit::stats() const
+{
+  std::vector<figure_stats> result;
+  result.reserve(m_stats.size());
+
+  for (auto const& [id, stats] : m_stats)
+    result.push_back(stats);
+
+  return result;
+}
+
+void glfw_graphics_toolkit::flush_frames() const
+{
+  m_flushing = true;
+
+  // The last state of the figures whose redraws were merged
+  auto const deferred = std::move(m_deferred);
+  m_deferred.clear();
+
+  for (auto const& [handle, go] : deferred)
+    draw_figure(go);
+
+  if (has_local_context())
+  {
+    // Mapping and unmapping need the context
+    m_context->make_current();
+
+    publish_pending();
+
+    for (std::size_t buffer = 0; buffer < m_buffers.size(); buffer++)
+      release_buffer(buffer);
+  }
+
+  m_flushing = false;
+
+  // The render threads queue the frames they draw on the publisher
+  if (m_pool)
+    m_pool->flush();
+
+  publisher().submit([this]() { frames_flushed(); });
+}
+
+void glfw_graphics_toolkit::update(octave::graphics_object const& go, int /*id*/)
+{
+  // The cached geometry of the object is no longer valid
+  m_display_lists.touch(go.get_handle().value());
+}
+
+void glfw_graphics_toolkit::finalize(octave::graphics_object const& go)
+{
+  if (!go.isa("figure"))
+    return;
+
+  m_deferred.erase(go.get_handle().value());
+  m_last_redraws.erase(go.get_handle().value());
+  m_render_costs.erase(go.get_handle().value());
+  m_direct_figures.erase(go.get_handle().value());
+  m_pooled_figures.erase(go.get_handle().value());
+
+  // The snapshots of the figure must not publish it once it is forgotten
+  if (m_pool)
+    m_pool->flush();
+
+  // Forget the last frame of the figure and its statistics, on the thread that owns them
+  publisher().submit(
+    [this, id = getPlotStream<std::string>(go)]()
+    {
+      m_last_frames.erase(id);
+      m_stats.erase(id);
+    }
+  );
+
+  if (m_remote)
+    m_display_lists.forget(go.get_handle().value(), *m_remote);
+  else if (has_local_context())
+  {
+    octave::opengl_functions glfcns;
+    m_context->make_current();
+    m_display_lists.forget(go.get_handle().value(), glfcns);
+  }
 }
 
 bool notebook_graphics_toolkit::initialize(octave::graphics_object const& go)
@@ -296,31 +1301,188 @@ void notebook_graphics_toolkit::show_figure(octave::graphics_object const& go) c
   // Display an empty figure (this is equivalent to the action of creating)
   // a window, and prepares a display with the correct display_id for
   // future updates
+  std::lock_guard<std::mutex> lock(io::publish_mutex());
   xeus::get_interpreter().display_data(
     nl::json(nl::json::value_t::object), nl::json(nl::json::value_t::object), {{"display_id", id}}
   );
 }
 
 void notebook_graphics_toolkit::send_figure(
-  octave::graphics_object const& go, std::vector<char> const& img, int width, int height, double dpr
+  std::string const& id,
+  std::vector<char> const& img,
+  int width,
+  int height,
+  double dpr,
+  figure_stats const& stats,
+  frame_delivery delivery
 ) const
 {
-  // Retrieve the figure id
-  std::string id = getPlotStream<std::string>(go);
+  auto& channel = io::get_figure_channel();
 
+  // The frames of animations go over the figure channel, if a frontend
+  // listens to it, as binary buffers
+  if (delivery.live && delivery.comm && channel.is_open())
+  {
+    // Make room for the frames in the display, instead of the previous image
+    if (m_streamed.find(id) == m_streamed.end())
+    {
+      auto const html = "<img id=\"xeus-octave-figure-" + id + "\" width=\"" +
+                        std::to_string(std::lround(width / dpr)) + "\" height=\"" +
+                        std::to_string(std::lround(height / dpr)) + "\">";
+
+      std::lock_guard<std::mutex> lock(io::publish_mutex());
+      xeus::get_interpreter().update_display_data(
+        {{"text/html", html}}, nl::json(nl::json::value_t::object), {{"display_id", id}}
+      );
+    }
+
+    nl::json message = {
+      {"type", "figure"},
+      {"display_id", id},
+      {"mimetype", "image/png"},
+      {"width", width / dpr},
+      {"height", height / dpr},
+      {"stats", to_json(stats)},
+    };
+
+    auto const generation = channel.generation();
+
+    if (channel.send(message, {img}))
+    {
+      m_streamed.insert_or_assign(id, streamed_frame{img, {}, {}, width, height, dpr, stats, generation});
+      return;
+    }
+  }
+
+  m_streamed.erase(id);
+  update_display(id, img, width, height, dpr, stats);
+}
+
+bool notebook_graphics_toolkit::send_tiles(
+  std::string const& id,
+  unsigned char const* pixels,
+  int width,
+  int height,
+  double dpr,
+  std::vector<dirty_rect> const& rects,
+  png_options const& options,
+  figure_stats& stats
+) const
+{
+  auto& channel = io::get_figure_channel();
+  auto const streamed = m_streamed.find(id);
+
+  // The frontends must have the previous frame to draw the tiles on it
+  if (streamed == m_streamed.end() || !channel.is_open())
+    return false;
+
+  if (streamed->second.generation != channel.generation())
+    return false;
+
+  auto const encode_start = high_resolution_clock::now();
+  auto const stride = static_cast<std::size_t>(width) * 3;
+
+  nl::json tiles = nl::json::array();
+  xeus::buffer_sequence buffers;
+  std::vector<unsigned char> tile;
+  stats.bytes = 0;
+
+  for (auto const& rect : rects)
+  {
+    auto const row_size = static_cast<std::size_t>(rect.width) * 3;
+    tile.resize(row_size * static_cast<std::size_t>(rect.height));
+
+    for (int y = 0; y < rect.height; ++y)
+    {
+      auto const* row = pixels + static_cast<std::size_t>(rect.y + y) * stride + static_cast<std::size_t>(rect.x) * 3;
+      std::copy(row, row + row_size, tile.data() + static_cast<std::size_t>(y) * row_size);
+    }
+
+    buffers.push_back(
+      png_encode(tile.data(), static_cast<unsigned int>(rect.width), static_cast<unsigned int>(rect.height), options)
+    );
+    stats.bytes += buffers.back().size();
+
+    // The frontend counts the rows from the top
+    tiles.push_back({
+      {"x", rect.x},
+      {"y", height - rect.y - rect.height},
+      {"width", rect.width},
+      {"height", rect.height},
+    });
+  }
+
+  stats.encode_us = microseconds_since(encode_start);
+
+  nl::json message = {
+    {"type", "tiles"},
+    {"display_id", id},
+    {"mimetype", "image/png"},
+    {"width", width / dpr},
+    {"height", height / dpr},
+    {"tiles", std::move(tiles)},
+    {"stats", to_json(stats)},
+  };
+
+  if (!channel.send(message, std::move(buffers)))
+    return false;
+
+  // Kept to be published in the display at the end of the cell
+  auto& last = streamed->second;
+  last.img.clear();
+  last.pixels.assign(pixels, pixels + stride * static_cast<std::size_t>(height));
+  last.options = options;
+  last.width = width;
+  last.height = height;
+  last.dpr = dpr;
+  last.stats = stats;
+
+  return true;
+}
+
+void notebook_graphics_toolkit::frames_flushed() const
+{
+  // The notebook only keeps the images of its displays
+  for (auto& [id, streamed] : m_streamed)
+  {
+    if (streamed.img.empty())
+    {
+      streamed.img = png_encode(
+        streamed.pixels.data(),
+        static_cast<unsigned int>(streamed.width),
+        static_cast<unsigned int>(streamed.height),
+        streamed.options
+      );
+    }
+
+    update_display(id, streamed.img, streamed.width, streamed.height, streamed.dpr, streamed.stats);
+  }
+
+  m_streamed.clear();
+}
+
+void notebook_graphics_toolkit::update_display(
+  std::string const& id, std::vector<char> const& img, int width, int height, double dpr, figure_stats const& stats
+) const
+{
   nl::json data, meta, tran;
 
-  data["image/png"] = xeus::base64encode(std::string(img.begin(), img.end()));
+  // Encode the image in place, in the string of the message
+  auto& png = data["image/png"] = std::string();
+  utils::base64_append(img.data(), img.size(), png.get_ref<std::string&>());
   // Send real width and height through metadata for optimal scaling
   meta["image/png"] = {
     {"width", width / dpr},
     {"height", height / dpr},
   };
+  // How long the figure took to produce
+  meta["image/png"]["stats"] = to_json(stats);
   // Dislplay id for updating existing display
   tran["display_id"] = id;
 
   // Update
-  xeus::get_interpreter().update_display_data(data, meta, tran);
+  std::lock_guard<std::mutex> lock(io::publish_mutex());
+  xeus::get_interpreter().update_display_data(std::move(data), std::move(meta), std::move(tran));
 }
 
 void register_all(octave::interpreter& interpreter)
@@ -328,6 +1490,18 @@ void register_all(octave::interpreter& interpreter)
   // Install the toolkit into the interpreter
   interpreter.get_gtk_manager().register_toolkit("notebook");
   interpreter.get_gtk_manager().load_toolkit(octave::graphics_toolkit(new notebook_graphics_toolkit()));
+
+  utils::add_native_binding(interpreter, "__notebook_gl_stats__", notebook_gl_stats);
+  utils::add_native_binding(interpreter, "__figure_stats__", figure_stats_binding);
+  utils::add_native_binding(interpreter, "notebook_options", notebook_options);
+}
+
+void flush()
+{
+  for (auto const* toolkit : toolkits())
+    toolkit->flush_frames();
+
+  publisher().flush();
 }
 
 }  // namespace xeus_octave::tk::notebook
@@ -20,16 +20,26 @@
 #include <algorithm>
 #include <cmath>
 #include <complex>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
 #include <iterator>
+#include <map>
+#include <mutex>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <nlohmann/json.hpp>
+#include <octave/defun-int.h>
+#include <octave/error.h>
 #include <octave/graphics-handle.h>
 #include <octave/graphics-toolkit.h>
 #include <octave/graphics.h>
 #include <octave/ov.h>
+#include <octave/oct-map.h>
 #include <octave/ovl.h>
 #include <octave/parse.h>
 #include <octave/quit.h>
@@ -38,15 +48,832 @@
 #include <octave/utils.h>
 #include <octave/version.h>
 
+#include "xeus-octave/base64.hpp"
+#include "xeus-octave/decimation.hpp"
+#include "xeus-octave/figure_channel.hpp"
+#include "xeus-octave/json_writer.hpp"
+#include "xeus-octave/output.hpp"
 #include "xeus-octave/plotstream.hpp"
 #include "xeus-octave/tex2html.hpp"
 #include "xeus-octave/tk_plotly.hpp"
+#include "xeus-octave/utils.hpp"
 
 namespace nl = nlohmann;
 
 namespace xeus_octave::tk::plotly
 {
 
+namespace
+{
+
+/**
+ * When the 2D and polar lines are drawn with WebGL rather than SVG
+ */
+enum class webgl_mode
+{
+  never,
+  automatic,
+  always,
+};
+
+std::string to_string(webgl_mode mode)
+{
+  switch (mode)
+  {
+  case webgl_mode::never:
+    return "never";
+  case webgl_mode::automatic:
+    return "auto";
+  case webgl_mode::always:
+    return "always";
+  }
+
+  return "";
+}
+
+bool from_string(std::string const& name, webgl_mode& mode)
+{
+  for (auto m : {webgl_mode::never, webgl_mode::automatic, webgl_mode::always})
+  {
+    if (to_string(m) == name)
+    {
+      mode = m;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Settings of the toolkit, changed with plotly_options
+ */
+struct toolkit_options
+{
+  // Send the trace data as base64 typed arrays, which plotly.js decodes
+  // since version 2.28, instead of JSON arrays of numbers
+  bool typed_arrays = true;
+  // Send the figures drawn while a cell runs over the figure channel, if a
+  // frontend listens to it, instead of display_data messages
+  bool comm = false;
+  // How the lines with many points per pixel column of their axes are
+  // decimated, in the figures sent over the figure channel only, whose
+  // frontends can ask for the points back
+  decimation line_decimation = decimation::minmax;
+  // Send only what changed in the figures sent over the figure channel
+  bool incremental = true;
+  // Draw the lines with WebGL, or only the figures with more points than
+  // webgl_points, which SVG draws too slowly
+  webgl_mode webgl = webgl_mode::automatic;
+  int webgl_points = 20000;
+};
+
+toolkit_options& get_options()
+{
+  static toolkit_options options;
+  return options;
+}
+
+/**
+ * Native binding to get and set the options of the plotly toolkit:
+ * plotly_options() returns all of them, plotly_options(name) returns one and
+ * plotly_options(name, value) sets it
+ */
+octave_value_list plotly_options(octave_value_list const& args, int /*nargout*/)
+{
+  auto& options = get_options();
+
+  if (args.length() == 0)
+  {
+    octave_scalar_map result;
+
+    result.assign("typed_arrays", options.typed_arrays);
+    result.assign("comm", options.comm);
+    result.assign("decimation", to_string(options.line_decimation));
+    result.assign("incremental", options.incremental);
+    result.assign("webgl", to_string(options.webgl));
+    result.assign("webgl_points", options.webgl_points);
+
+    return ovl(result);
+  }
+
+  if (args.length() > 2)
+    print_usage();
+
+  auto const name = args(0).xstring_value("plotly_options: NAME must be a string");
+  auto const set = args.length() == 2;
+
+  if (name == "typed_arrays")
+  {
+    if (set)
+      options.typed_arrays = args(1).xbool_value("plotly_options: typed_arrays must be a boolean");
+
+    return ovl(options.typed_arrays);
+  }
+  else if (name == "comm")
+  {
+    if (set)
+      options.comm = args(1).xbool_value("plotly_options: comm must be a boolean");
+
+    return ovl(options.comm);
+  }
+  else if (name == "decimation")
+  {
+    if (set && !from_string(args(1).xstring_value("plotly_options: VALUE must be a string"), options.line_decimation))
+      error("plotly_options: decimation must be \"none\", \"minmax\" or \"lttb\"");
+
+    return ovl(to_string(options.line_decimation));
+  }
+  else if (name == "incremental")
+  {
+    if (set)
+      options.incremental = args(1).xbool_value("plotly_options: incremental must be a boolean");
+
+    return ovl(options.incremental);
+  }
+  else if (name == "webgl")
+  {
+    if (set && !from_string(args(1).xstring_value("plotly_options: VALUE must be a string"), options.webgl))
+      error("plotly_options: webgl must be \"auto\", \"always\" or \"never\"");
+
+    return ovl(to_string(options.webgl));
+  }
+  else if (name == "webgl_points")
+  {
+    if (set)
+    {
+      auto const points = args(1).xint_value("plotly_options: webgl_points must be an integer");
+
+      if (points < 0)
+        error("plotly_options: webgl_points must be positive");
+
+      options.webgl_points = points;
+    }
+
+    return ovl(options.webgl_points);
+  }
+
+  error("plotly_options: unknown option \"%s\"", name.c_str());
+}
+
+/**
+ * Native binding publishing the figures sent over the figure channel in their
+ * displays, as done at the end of the cell, e.g. to time it
+ */
+octave_value_list plotly_flush(octave_value_list const& args, int /*nargout*/)
+{
+  if (args.length() != 0)
+    print_usage();
+
+  flush();
+
+  return ovl();
+}
+
+/**
+ * The shape of a matrix, as given to plotly typed arrays
+ */
+std::string shape(Matrix const& m)
+{
+  return std::to_string(m.rows()) + "," + std::to_string(m.cols());
+}
+
+/**
+ * The points of an array as plotly takes them, as a typed array unless
+ * disabled. Plotly takes the rows of the matrices first, while octave stores
+ * their columns first.
+ */
+nl::json to_json(trace::array const& array)
+{
+  auto const& m = array.data;
+  auto const size = static_cast<std::size_t>(m.numel());
+
+  if (get_options().typed_arrays)
+  {
+    Matrix const values = array.matrix ? m.transpose() : m;
+    nl::json result = {{"dtype", "f8"}, {"bdata", ""}};
+    utils::base64_append(values.data(), size * sizeof(double), result["bdata"].get_ref<std::string&>());
+
+    if (array.matrix)
+      result["shape"] = shape(m);
+
+    return result;
+  }
+
+  if (!array.matrix)
+    return std::vector<double>(m.data(), m.data() + size);
+
+  nl::json result = nl::json::array();
+
+  for (octave_idx_type i = 0; i < m.rows(); i++)
+  {
+    nl::json row = nl::json::array();
+
+    for (octave_idx_type j = 0; j < m.cols(); j++)
+      row.push_back(m(i, j));
+
+    result.push_back(std::move(row));
+  }
+
+  return result;
+}
+
+/**
+ * Write the points of an array like to_json does, without building any DOM
+ */
+void write(utils::json_writer& writer, trace::array const& array)
+{
+  auto const& m = array.data;
+  auto const size = static_cast<std::size_t>(m.numel());
+
+  if (get_options().typed_arrays)
+  {
+    if (array.matrix)
+      writer.typed_array(m.transpose().data(), size, shape(m));
+    else
+      writer.typed_array(m.data(), size);
+  }
+  else if (!array.matrix)
+    writer.number_array(m.data(), size);
+  else
+  {
+    writer.begin_array();
+
+    for (octave_idx_type i = 0; i < m.rows(); i++)
+    {
+      writer.begin_array();
+
+      for (octave_idx_type j = 0; j < m.cols(); j++)
+        writer.number(m(i, j));
+
+      writer.end_array();
+    }
+
+    writer.end_array();
+  }
+}
+
+/**
+ * Upper bound of the size of an array written with write
+ */
+std::size_t written_size(trace::array const& array)
+{
+  auto const bytes = static_cast<std::size_t>(array.data.numel()) * sizeof(double);
+  return array.name.size() + (get_options().typed_arrays ? utils::base64_size(bytes) + 64 : bytes * 3);
+}
+
+/**
+ * The figure as an application/vnd.plotly.v1+json document, moving the
+ * attributes and the layout into it
+ */
+nl::json to_json(std::vector<trace>& data, nl::json& layout)
+{
+  nl::json plot = {{"data", nl::json::array()}, {"layout", std::move(layout)}};
+
+  for (auto& t : data)
+  {
+    auto& trace = plot["data"].emplace_back(std::move(t.attributes));
+
+    for (auto const& array : t.arrays)
+      trace[array.name] = to_json(array);
+  }
+
+  return plot;
+}
+
+/**
+ * Write a trace, its attributes and then its arrays
+ */
+void write(utils::json_writer& writer, trace const& t)
+{
+  writer.begin_object();
+  writer.members(t.attributes);
+
+  for (auto const& array : t.arrays)
+  {
+    writer.key(array.name);
+    write(writer, array);
+  }
+
+  writer.end_object();
+}
+
+/**
+ * Upper bound of the size of a trace written with write
+ */
+std::size_t written_size(trace const& t)
+{
+  std::size_t size = 1024;
+
+  for (auto const& array : t.arrays)
+    size += written_size(array);
+
+  return size;
+}
+
+/**
+ * Write the figure like to_json does into a single buffer, sized from the
+ * number of points
+ */
+std::vector<char> write_figure(std::vector<trace> const& data, nl::json const& layout)
+{
+  // The attributes and the layout are small, the points take most of the room
+  std::size_t capacity = 4096;
+
+  for (auto const& t : data)
+    capacity += written_size(t);
+
+  utils::json_writer writer(capacity);
+
+  writer.begin_object();
+  writer.key("data");
+  writer.begin_array();
+
+  for (auto const& t : data)
+    write(writer, t);
+
+  writer.end_array();
+  writer.key("layout");
+  writer.value(layout);
+  writer.end_object();
+
+  return writer.take();
+}
+
+/**
+ * The last figure sent over the figure channel to a display, to send only
+ * what changes in the next ones
+ */
+struct sent_figure
+{
+  std::vector<trace> data;
+  nl::json layout;
+  // Generation of the figure channel it was sent in
+  std::size_t generation;
+};
+
+struct sent_figures
+{
+  std::mutex mutex;
+  std::map<std::string, sent_figure> figures;
+};
+
+sent_figures& get_sent()
+{
+  static sent_figures sent;
+  return sent;
+}
+
+/**
+ * Forget the last figure sent to a display, so that the next one is sent
+ * whole
+ */
+void forget_sent(std::string const& id)
+{
+  auto& sent = get_sent();
+  std::lock_guard<std::mutex> lock(sent.mutex);
+  sent.figures.erase(id);
+}
+
+/**
+ * Number of points appended to all the arrays of a trace since it was sent
+ * (0 when it did not change), or nothing if it must be sent again
+ */
+std::optional<std::size_t> appended_points(trace const& before, trace const& after)
+{
+  if (before.attributes != after.attributes || before.arrays.size() != after.arrays.size())
+    return std::nullopt;
+
+  std::optional<std::size_t> appended;
+
+  for (std::size_t i = 0; i < after.arrays.size(); i++)
+  {
+    auto const& old = before.arrays[i];
+    auto const& now = after.arrays[i];
+    auto const old_size = static_cast<std::size_t>(old.data.numel());
+    auto const new_size = static_cast<std::size_t>(now.data.numel());
+
+    if (old.name != now.name || old.matrix != now.matrix || new_size < old_size || (now.matrix && new_size != old_size))
+      return std::nullopt;
+
+    // The arrays of octave are shared until they are changed. The points are
+    // compared bitwise, to match the NaN.
+    if (old.data.data() != now.data.data() && old_size > 0 &&
+        std::memcmp(old.data.data(), now.data.data(), old_size * sizeof(double)) != 0)
+      return std::nullopt;
+
+    // The arrays of a trace must grow together
+    if (appended && *appended != new_size - old_size)
+      return std::nullopt;
+
+    appended = new_size - old_size;
+  }
+
+  return appended.value_or(0);
+}
+
+/**
+ * The last points of a vector
+ */
+Matrix tail(Matrix const& m, std::size_t points)
+{
+  auto const size = static_cast<std::size_t>(m.numel());
+  Matrix result(1, static_cast<octave_idx_type>(points));
+  std::copy(m.data() + (size - points), m.data() + size, result.fortran_vec());
+  return result;
+}
+
+/**
+ * Write what changed in a figure since it was last sent: the number of
+ * traces, the traces to replace, the points appended to the others, and the
+ * keys of the layout which changed (null if removed). Returns nothing if the
+ * figure did not change.
+ */
+std::vector<char> write_update(sent_figure const& last, std::vector<trace> const& data, nl::json const& layout)
+{
+  std::vector<std::size_t> replaced;
+  std::vector<std::pair<std::size_t, std::size_t>> extended;
+  nl::json changed = nl::json::object();
+  std::size_t capacity = 4096;
+
+  for (std::size_t i = 0; i < data.size(); i++)
+  {
+    auto const appended = i < last.data.size() ? appended_points(last.data[i], data[i]) : std::nullopt;
+
+    if (!appended)
+    {
+      replaced.push_back(i);
+      capacity += written_size(data[i]);
+    }
+    else if (*appended > 0)
+    {
+      extended.emplace_back(i, *appended);
+      capacity += 64 + data[i].arrays.size() * (*appended * sizeof(double) * 3 + 64);
+    }
+  }
+
+  for (auto const& [key, value] : layout.items())
+    if (!last.layout.contains(key) || last.layout[key] != value)
+      changed[key] = value;
+
+  for (auto const& [key, value] : last.layout.items())
+    if (!layout.contains(key))
+      changed[key] = nullptr;
+
+  if (replaced.empty() && extended.empty() && changed.empty() && data.size() == last.data.size())
+    return {};
+
+  utils::json_writer writer(capacity);
+
+  writer.begin_object();
+  writer.key("length");
+  writer.number(static_cast<double>(data.size()));
+
+  writer.key("traces");
+  writer.begin_array();
+
+  for (auto i : replaced)
+  {
+    writer.begin_array();
+    writer.number(static_cast<double>(i));
+    write(writer, data[i]);
+    writer.end_array();
+  }
+
+  writer.end_array();
+
+  writer.key("extend");
+  writer.begin_array();
+
+  for (auto const& [i, points] : extended)
+  {
+    writer.begin_array();
+    writer.number(static_cast<double>(i));
+    writer.begin_object();
+
+    for (auto const& array : data[i].arrays)
+    {
+      writer.key(array.name);
+      write(writer, trace::array{array.name, tail(array.data, points)});
+    }
+
+    writer.end_object();
+    writer.end_array();
+  }
+
+  writer.end_array();
+
+  writer.key("layout");
+  writer.value(changed);
+  writer.end_object();
+
+  return writer.take();
+}
+
+/**
+ * A decimated line, kept at full resolution to send the points shown when its
+ * axes are zoomed
+ */
+struct decimated_line
+{
+  std::size_t trace;
+  std::string axis;
+  // Range and scale of the axis when the figure was drawn
+  double lo;
+  double hi;
+  bool log;
+  std::size_t columns;
+  Matrix x;
+  Matrix y;
+};
+
+/**
+ * The decimated lines of the figures sent over the figure channel, by display
+ * id. They are looked up by the handler of the relayout messages.
+ */
+struct decimated_figures
+{
+  std::mutex mutex;
+  std::map<std::string, std::vector<decimated_line>> lines;
+};
+
+decimated_figures& get_decimated()
+{
+  static decimated_figures figures;
+  return figures;
+}
+
+trace::array const* find_array(trace const& t, std::string const& name)
+{
+  auto const found =
+    std::find_if(t.arrays.begin(), t.arrays.end(), [&name](auto const& array) { return array.name == name; });
+  return found == t.arrays.end() ? nullptr : &*found;
+}
+
+Matrix gather(Matrix const& m, std::vector<std::size_t> const& indices)
+{
+  Matrix result(1, static_cast<octave_idx_type>(indices.size()));
+
+  for (std::size_t i = 0; i < indices.size(); i++)
+    result(static_cast<octave_idx_type>(i)) = m(static_cast<octave_idx_type>(indices[i]));
+
+  return result;
+}
+
+/**
+ * Draw the 2D and polar lines of a figure with WebGL, if forced or if they
+ * have more points than the threshold once decimated. All the lines switch
+ * together, since plotly draws the WebGL traces above the SVG ones.
+ */
+void use_webgl(std::vector<trace>& data)
+{
+  auto const mode = get_options().webgl;
+  auto const is_svg = [](trace const& t)
+  {
+    auto const& type = t.attributes["type"];
+    return type == "scatter" || type == "scatterpolar";
+  };
+  std::size_t points = 0;
+
+  if (mode == webgl_mode::never)
+    return;
+
+  for (auto const& t : data)
+    if (is_svg(t) && !t.arrays.empty())
+      points += static_cast<std::size_t>(t.arrays.front().data.numel());
+
+  if (mode == webgl_mode::automatic && points <= static_cast<std::size_t>(get_options().webgl_points))
+    return;
+
+  for (auto& t : data)
+    if (is_svg(t))
+      t.attributes["type"] = t.attributes["type"].get<std::string>() + "gl";
+}
+
+/**
+ * Decimate the long lines of a figure sent over the figure channel to the
+ * resolution of their axes. The full resolution lines are kept for the
+ * frontend to ask for them, and for the end of the cell.
+ */
+void decimate_lines(std::string const& id, std::vector<trace>& data, nl::json const& layout)
+{
+  auto const method = get_options().line_decimation;
+  std::vector<decimated_line> lines;
+
+  for (std::size_t i = 0; i < data.size() && method != decimation::none; i++)
+  {
+    auto& t = data[i];
+    auto const columns = static_cast<std::size_t>(std::max(t.width, 0.0));
+    auto const* x = find_array(t, "x");
+    auto const* y = find_array(t, "y");
+
+    if (columns == 0 || !x || !y)
+      continue;
+
+    auto const size = static_cast<std::size_t>(x->data.numel());
+
+    // The lines with a few points per pixel column are left as they are
+    if (size <= 4 * columns || static_cast<std::size_t>(y->data.numel()) != size)
+      continue;
+
+    if (!is_increasing(x->data.data(), size))
+      continue;
+
+    auto const name = "xaxis" + t.attributes.value("xaxis", std::string("x")).substr(1);
+    auto const axis = layout.value(name, nl::json::object());
+    auto const range = axis.value("range", nl::json::array());
+    auto const log = axis.value("type", "") == "log";
+
+    if (range.size() != 2 || !range[0].is_number() || !range[1].is_number())
+      continue;
+
+    // The ranges of the log axes are given in powers of 10
+    auto lo = std::min(range[0].get<double>(), range[1].get<double>());
+    auto hi = std::max(range[0].get<double>(), range[1].get<double>());
+
+    if (log)
+    {
+      lo = std::pow(10.0, lo);
+      hi = std::pow(10.0, hi);
+    }
+
+    auto const indices = decimate(method, x->data.data(), y->data.data(), size, lo, hi, log, columns);
+
+    lines.push_back({i, name, lo, hi, log, columns, x->data, y->data});
+
+    for (auto& array : t.arrays)
+      if (static_cast<std::size_t>(array.data.numel()) == size)
+        array.data = gather(array.data, indices);
+  }
+
+  auto& decimated = get_decimated();
+  std::lock_guard<std::mutex> lock(decimated.mutex);
+
+  if (lines.empty())
+    decimated.lines.erase(id);
+  else
+    decimated.lines.insert_or_assign(id, std::move(lines));
+}
+
+/**
+ * Handle the ranges shown by a figure after a zoom, sent by the frontend as
+ * {"xaxis2": [lo, hi]} (null for the axes which were reset). The decimated
+ * lines are sent back at the resolution of the ranges, in the format of
+ * Plotly.restyle.
+ */
+void relayout(nl::json const& message)
+{
+  auto const id = message.value("display_id", std::string());
+  auto const ranges = message.value("ranges", nl::json::object());
+  std::vector<decimated_line> lines;
+
+  {
+    auto& decimated = get_decimated();
+    std::lock_guard<std::mutex> lock(decimated.mutex);
+    auto const found = decimated.lines.find(id);
+
+    if (found == decimated.lines.end())
+      return;
+
+    lines = found->second;
+  }
+
+  nl::json traces = nl::json::array();
+  std::vector<trace::array> xs;
+  std::vector<trace::array> ys;
+  std::size_t capacity = 64;
+
+  for (auto const& line : lines)
+  {
+    if (!ranges.is_object() || !ranges.contains(line.axis))
+      continue;
+
+    auto const& range = ranges[line.axis];
+    auto lo = line.lo;
+    auto hi = line.hi;
+
+    if (range.is_array() && range.size() == 2 && range[0].is_number() && range[1].is_number())
+    {
+      lo = std::min(range[0].get<double>(), range[1].get<double>());
+      hi = std::max(range[0].get<double>(), range[1].get<double>());
+
+      if (line.log)
+      {
+        lo = std::pow(10.0, lo);
+        hi = std::pow(10.0, hi);
+      }
+    }
+
+    // The points shown, and the ones next to them to draw the lines up to the
+    // edges of the axes
+    auto const* x = line.x.data();
+    auto const size = static_cast<std::size_t>(line.x.numel());
+    auto const first = static_cast<std::size_t>(std::lower_bound(x, x + size, lo) - x);
+    auto const last = static_cast<std::size_t>(std::upper_bound(x, x + size, hi) - x);
+    auto const begin = first > 0 ? first - 1 : 0;
+    auto const end = std::min(last + 1, size);
+
+    auto indices = decimate(
+      get_options().line_decimation, x + begin, line.y.data() + begin, end - begin, lo, hi, line.log, line.columns
+    );
+
+    for (auto& i : indices)
+      i += begin;
+
+    traces.push_back(line.trace);
+    xs.push_back({"x", gather(line.x, indices)});
+    ys.push_back({"y", gather(line.y, indices)});
+    capacity += written_size(xs.back()) + written_size(ys.back());
+  }
+
+  if (traces.empty())
+    return;
+
+  utils::json_writer writer(capacity);
+
+  writer.begin_object();
+
+  for (auto const* arrays : {&xs, &ys})
+  {
+    writer.key(arrays->front().name);
+    writer.begin_array();
+
+    for (auto const& array : *arrays)
+      write(writer, array);
+
+    writer.end_array();
+  }
+
+  writer.end_object();
+
+  xeus::buffer_sequence buffers;
+  buffers.push_back(writer.take());
+
+  io::get_figure_channel().send(
+    {{"type", "restyle"}, {"display_id", id}, {"traces", std::move(traces)}}, std::move(buffers)
+  );
+
+  // The lines of the frontend are no longer the ones sent last
+  forget_sent(id);
+}
+
+/**
+ * Put back the decimated lines of a figure at full resolution
+ */
+void restore_lines(std::string const& id, std::vector<trace>& data)
+{
+  auto& decimated = get_decimated();
+  std::lock_guard<std::mutex> lock(decimated.mutex);
+  auto const found = decimated.lines.find(id);
+
+  if (found == decimated.lines.end())
+    return;
+
+  for (auto const& line : found->second)
+  {
+    if (line.trace >= data.size())
+      continue;
+
+    for (auto& array : data[line.trace].arrays)
+      if (array.name == "x")
+        array.data = line.x;
+      else if (array.name == "y")
+        array.data = line.y;
+  }
+}
+
+/**
+ * Forget the decimated lines of a figure
+ */
+void forget_decimated(std::string const& id)
+{
+  auto& decimated = get_decimated();
+  std::lock_guard<std::mutex> lock(decimated.mutex);
+  decimated.lines.erase(id);
+}
+
+/**
+ * The toolkits loaded in the interpreter
+ */
+std::vector<plotly_graphics_toolkit const*>& toolkits()
+{
+  static std::vector<plotly_graphics_toolkit const*> t;
+  return t;
+}
+
+}  // namespace
+
+plotly_graphics_toolkit::plotly_graphics_toolkit(octave::interpreter& interp) :
+  base_graphics_toolkit("plotly"), m_interpreter(interp)
+{
+  toolkits().push_back(this);
+}
+
+plotly_graphics_toolkit::~plotly_graphics_toolkit()
+{
+  toolkits().erase(std::find(toolkits().begin(), toolkits().end(), this));
+}
+
 bool plotly_graphics_toolkit::initialize(octave::graphics_object const& go)
 {
   if (go.isa("figure"))
@@ -71,27 +898,28 @@ void plotly_graphics_toolkit::redraw_figure(octave::graphics_object const& go) c
     std::map<std::string, std::vector<unsigned long>> ids;
     auto& figureProperties = dynamic_cast<octave::figure::properties&>(octave::graphics_object(go).get_properties());
     Matrix figurePosition = figureProperties.get_position().matrix_value();
-    nl::json plot, output;
+    nl::json layout;
+    std::vector<trace> data;
 
     // Setting margins to 0 because octave positions its axes considering
     // the margins
-    plot["layout"]["margin"]["l"] = 0;
-    plot["layout"]["margin"]["r"] = 0;
-    plot["layout"]["margin"]["b"] = 0;
-    plot["layout"]["margin"]["t"] = 0;
+    layout["margin"]["l"] = 0;
+    layout["margin"]["r"] = 0;
+    layout["margin"]["b"] = 0;
+    layout["margin"]["t"] = 0;
 
     // Setting width and height properties
-    plot["layout"]["width"] = figurePosition(2);
-    plot["layout"]["height"] = figurePosition(3);
+    layout["width"] = figurePosition(2);
+    layout["height"] = figurePosition(3);
 
     // Tooltip on the closest point
-    plot["layout"]["hovermode"] = "closest";
+    layout["hovermode"] = "closest";
 
     // We draw manually the legend
-    plot["layout"]["showlegend"] = false;
+    layout["showlegend"] = false;
 
     // Background color
-    plot["layout"]["plot_bgcolor"] = "rgba(0,0,0,0)";
+    layout["plot_bgcolor"] = "rgba(0,0,0,0)";
 
     // Figures contain axes and hggroups (not implemented for now) as children
     for (auto ax : children(go))
@@ -119,32 +947,35 @@ void plotly_graphics_toolkit::redraw_figure(octave::graphics_object const& go) c
         if (!ax.get("tag").isempty() && ax.get("tag").string_value() == "polaraxes")
         {
           std::string p = "polar" + axNumber;
+          auto& polar = layout[p];
 
           // Setting domain, which is the position of the axis of the figure
           // (percentage)
-          plot["layout"][p]["domain"]["x"] = {axisPosition(0), axisPosition(0) + axisPosition(2)};
-          plot["layout"][p]["domain"]["y"] = {axisPosition(1), axisPosition(1) + axisPosition(3)};
+          polar["domain"]["x"] = {axisPosition(0), axisPosition(0) + axisPosition(2)};
+          polar["domain"]["y"] = {axisPosition(1), axisPosition(1) + axisPosition(3)};
 
           polarAxis(
-            plot["layout"][p]["radialaxis"], axisProperties.get("rtick").matrix_value(), axisProperties.get_fontsize()
+            polar["radialaxis"], axisProperties.get("rtick").matrix_value(), axisProperties.get_fontsize()
           );
 
           polarAxis(
-            plot["layout"][p]["angularaxis"], axisProperties.get("ttick").matrix_value(), axisProperties.get_fontsize()
+            polar["angularaxis"], axisProperties.get("ttick").matrix_value(), axisProperties.get_fontsize()
           );
         }
         else if (axisProperties.get_is2D())
         {
           std::string x = "xaxis" + axNumber;
           std::string y = "yaxis" + axNumber;
+          auto& xaxis = layout[x];
+          auto& yaxis = layout[y];
 
           // Setting domain, which is the position of the axis of the figure
           // (percentage)
-          plot["layout"][x]["domain"] = {axisPosition(0), axisPosition(0) + axisPosition(2)};
-          plot["layout"][y]["domain"] = {axisPosition(1), axisPosition(1) + axisPosition(3)};
+          xaxis["domain"] = {axisPosition(0), axisPosition(0) + axisPosition(2)};
+          yaxis["domain"] = {axisPosition(1), axisPosition(1) + axisPosition(3)};
 
           axis(
-            plot["layout"][x],
+            xaxis,
             axisProperties.is_visible(),
             axisProperties.get_xscale(),
             axisProperties.get_xaxislocation(),
@@ -167,7 +998,7 @@ void plotly_graphics_toolkit::redraw_figure(octave::graphics_object const& go) c
           );
 
           axis(
-            plot["layout"][y],
+            yaxis,
             axisProperties.is_visible(),
             axisProperties.get_yscale(),
             axisProperties.get_yaxislocation(),
@@ -191,7 +1022,7 @@ void plotly_graphics_toolkit::redraw_figure(octave::graphics_object const& go) c
 
           if (xlabel && xlabel.isa("text"))
             text(
-              plot["layout"][x]["title"],
+              xaxis["title"],
               xlabelProperties.get_string().string_value(),
               xlabelProperties.get_interpreter(),
               xlabelProperties.get_color_rgb(),
@@ -200,7 +1031,7 @@ void plotly_graphics_toolkit::redraw_figure(octave::graphics_object const& go) c
 
           if (ylabel && ylabel.isa("text"))
             text(
-              plot["layout"][y]["title"],
+              yaxis["title"],
               ylabelProperties.get_string().string_value(),
               ylabelProperties.get_interpreter(),
               ylabelProperties.get_color_rgb(),
@@ -208,28 +1039,29 @@ void plotly_graphics_toolkit::redraw_figure(octave::graphics_object const& go) c
             );
 
           // Anchoring each axis to the other
-          plot["layout"][x]["anchor"] = "y" + axNumber;
-          plot["layout"][y]["anchor"] = "x" + axNumber;
+          xaxis["anchor"] = "y" + axNumber;
+          yaxis["anchor"] = "x" + axNumber;
 
           if (isLegend)
           {
-            plot["layout"][x]["showspikes"] = false;
-            plot["layout"][y]["showspikes"] = false;
-            plot["layout"][x]["fixedrange"] = true;
-            plot["layout"][y]["fixedrange"] = true;
+            xaxis["showspikes"] = false;
+            yaxis["showspikes"] = false;
+            xaxis["fixedrange"] = true;
+            yaxis["fixedrange"] = true;
           }
         }
         else
         {
           std::string s = "scene" + axNumber;
+          auto& scene = layout[s];
 
           // Setting domain, which is the position of the axis of the figure
           // (percentage)
-          plot["layout"][s]["domain"]["x"] = {axisPosition(0), axisPosition(0) + axisPosition(2)};
-          plot["layout"][s]["domain"]["y"] = {axisPosition(1), axisPosition(1) + axisPosition(3)};
+          scene["domain"]["x"] = {axisPosition(0), axisPosition(0) + axisPosition(2)};
+          scene["domain"]["y"] = {axisPosition(1), axisPosition(1) + axisPosition(3)};
 
           axis(
-            plot["layout"][s]["xaxis"],
+            scene["xaxis"],
             axisProperties.is_visible(),
             axisProperties.get_xscale(),
             axisProperties.get_xaxislocation(),
@@ -250,7 +1082,7 @@ void plotly_graphics_toolkit::redraw_figure(octave::graphics_object const& go) c
           );
 
           axis(
-            plot["layout"][s]["yaxis"],
+            scene["yaxis"],
             axisProperties.is_visible(),
             axisProperties.get_yscale(),
             axisProperties.get_yaxislocation(),
@@ -271,7 +1103,7 @@ void plotly_graphics_toolkit::redraw_figure(octave::graphics_object const& go) c
           );
 
           axis(
-            plot["layout"][s]["zaxis"],
+            scene["zaxis"],
             axisProperties.is_visible(),
             axisProperties.get_zscale(),
             "none",
@@ -294,7 +1126,7 @@ void plotly_graphics_toolkit::redraw_figure(octave::graphics_object const& go) c
           // Adding labels
           if (xlabel && xlabel.isa("text"))
             text(
-              plot["layout"][s]["xaxis"]["title"],
+              scene["xaxis"]["title"],
               xlabelProperties.get_string().string_value(),
               xlabelProperties.get_interpreter(),
               xlabelProperties.get_color_rgb(),
@@ -303,7 +1135,7 @@ void plotly_graphics_toolkit::redraw_figure(octave::graphics_object const& go) c
 
           if (ylabel && ylabel.isa("text"))
             text(
-              plot["layout"][s]["yaxis"]["title"],
+              scene["yaxis"]["title"],
               ylabelProperties.get_string().string_value(),
               ylabelProperties.get_interpreter(),
               ylabelProperties.get_color_rgb(),
@@ -312,7 +1144,7 @@ void plotly_graphics_toolkit::redraw_figure(octave::graphics_object const& go) c
 
           if (zlabel && zlabel.isa("text"))
             text(
-              plot["layout"][s]["zaxis"]["title"],
+              scene["zaxis"]["title"],
               zlabelProperties.get_string().string_value(),
               zlabelProperties.get_interpreter(),
               zlabelProperties.get_color_rgb(),
@@ -320,17 +1152,16 @@ void plotly_graphics_toolkit::redraw_figure(octave::graphics_object const& go) c
             );
 
           // Set projection type
-          plot["layout"][s]["camera"]["projection"]["type"] = axisProperties.get_projection();
+          scene["camera"]["projection"]["type"] = axisProperties.get_projection();
         }
 
         // Axes contain line, text, patch, surface, image, and light objects.
         for (auto d : children(ax))
         {
-          unsigned long dNumber = plot["data"].size();
-
           if (d.isa("line"))
           {
             auto& lineProperties = dynamic_cast<octave::line::properties&>(d.get_properties());
+            auto& t = data.emplace_back();
             std::string type;
 
             // Set corresponding type and axes/scene
@@ -338,24 +1169,24 @@ void plotly_graphics_toolkit::redraw_figure(octave::graphics_object const& go) c
             {
               type = "scatterpolar";
 
-              plot["data"][dNumber]["subplot"] = "polar" + axNumber;
+              t.attributes["subplot"] = "polar" + axNumber;
             }
             else if (axisProperties.get_is2D())
             {
               type = "scatter";
 
-              plot["data"][dNumber]["xaxis"] = "x" + axNumber;
-              plot["data"][dNumber]["yaxis"] = "y" + axNumber;
+              t.attributes["xaxis"] = "x" + axNumber;
+              t.attributes["yaxis"] = "y" + axNumber;
             }
             else
             {
               type = "scatter3d";
 
-              plot["data"][dNumber]["scene"] = "scene" + axNumber;
+              t.attributes["scene"] = "scene" + axNumber;
             }
 
             line(
-              plot["data"][dNumber],
+              t,
               lineProperties.is_visible(),
               type,
               lineProperties.get_xdata().matrix_value(),
@@ -365,13 +1196,14 @@ void plotly_graphics_toolkit::redraw_figure(octave::graphics_object const& go) c
               lineProperties.get_linestyle(),
               lineProperties.get_color_rgb(),
               lineProperties.get_linewidth(),
-              lineProperties.get_markersize()
+              lineProperties.get_markersize(),
+              figurePosition(2) * axisPosition(2)
             );
 
             if (isLegend)
-              plot["data"][dNumber]["hoverinfo"] = "none";
+              t.attributes["hoverinfo"] = "none";
 
-            setLegendVisibility(plot["data"][dNumber], lineProperties.get_displayname());
+            setLegendVisibility(t.attributes, lineProperties.get_displayname());
           }
           else if (d.isa("surface"))
           {
@@ -385,10 +1217,11 @@ void plotly_graphics_toolkit::redraw_figure(octave::graphics_object const& go) c
             }
             else
             {
-              plot["data"][dNumber]["scene"] = "scene" + axNumber;
+              auto& t = data.emplace_back();
+              t.attributes["scene"] = "scene" + axNumber;
 
               surface(
-                plot["data"][dNumber],
+                t,
                 surfaceProperties.is_visible(),
                 surfaceProperties.get_xdata().matrix_value(),
                 surfaceProperties.get_ydata().matrix_value(),
@@ -398,7 +1231,7 @@ void plotly_graphics_toolkit::redraw_figure(octave::graphics_object const& go) c
                 surfaceProperties.get_clim().matrix_value()
               );
 
-              setLegendVisibility(plot["data"][dNumber], surfaceProperties.get_displayname());
+              setLegendVisibility(t.attributes, surfaceProperties.get_displayname());
             }
           }
           else if (d.isa("text"))
@@ -407,29 +1240,30 @@ void plotly_graphics_toolkit::redraw_figure(octave::graphics_object const& go) c
 
             Matrix textPosition = textProperties.get_position().matrix_value();
 
-            unsigned long aNumber = plot["layout"]["annotations"].size();
+            auto& annotations = layout["annotations"];
+            auto& annotation = annotations[annotations.size()];
 
-            plot["layout"]["annotations"][aNumber]["showarrow"] = false;
+            annotation["showarrow"] = false;
 
-            plot["layout"]["annotations"][aNumber]["xref"] = "x" + axNumber;
-            plot["layout"]["annotations"][aNumber]["yref"] = "y" + axNumber;
+            annotation["xref"] = "x" + axNumber;
+            annotation["yref"] = "y" + axNumber;
 
-            plot["layout"]["annotations"][aNumber]["x"] = textPosition(0);
-            plot["layout"]["annotations"][aNumber]["y"] = textPosition(1);
+            annotation["x"] = textPosition(0);
+            annotation["y"] = textPosition(1);
 
-            plot["layout"]["annotations"][aNumber]["xanchor"] = textProperties.get_horizontalalignment();
+            annotation["xanchor"] = textProperties.get_horizontalalignment();
 
             std::string valign = textProperties.get_verticalalignment();
 
             if (valign == "top" || valign == "cap")
-              plot["layout"]["annotations"][aNumber]["yanchor"] = "top";
+              annotation["yanchor"] = "top";
             else if (valign == "middle")
-              plot["layout"]["annotations"][aNumber]["yanchor"] = "middle";
+              annotation["yanchor"] = "middle";
             else if (valign == "baseline" || valign == "bottom")
-              plot["layout"]["annotations"][aNumber]["yanchor"] = "bottom";
+              annotation["yanchor"] = "bottom";
 
             text(
-              plot["layout"]["annotations"][aNumber],
+              annotation,
               textProperties.get_string().string_value(),
               textProperties.get_interpreter(),
               textProperties.get_color_rgb(),
@@ -444,6 +1278,7 @@ void plotly_graphics_toolkit::redraw_figure(octave::graphics_object const& go) c
           {
             auto components = children(d);
             auto& hggroupProperties = dynamic_cast<octave::hggroup::properties&>(d.get_properties());
+            auto& t = data.emplace_back();
 
             switch (components.size())
             {
@@ -458,18 +1293,18 @@ void plotly_graphics_toolkit::redraw_figure(octave::graphics_object const& go) c
                 {
                   type = "scatter";
 
-                  plot["data"][dNumber]["xaxis"] = "x" + axNumber;
-                  plot["data"][dNumber]["yaxis"] = "y" + axNumber;
+                  t.attributes["xaxis"] = "x" + axNumber;
+                  t.attributes["yaxis"] = "y" + axNumber;
                 }
                 else
                 {
                   type = "scatter3d";
 
-                  plot["data"][dNumber]["scene"] = "scene" + axNumber;
+                  t.attributes["scene"] = "scene" + axNumber;
                 }
 
                 line(
-                  plot["data"][dNumber],
+                  t,
                   hggroupProperties.is_visible(),
                   type,
                   lineProperties.get_xdata().matrix_value(),
@@ -485,21 +1320,23 @@ void plotly_graphics_toolkit::redraw_figure(octave::graphics_object const& go) c
                 // Fix markers: by default markers would be
                 // visible also on the bottom, so we make them
                 // transparent
-                std::string tempColor = plot["data"][dNumber]["line"]["color"];
-                std::string tempMarkerColor = plot["data"][dNumber]["marker"]["color"];
+                std::string tempColor = t.attributes["line"]["color"];
+                std::string tempMarkerColor = t.attributes["marker"]["color"];
+
+                auto& markerLineColors = t.attributes["marker"]["line"]["color"] = nl::json::array();
+                auto& markerColors = t.attributes["marker"]["color"] = nl::json::array();
 
-                plot["data"][dNumber]["marker"]["line"]["color"] = {};
-                plot["data"][dNumber]["marker"]["color"] = {};
+                auto const points = static_cast<std::size_t>(lineProperties.get_xdata().matrix_value().numel());
 
-                for (size_t i = 0; i < plot["data"][dNumber]["x"].size(); i += 3)
+                for (size_t i = 0; i < points; i += 3)
                 {
-                  plot["data"][dNumber]["marker"]["line"]["color"][i] = "rgba(0,0,0,0)";
-                  plot["data"][dNumber]["marker"]["line"]["color"][i + 1] = tempColor;
-                  plot["data"][dNumber]["marker"]["line"]["color"][i + 2] = "rgba(0,0,0,0)";
+                  markerLineColors.push_back("rgba(0,0,0,0)");
+                  markerLineColors.push_back(tempColor);
+                  markerLineColors.push_back("rgba(0,0,0,0)");
 
-                  plot["data"][dNumber]["marker"]["color"][i] = "rgba(0,0,0,0)";
-                  plot["data"][dNumber]["marker"]["color"][i + 1] = tempMarkerColor;
-                  plot["data"][dNumber]["marker"]["color"][i + 2] = "rgba(0,0,0,0)";
+                  markerColors.push_back("rgba(0,0,0,0)");
+                  markerColors.push_back(tempMarkerColor);
+                  markerColors.push_back("rgba(0,0,0,0)");
                 }
               }
               break;
@@ -507,18 +1344,13 @@ void plotly_graphics_toolkit::redraw_figure(octave::graphics_object const& go) c
               break;
             }
 
-            setLegendVisibility(plot["data"][dNumber], hggroupProperties.get_displayname());
+            setLegendVisibility(t.attributes, hggroupProperties.get_displayname());
           }
         }
       }
 
     // Show the newly created plot
-    nl::json data = nl::json::object();
-    data["application/vnd.plotly.v1+json"] = std::move(plot);
-
-    xeus::get_interpreter().update_display_data(
-      std::move(data), nl::json(nl::json::value_t::object), {{"display_id", id}}
-    );
+    send_figure(id, data, layout, figurePosition);
   }
 }
 
@@ -531,11 +1363,127 @@ void plotly_graphics_toolkit::show_figure(octave::graphics_object const& go) con
   // Display an empty figure (this is equivalent to the action of creating)
   // a window, and prepares a display with the correct display_id for
   // future updates
+  std::lock_guard<std::mutex> lock(io::publish_mutex());
   xeus::get_interpreter().display_data(
     nl::json(nl::json::value_t::object), nl::json(nl::json::value_t::object), {{"display_id", id}}
   );
 }
 
+void plotly_graphics_toolkit::finalize(octave::graphics_object const& go)
+{
+  if (!go.isa("figure"))
+    return;
+
+  auto const id = getPlotStream<std::string>(go);
+
+  m_streamed.erase(id);
+  forget_decimated(id);
+  forget_sent(id);
+}
+
+void plotly_graphics_toolkit::flush_figures() const
+{
+  auto& sent = get_sent();
+  std::lock_guard<std::mutex> sent_lock(sent.mutex);
+
+  // The figures keep their place in the display, with all their points, and
+  // the next cell makes room for them again
+  for (auto const& id : m_streamed)
+  {
+    auto const last = sent.figures.find(id);
+
+    if (last == sent.figures.end())
+      continue;
+
+    auto data = last->second.data;
+    auto layout = last->second.layout;
+
+    restore_lines(id, data);
+    use_webgl(data);
+
+    nl::json bundle = nl::json::object();
+    bundle["application/vnd.plotly.v1+json"] = to_json(data, layout);
+
+    std::lock_guard<std::mutex> lock(io::publish_mutex());
+    xeus::get_interpreter().update_display_data(
+      std::move(bundle), nl::json(nl::json::value_t::object), {{"display_id", id}}
+    );
+  }
+
+  m_streamed.clear();
+}
+
+void plotly_graphics_toolkit::send_figure(
+  std::string const& id, std::vector<trace>& data, nl::json& layout, Matrix const& position
+) const
+{
+  auto& channel = io::get_figure_channel();
+  auto const streamed = get_options().comm && channel.is_open();
+
+  // The frontends listening to the channel can ask for the lines at full
+  // resolution when their axes are zoomed, the others keep all the points
+  if (streamed)
+    decimate_lines(id, data, layout);
+  use_webgl(data);
+
+  // The figures go over the figure channel, if a frontend listens to it, as
+  // JSON documents written straight from the points
+  if (streamed)
+  {
+    auto& sent = get_sent();
+    std::lock_guard<std::mutex> sent_lock(sent.mutex);
+    auto const last = sent.figures.find(id);
+    auto const generation = channel.generation();
+    xeus::buffer_sequence buffers;
+    std::string type = "plotly";
+
+    // Only what changed is sent, once the frontends have the figure. The
+    // display keeps the figure if nothing did.
+    if (get_options().incremental && last != sent.figures.end() && last->second.generation == generation)
+    {
+      type = "update";
+      buffers.push_back(write_update(last->second, data, layout));
+
+      if (buffers.back().empty())
+        return;
+    }
+    else
+      buffers.push_back(write_figure(data, layout));
+
+    // Make room for the figure in the display
+    if (m_streamed.find(id) == m_streamed.end())
+    {
+      auto const html = "<div id=\"xeus-octave-figure-" + id + "\" style=\"width: " +
+                        std::to_string(std::lround(position(2))) + "px; height: " +
+                        std::to_string(std::lround(position(3))) + "px\"></div>";
+
+      std::lock_guard<std::mutex> lock(io::publish_mutex());
+      xeus::get_interpreter().update_display_data(
+        {{"text/html", html}}, nl::json(nl::json::value_t::object), {{"display_id", id}}
+      );
+    }
+
+    if (channel.send({{"type", type}, {"display_id", id}}, std::move(buffers)))
+    {
+      m_streamed.insert(id);
+      sent.figures.insert_or_assign(id, sent_figure{std::move(data), std::move(layout), generation});
+      return;
+    }
+  }
+
+  m_streamed.erase(id);
+  forget_decimated(id);
+  forget_sent(id);
+
+  nl::json bundle = nl::json::object();
+  bundle["application/vnd.plotly.v1+json"] = to_json(data, layout);
+
+  std::lock_guard<std::mutex> lock(io::publish_mutex());
+  xeus::get_interpreter().update_display_data(
+    std::move(bundle), nl::json(nl::json::value_t::object), {{"display_id", id}}
+  );
+}
+
 std::string plotly_graphics_toolkit::getObjectNumber(
   octave::graphics_object const& o, std::map<std::string, std::vector<unsigned long>>& ids
 ) const
@@ -849,7 +1797,7 @@ void plotly_graphics_toolkit::legend(
 }
 
 void plotly_graphics_toolkit::line(
-  nl::json& line,
+  trace& t,
   bool visible,
   std::string type,
   Matrix xdata,
@@ -859,9 +1807,16 @@ void plotly_graphics_toolkit::line(
   std::string lineStyle,
   Matrix lineColor,
   double lineWidth,
-  double markerSize
+  double markerSize,
+  double width
 ) const
 {
+  auto& line = t.attributes;
+
+  // The markers of the points would go missing
+  if (type == "scatter" && marker == "none")
+    t.width = width;
+
   line["type"] = type;
   line["visibility"] = visible;
   // TODO: marker color
@@ -932,73 +1887,52 @@ void plotly_graphics_toolkit::line(
     // In polar charts the points are in XY coordinates
     // so we need to convert them in polar coordinates
     // by ourselves
+    Matrix r(1, xdata.cols());
+    Matrix theta(1, xdata.cols());
+
     for (octave_idx_type i = 0; i < xdata.cols(); i++)
     {
       auto const vector = std::complex<double>(xdata(i), ydata(i));
-      auto const ui = static_cast<std::size_t>(i);
-      line["r"][ui] = std::abs(vector);
-      line["theta"][ui] = std::arg(vector);
+      r(i) = std::abs(vector);
+      theta(i) = std::arg(vector);
+    }
+
+    if (xdata.cols() > 0)
+    {
+      t.arrays.push_back({"r", r});
+      t.arrays.push_back({"theta", theta});
     }
     line["thetaunit"] = "radians";
   }
   else
   {
-    for (octave_idx_type i = 0; i < xdata.cols(); i++)
-    {
-      auto const ui = static_cast<std::size_t>(i);
-      line["x"][ui] = xdata(i);
-    }
-    for (octave_idx_type i = 0; i < ydata.cols(); i++)
-    {
-      auto const ui = static_cast<std::size_t>(i);
-      line["y"][ui] = ydata(i);
-    }
-    for (octave_idx_type i = 0; i < zdata.cols(); i++)
-    {
-      auto const ui = static_cast<std::size_t>(i);
-      line["z"][ui] = zdata(i);
-    }
+    if (xdata.cols() > 0)
+      t.arrays.push_back({"x", xdata});
+    if (ydata.cols() > 0)
+      t.arrays.push_back({"y", ydata});
+    if (zdata.cols() > 0)
+      t.arrays.push_back({"z", zdata});
   }
 }
 
 void plotly_graphics_toolkit::surface(
-  nl::json& surf, bool visible, Matrix xdata, Matrix ydata, Matrix zdata, Matrix cdata, Matrix colorMap, Matrix clim
+  trace& t, bool visible, Matrix xdata, Matrix ydata, Matrix zdata, Matrix cdata, Matrix colorMap, Matrix clim
 ) const
 {
+  auto& surf = t.attributes;
+
   surf["type"] = "surface";
   surf["visibility"] = visible;
 
-  for (octave_idx_type i = 0; i < xdata.cols(); i++)
-  {
-    auto const ui = static_cast<std::size_t>(i);
-    surf["x"][ui] = xdata(0, i);
-  }
-
-  for (octave_idx_type j = 0; j < ydata.rows(); j++)
-  {
-    auto const uj = static_cast<std::size_t>(j);
-    surf["y"][uj] = ydata(j, 0);
-  }
-
-  for (octave_idx_type i = 0; i < zdata.rows(); i++)
-  {
-    auto const ui = static_cast<std::size_t>(i);
-    for (octave_idx_type j = 0; j < zdata.cols(); j++)
-    {
-      auto const uj = static_cast<std::size_t>(j);
-      surf["z"][ui][uj] = zdata(i, j);
-    }
-  }
-
-  for (octave_idx_type i = 0; i < cdata.rows(); i++)
-  {
-    auto const ui = static_cast<std::size_t>(i);
-    for (octave_idx_type j = 0; j < cdata.cols(); j++)
-    {
-      auto const uj = static_cast<std::size_t>(j);
-      surf["surfacecolor"][ui][uj] = cdata(i, j);
-    }
-  }
+  // The first row of xdata and the first column of ydata
+  if (xdata.numel() > 0)
+    t.arrays.push_back({"x", Matrix(xdata.row(0))});
+  if (ydata.numel() > 0)
+    t.arrays.push_back({"y", Matrix(ydata.column(0))});
+  if (zdata.numel() > 0)
+    t.arrays.push_back({"z", zdata, true});
+  if (cdata.numel() > 0)
+    t.arrays.push_back({"surfacecolor", cdata, true});
 
   for (octave_idx_type i = 0; i < colorMap.rows(); i++)
   {
@@ -1049,6 +1983,17 @@ void register_all(octave::interpreter& interpreter)
   // Install the toolkit into the interpreter
   interpreter.get_gtk_manager().register_toolkit("plotly");
   interpreter.get_gtk_manager().load_toolkit(octave::graphics_toolkit(new plotly_graphics_toolkit(interpreter)));
+
+  utils::add_native_binding(interpreter, "plotly_options", plotly_options);
+  utils::add_native_binding(interpreter, "__plotly_flush__", plotly_flush);
+
+  io::get_figure_channel().on_message("relayout", relayout);
+}
+
+void flush()
+{
+  for (auto const* toolkit : toolkits())
+    toolkit->flush_figures();
 }
 
 }  // namespace xeus_octave::tk::plotly
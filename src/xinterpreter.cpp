@@ -23,6 +23,7 @@
 #include <cstring>
 #include <exception>
 #include <iostream>
+#include <mutex>
 #include <optional>
 #include <ostream>
 #include <regex>
@@ -55,6 +56,7 @@
 
 #include "xeus-octave/config.hpp"
 #include "xeus-octave/display.hpp"
+#include "xeus-octave/figure_channel.hpp"
 #include "xeus-octave/input.hpp"
 #include "xeus-octave/output.hpp"
 #include "xeus-octave/tk_plotly.hpp"
@@ -247,6 +249,27 @@ void fix_parse_error(std::string& evalue, std::string const& code, int line, int
   evalue = new_evalue.str();
 }
 
+/**
+ * Check if any figure had its properties (or the ones of its children)
+ * changed since it was last drawn. Octave marks modified objects and their
+ * ancestors, and drawnow clears the mark.
+ */
+bool figures_modified(octave::interpreter& interpreter)
+{
+  auto& gh_mgr = interpreter.get_gh_manager();
+  Matrix figures = gh_mgr.figure_handle_list(true);
+
+  for (octave_idx_type i = 0; i < figures.numel(); i++)
+  {
+    auto go = gh_mgr.get_object(figures(i));
+
+    if (go.valid_object() && go.get_properties().is_modified())
+      return true;
+  }
+
+  return false;
+}
+
 }  // namespace
 
 xoctave_interpreter::xoctave_interpreter()
@@ -416,8 +439,18 @@ void xoctave_interpreter::execute_request_impl(
     }
   }
 
-  // Update the figure if present
-  m_octave_interpreter.feval("drawnow");
+  // Update the figures changed by the cell, if any (drawnow only redraws
+  // the modified figures, but it is costly on its own)
+  if (figures_modified(m_octave_interpreter))
+    m_octave_interpreter.feval("drawnow");
+
+#ifndef __EMSCRIPTEN__
+  // The kernel must not go idle before the figures are published
+  xeus_octave::tk::notebook::flush();
+#endif
+
+  // As are the plotly figures which went over the figure channel
+  xeus_octave::tk::plotly::flush();
 
   cb(result);
 }
@@ -452,6 +485,9 @@ void xoctave_interpreter::configure_impl()
 
   m_octave_interpreter.get_output_system().page_screen_output(true);
 
+  // Let the frontends receive the figures over a comm
+  xeus_octave::io::get_figure_channel().register_target(comm_manager());
+
   // Register the graphics toolkits
 #ifndef __EMSCRIPTEN__
   xeus_octave::tk::notebook::register_all(m_octave_interpreter);
@@ -631,6 +667,7 @@ nl::json xoctave_interpreter::handle_exception(
   m_octave_interpreter.recover_from_exception();
   if (!silent)
   {
+    std::lock_guard<std::mutex> lock(io::publish_mutex());
     publish_execution_error(ename, evalue, traceback);
   }
   return xeus::create_error_reply(ename, evalue, traceback);
@@ -0,0 +1,25 @@
+# Check that the notebook toolkit options can be changed and are validated
+old = notebook_options("png_preset");
+notebook_options("png_preset", "fast");
+assert(strcmp(notebook_options("png_preset"), "fast"));
+notebook_options("png_preset", old);
+
+assert(islogical(notebook_options("async_readback")));
+assert(islogical(notebook_options("batch_vertices")));
+assert(islogical(notebook_options("display_lists")));
+assert(notebook_options("max_fps") >= 0);
+assert(notebook_options("max_tile_size") >= 0);
+assert(islogical(notebook_options("preview")));
+assert(notebook_options("preview_ms") >= 0);
+assert(islogical(notebook_options("comm")));
+assert(islogical(notebook_options("dirty_tiles")));
+assert(notebook_options("render_threads") >= 0);
+assert(isfield(notebook_options(), "png_backend"));
+
+failed = false;
+try
+  notebook_options("no_such_option");
+catch
+  failed = true;
+end
+assert(failed);
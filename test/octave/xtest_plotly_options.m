@@ -0,0 +1,40 @@
+# Check that the plotly toolkit options can be changed and are validated
+old = plotly_options("typed_arrays");
+plotly_options("typed_arrays", false);
+assert(!plotly_options("typed_arrays"));
+plotly_options("typed_arrays", old);
+
+assert(islogical(plotly_options("comm")));
+assert(islogical(plotly_options("incremental")));
+
+old = plotly_options("decimation");
+plotly_options("decimation", "lttb");
+assert(strcmp(plotly_options("decimation"), "lttb"));
+plotly_options("decimation", old);
+assert(isfield(plotly_options(), "typed_arrays"));
+
+old = plotly_options("webgl");
+plotly_options("webgl", "always");
+assert(strcmp(plotly_options("webgl"), "always"));
+plotly_options("webgl", old);
+
+old = plotly_options("webgl_points");
+plotly_options("webgl_points", 1000);
+assert(plotly_options("webgl_points") == 1000);
+plotly_options("webgl_points", old);
+
+failed = false;
+try
+  plotly_options("no_such_option");
+catch
+  failed = true;
+end
+assert(failed);
+
+failed = false;
+try
+  plotly_options("webgl", "sometimes");
+catch
+  failed = true;
+end
+assert(failed);
@@ -6,7 +6,18 @@
 # The full license is in the file LICENSE, distributed with this software.
 #############################################################################
 
+import base64
+import json
 import platform
+import shutil
+import socket
+import struct
+import subprocess
+import tempfile
+import time
+import unittest
+import uuid
+import zlib
 
 import jupyter_kernel_test
 import os
@@ -94,6 +105,289 @@ class KernelTests(jupyter_kernel_test.KernelTests):
 
         self.assertEqual(content0["transient"]["display_id"], content1["transient"]["display_id"])
 
+    def test_plot_notebook_context_reuse(self):
+        self.flush_channels()
+        self.execute_helper(code="graphics_toolkit notebook; plot([1 2 3])")
+
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="plot([3 2 1]); drawnow; s = __notebook_gl_stats__();"
+            " printf('%d %d %d', s.contexts_created, s.framebuffers_reused, s.init_microseconds)"
+        )
+
+        streams = [msg for msg in output_msgs if msg["msg_type"] == "stream"]
+        contexts_created, framebuffers_reused, init_microseconds = streams[0]["content"]["text"].split()
+        self.assertEqual(int(contexts_created), 1)
+        self.assertTrue(int(framebuffers_reused) > 0)
+        self.assertTrue(int(init_microseconds) > 0)
+
+    def test_plot_notebook_figure_stats(self):
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="graphics_toolkit notebook; f = figure(); plot(1:10); drawnow; s = __figure_stats__(f);"
+            " printf('%d %d %d', s.figure == f, s.bytes, s.pixels)"
+        )
+        self.assertEqual(reply["content"]["status"], "ok")
+
+        updates = [msg for msg in output_msgs if msg["msg_type"] == "update_display_data"]
+        stats = updates[-1]["content"]["metadata"]["image/png"]["stats"]
+        self.assertGreater(stats["bytes"], 0)
+        self.assertGreater(stats["pixels"], 0)
+        self.assertIn("render_us", stats)
+
+        streams = [msg for msg in output_msgs if msg["msg_type"] == "stream"]
+        same, size, pixels = streams[0]["content"]["text"].split()
+        self.assertEqual(int(same), 1)
+        self.assertEqual(int(size), stats["bytes"])
+        self.assertEqual(int(pixels), stats["pixels"])
+
+    def test_plot_notebook_unchanged(self):
+        self.flush_channels()
+        self.execute_helper(code="graphics_toolkit notebook; plot([1 2 3])")
+
+        # A cell not touching graphics must not redraw the figure
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(code="x = 1;")
+        self.assertEqual(reply["content"]["status"], "ok")
+        self.assertFalse(any(msg["msg_type"] == "update_display_data" for msg in output_msgs))
+
+    def test_plot_notebook_same_pixels(self):
+        self.flush_channels()
+        self.execute_helper(code="graphics_toolkit notebook; h = figure(); plot([1 2 3])")
+
+        # The figure is redrawn, but it looks the same so it is not sent again
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(code="set(h, 'name', 'renamed'); drawnow")
+        self.assertEqual(reply["content"]["status"], "ok")
+        self.assertFalse(any(msg["msg_type"] == "update_display_data" for msg in output_msgs))
+
+    def test_plot_notebook_display_lists(self):
+        self.flush_channels()
+        self.execute_helper(code="graphics_toolkit notebook; h = figure(); l = plot(rand(10, 2))")
+
+        # Only the first line is drawn again, the second one comes from its display list
+        self.execute_helper(code="set(l(1), 'ydata', rand(10, 1))")
+
+        # Drawing everything from scratch gives the same pixels, so nothing is sent
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="notebook_options('display_lists', false); set(h, 'name', 'uncached'); drawnow;"
+            " notebook_options('display_lists', true)"
+        )
+        self.assertEqual(reply["content"]["status"], "ok")
+        self.assertFalse(any(msg["msg_type"] == "update_display_data" for msg in output_msgs))
+
+    def test_plot_notebook_display_lists_lights(self):
+        self.flush_channels()
+        self.execute_helper(code="graphics_toolkit notebook; h = figure(); surf(peaks(20)); lt = light()")
+
+        # The surface is no longer lit, which its display list does not know
+        self.execute_helper(code="delete(lt)")
+
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="notebook_options('display_lists', false); set(h, 'name', 'uncached'); drawnow;"
+            " notebook_options('display_lists', true)"
+        )
+        self.assertEqual(reply["content"]["status"], "ok")
+        self.assertFalse(any(msg["msg_type"] == "update_display_data" for msg in output_msgs))
+
+    def test_plot_notebook_max_fps(self):
+        self.flush_channels()
+        self.execute_helper(code="graphics_toolkit notebook; figure(); l = plot(1:10)")
+
+        # The loop is faster than one frame per second: only the first and
+        # the last state are sent
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="notebook_options('max_fps', 1); for i = 1:20; set(l, 'ydata', rand(1, 10)); drawnow; end;"
+            " notebook_options('max_fps', 0)"
+        )
+        self.assertEqual(reply["content"]["status"], "ok")
+
+        updates = [msg for msg in output_msgs if msg["msg_type"] == "update_display_data"]
+        self.assertGreaterEqual(len(updates), 1)
+        self.assertLessEqual(len(updates), 3)
+
+    def test_plot_notebook_png_options(self):
+        self.flush_channels()
+        self.execute_helper(code="graphics_toolkit notebook; figure('position', [0 0 1600 1200]); plot(1:10)")
+
+        for backend in ["libpng", "zlib"]:
+            for preset in ["fast", "balanced", "small"]:
+                self.flush_channels()
+                reply, output_msgs = self.execute_helper(
+                    code=f"notebook_options('png_backend', '{backend}');"
+                    f" notebook_options('png_preset', '{preset}'); plot(rand(1, 10))"
+                )
+
+                updates = [msg for msg in output_msgs if msg["msg_type"] == "update_display_data"]
+                png = base64.b64decode(updates[-1]["content"]["data"]["image/png"])
+                self.assertEqual(png[:8], b"\x89PNG\r\n\x1a\n")
+
+                # The IDAT chunks, possibly deflated in parallel strips, must
+                # form a single valid zlib stream
+                idat, pos = b"", 8
+                while pos < len(png):
+                    length, kind = struct.unpack(">I4s", png[pos : pos + 8])
+                    if kind == b"IHDR":
+                        width, height, depth, color = struct.unpack(">IIBB", png[pos + 8 : pos + 18])
+                    elif kind == b"IDAT":
+                        idat += png[pos + 8 : pos + 8 + length]
+                    pos += length + 12
+
+                # A line plot has few colours, so it is written with a palette
+                self.assertEqual(color, 3)
+                self.assertEqual(len(zlib.decompress(idat)), height * (width + 1))
+
+        self.execute_helper(code="notebook_options('png_backend', 'zlib'); notebook_options('png_preset', 'balanced')")
+
+    def test_plot_notebook_tiles(self):
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="graphics_toolkit notebook; notebook_options('max_tile_size', 64);"
+            " figure('position', [0 0 300 200]); plot(1:10); drawnow; notebook_options('max_tile_size', 4096)"
+        )
+        self.assertEqual(reply["content"]["status"], "ok")
+
+        updates = [msg for msg in output_msgs if msg["msg_type"] == "update_display_data"]
+        png = base64.b64decode(updates[-1]["content"]["data"]["image/png"])
+
+        idat, pos = b"", 8
+        while pos < len(png):
+            length, kind = struct.unpack(">I4s", png[pos : pos + 8])
+            if kind == b"IHDR":
+                width, height, depth, color = struct.unpack(">IIBB", png[pos + 8 : pos + 18])
+            elif kind == b"IDAT":
+                idat += png[pos + 8 : pos + 8 + length]
+            pos += length + 12
+
+        # Tiled figures are encoded band by band, as RGB
+        self.assertEqual(color, 2)
+        self.assertEqual(len(zlib.decompress(idat)), height * (3 * width + 1))
+
+    def test_plot_notebook_preview(self):
+        self.flush_channels()
+        self.execute_helper(code="graphics_toolkit notebook; figure(); l = plot(1:10); drawnow")
+
+        # With a zero threshold, each redraw is preceded by its preview
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="notebook_options('preview', true); notebook_options('preview_ms', 0);"
+            " set(l, 'ydata', rand(1, 10)); drawnow; notebook_options('preview', false)"
+        )
+        self.assertEqual(reply["content"]["status"], "ok")
+
+        updates = [msg for msg in output_msgs if msg["msg_type"] == "update_display_data"]
+        self.assertEqual(len(updates), 2)
+
+        widths = []
+        for update in updates:
+            png = base64.b64decode(update["content"]["data"]["image/png"])
+            widths.append(struct.unpack(">I", png[16:20])[0])
+        self.assertLess(widths[0], widths[1])
+
+        self.execute_helper(code="notebook_options('preview_ms', 300)")
+
+    def test_plot_notebook_comm(self):
+        self.flush_channels()
+        self.execute_helper(code="graphics_toolkit notebook; figure(); l = plot(1:10)")
+
+        comm_id = uuid.uuid4().hex
+        self.kc.shell_channel.send(
+            self.kc.session.msg("comm_open", {"comm_id": comm_id, "target_name": "xeus-octave.figure", "data": {}})
+        )
+
+        # The frames drawn by the loop come over the comm, as binary buffers
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="for i = 1:3; set(l, 'ydata', rand(1, 10)); drawnow; end"
+        )
+        self.assertEqual(reply["content"]["status"], "ok")
+
+        frames = [msg for msg in output_msgs if msg["msg_type"] == "comm_msg"]
+        self.assertGreaterEqual(len(frames), 1)
+        self.assertEqual(frames[0]["content"]["data"]["type"], "figure")
+        self.assertEqual(bytes(frames[0]["buffers"][0])[:8], b"\x89PNG\r\n\x1a\n")
+
+        # While the notebook keeps the last one
+        updates = [msg for msg in output_msgs if msg["msg_type"] == "update_display_data"]
+        self.assertIn("image/png", updates[-1]["content"]["data"])
+
+        self.kc.shell_channel.send(self.kc.session.msg("comm_close", {"comm_id": comm_id, "data": {}}))
+
+    def test_plot_notebook_dirty_tiles(self):
+        self.flush_channels()
+        self.execute_helper(
+            code="graphics_toolkit notebook; figure(); plot(1:10); hold on; p = plot(1, 1, 'o'); axis([0 11 0 11])"
+        )
+
+        comm_id = uuid.uuid4().hex
+        self.kc.shell_channel.send(
+            self.kc.session.msg("comm_open", {"comm_id": comm_id, "target_name": "xeus-octave.figure", "data": {}})
+        )
+
+        # Only the marker moves: after the first frame, only the tiles around
+        # it are sent
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="for i = 1:4; set(p, 'xdata', i, 'ydata', i); drawnow; end"
+        )
+        self.assertEqual(reply["content"]["status"], "ok")
+
+        frames = [msg for msg in output_msgs if msg["msg_type"] == "comm_msg"]
+        self.assertEqual(frames[0]["content"]["data"]["type"], "figure")
+
+        tiles = [msg for msg in frames if msg["content"]["data"]["type"] == "tiles"]
+        self.assertGreaterEqual(len(tiles), 1)
+        self.assertEqual(len(tiles[0]["buffers"]), len(tiles[0]["content"]["data"]["tiles"]))
+        self.assertLess(sum(len(b) for b in tiles[0]["buffers"]), len(frames[0]["buffers"][0]))
+
+        self.kc.shell_channel.send(self.kc.session.msg("comm_close", {"comm_id": comm_id, "data": {}}))
+
+    def test_plot_notebook_render_threads(self):
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="graphics_toolkit notebook; notebook_options('render_threads', 2);"
+            " drawn = __notebook_gl_stats__().snapshots_drawn;"
+            " for i = 1:4; figure(); for j = 1:4; subplot(2, 2, j); plot(rand(10, 1) * i); end; end"
+        )
+        self.assertEqual(reply["content"]["status"], "ok")
+
+        updates = [msg for msg in output_msgs if msg["msg_type"] == "update_display_data"]
+        ids = {msg["content"]["transient"]["display_id"] for msg in updates}
+        self.assertEqual(len(ids), 4)
+        self.assertTrue(all(len(msg["content"]["data"]["image/png"]) > 0 for msg in updates))
+
+        # Each figure is drawn by one of the threads, rather than on the
+        # interpreter thread
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="s = __notebook_gl_stats__();"
+            " printf('%d %d %d', s.snapshots_drawn - drawn, s.contexts_created, s.thread_contexts_created)"
+        )
+        self.assertEqual(reply["content"]["status"], "ok")
+        snapshots, contexts, thread_contexts = output_msgs[0]["content"]["text"].split()
+        self.assertGreaterEqual(int(snapshots), 4)
+
+        # The contexts of the threads are counted apart from the main one
+        self.assertEqual(int(contexts), 1)
+        self.assertGreaterEqual(int(thread_contexts), 2)
+
+        # A figure grown beyond the tiles is drawn on the interpreter thread,
+        # after the frame queued on the render threads
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="notebook_options('max_tile_size', 256); f = figure('position', [0 0 200 150]); plot(1:10); drawnow;"
+            " set(f, 'position', [0 0 400 300]); drawnow; notebook_options('max_tile_size', 4096)"
+        )
+        self.assertEqual(reply["content"]["status"], "ok")
+
+        updates = [msg for msg in output_msgs if msg["msg_type"] == "update_display_data"]
+        self.assertEqual(updates[-1]["content"]["metadata"]["image/png"]["width"], 400)
+
+        self.execute_helper(code="notebook_options('render_threads', 0)")
+
     def test_plot_plotly(self):
         # On MacOS with conda-forge Octave, graphic commands show a FreeType warning
         # the first time
@@ -117,6 +411,215 @@ class KernelTests(jupyter_kernel_test.KernelTests):
 
         self.assertEqual(content0["transient"]["display_id"], content1["transient"]["display_id"])
 
+    def test_plot_plotly_typed_arrays(self):
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(code="graphics_toolkit plotly; plot(1:3, [4 5 6])")
+        self.assertEqual(reply["content"]["status"], "ok")
+
+        # The points are sent as little endian doubles
+        app = output_msgs[-1]["content"]["data"]["application/vnd.plotly.v1+json"]
+        x = app["data"][0]["x"]
+        self.assertEqual(x["dtype"], "f8")
+        self.assertEqual(struct.unpack("<3d", base64.b64decode(x["bdata"])), (1.0, 2.0, 3.0))
+
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="plotly_options('typed_arrays', false); plot(1:3, [4 5 6])"
+        )
+        self.execute_helper(code="plotly_options('typed_arrays', true)")
+
+        app = output_msgs[-1]["content"]["data"]["application/vnd.plotly.v1+json"]
+        self.assertEqual(app["data"][0]["y"], [4, 5, 6])
+
+    def test_plot_plotly_comm(self):
+        # Without any frontend listening to the figure channel, the figures are
+        # still sent as display_data
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="graphics_toolkit plotly; plotly_options('comm', true); plot(1:3, [4 5 6])"
+        )
+        self.execute_helper(code="plotly_options('comm', false)")
+        self.assertEqual(reply["content"]["status"], "ok")
+
+        app = output_msgs[-1]["content"]["data"]["application/vnd.plotly.v1+json"]
+        self.assertEqual(len(app["data"]), 1)
+        self.assertEqual(app["data"][0]["x"]["dtype"], "f8")
+
+    def test_plot_plotly_incremental(self):
+        comm_id = uuid.uuid4().hex
+        self.kc.shell_channel.send(
+            self.kc.session.msg("comm_open", {"comm_id": comm_id, "target_name": "xeus-octave.figure", "data": {}})
+        )
+
+        # The figure is first sent whole over the comm
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="graphics_toolkit plotly; plotly_options('comm', true); figure(); l = plot(1:10, 1:10)"
+        )
+        self.assertEqual(reply["content"]["status"], "ok")
+
+        messages = [msg for msg in output_msgs if msg["msg_type"] == "comm_msg"]
+        self.assertEqual(messages[0]["content"]["data"]["type"], "plotly")
+        figure = json.loads(bytes(messages[0]["buffers"][0]))
+        self.assertEqual(len(figure["data"]), 1)
+
+        # And published in its display at the end of the cell, for the
+        # notebook to keep it
+        updates = [msg for msg in output_msgs if msg["msg_type"] == "update_display_data"]
+        app = updates[-1]["content"]["data"]["application/vnd.plotly.v1+json"]
+        self.assertEqual(len(app["data"]), 1)
+
+        # Then only the points appended to the line
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(code="set(l, 'xdata', 1:12, 'ydata', 1:12); drawnow")
+        self.assertEqual(reply["content"]["status"], "ok")
+
+        messages = [msg for msg in output_msgs if msg["msg_type"] == "comm_msg"]
+        self.assertEqual(messages[-1]["content"]["data"]["type"], "update")
+        update = json.loads(bytes(messages[-1]["buffers"][0]))
+        self.assertEqual(update["traces"], [])
+        self.assertEqual(update["extend"][0][0], 0)
+        y = update["extend"][0][1]["y"]
+        self.assertEqual(struct.unpack("<2d", base64.b64decode(y["bdata"])), (11.0, 12.0))
+
+        updates = [msg for msg in output_msgs if msg["msg_type"] == "update_display_data"]
+        app = updates[-1]["content"]["data"]["application/vnd.plotly.v1+json"]
+        self.assertEqual(len(base64.b64decode(app["data"][0]["y"]["bdata"])) // 8, 12)
+
+        # A redraw which changes nothing, in a later cell, leaves the figure
+        # in its display
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(code="set(l, 'tag', 'unchanged'); drawnow")
+        self.assertEqual(reply["content"]["status"], "ok")
+
+        self.assertEqual([msg for msg in output_msgs if msg["msg_type"] == "comm_msg"], [])
+        updates = [msg for msg in output_msgs if msg["msg_type"] == "update_display_data"]
+        for update in updates:
+            self.assertIn("application/vnd.plotly.v1+json", update["content"]["data"])
+
+        # A frontend connecting later gets the whole figure again
+        other_id = uuid.uuid4().hex
+        self.kc.shell_channel.send(
+            self.kc.session.msg("comm_open", {"comm_id": other_id, "target_name": "xeus-octave.figure", "data": {}})
+        )
+
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(code="set(l, 'ydata', 12:-1:1); drawnow")
+        self.assertEqual(reply["content"]["status"], "ok")
+
+        messages = [msg for msg in output_msgs if msg["msg_type"] == "comm_msg"]
+        self.assertEqual(messages[-1]["content"]["data"]["type"], "plotly")
+
+        self.execute_helper(code="plotly_options('comm', false)")
+        for closed in [comm_id, other_id]:
+            self.kc.shell_channel.send(self.kc.session.msg("comm_close", {"comm_id": closed, "data": {}}))
+
+    def test_plot_plotly_relayout(self):
+        comm_id = uuid.uuid4().hex
+        self.kc.shell_channel.send(
+            self.kc.session.msg("comm_open", {"comm_id": comm_id, "target_name": "xeus-octave.figure", "data": {}})
+        )
+
+        # The long line goes decimated over the comm
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="graphics_toolkit plotly; plotly_options('comm', true); figure(); plot(1:1e5, sin((1:1e5) / 1e3))"
+        )
+        self.assertEqual(reply["content"]["status"], "ok")
+
+        messages = [msg for msg in output_msgs if msg["msg_type"] == "comm_msg"]
+        self.assertEqual(messages[0]["content"]["data"]["type"], "plotly")
+        display_id = messages[0]["content"]["data"]["display_id"]
+        figure = json.loads(bytes(messages[0]["buffers"][0]))
+        self.assertLess(len(base64.b64decode(figure["data"][0]["x"]["bdata"])) // 8, 5000)
+
+        # Zooming on its axes brings back the points shown, at full density
+        self.kc.shell_channel.send(
+            self.kc.session.msg(
+                "comm_msg",
+                {
+                    "comm_id": comm_id,
+                    "data": {"type": "relayout", "display_id": display_id, "ranges": {"xaxis": [1000, 1100]}},
+                },
+            )
+        )
+
+        while True:
+            msg = self.kc.get_iopub_msg(timeout=10)
+            if msg["msg_type"] == "comm_msg" and msg["content"]["data"]["type"] == "restyle":
+                break
+
+        self.assertEqual(msg["content"]["data"]["display_id"], display_id)
+        self.assertEqual(msg["content"]["data"]["traces"], [0])
+        update = json.loads(bytes(msg["buffers"][0]))
+        x = base64.b64decode(update["x"][0]["bdata"])
+        x = struct.unpack("<%dd" % (len(x) // 8), x)
+        self.assertEqual(x, tuple(float(i) for i in range(999, 1102)))
+
+        self.execute_helper(code="plotly_options('comm', false)")
+        self.kc.shell_channel.send(self.kc.session.msg("comm_close", {"comm_id": comm_id, "data": {}}))
+
+    def test_plot_plotly_decimation(self):
+        def count(array):
+            return len(base64.b64decode(array["bdata"])) // 8
+
+        # The figures sent as display_data keep all their points
+        self.flush_channels()
+        code = "plot(1:1e5, sin((1:1e5) / 1e3))"
+        reply, output_msgs = self.execute_helper(code="graphics_toolkit plotly; " + code)
+        self.assertEqual(reply["content"]["status"], "ok")
+        app = output_msgs[-1]["content"]["data"]["application/vnd.plotly.v1+json"]
+        self.assertEqual(count(app["data"][0]["y"]), 100000)
+
+        comm_id = uuid.uuid4().hex
+        self.kc.shell_channel.send(
+            self.kc.session.msg("comm_open", {"comm_id": comm_id, "target_name": "xeus-octave.figure", "data": {}})
+        )
+        self.execute_helper(code="plotly_options('comm', true)")
+
+        def points(code):
+            self.flush_channels()
+            reply, output_msgs = self.execute_helper(code="figure(); " + code)
+            self.assertEqual(reply["content"]["status"], "ok")
+            messages = [msg for msg in output_msgs if msg["msg_type"] == "comm_msg"]
+            figure = json.loads(bytes(messages[0]["buffers"][0]))
+            updates = [msg for msg in output_msgs if msg["msg_type"] == "update_display_data"]
+            app = updates[-1]["content"]["data"]["application/vnd.plotly.v1+json"]
+            self.execute_helper(code="close()")
+            return count(figure["data"][0]["y"]), count(app["data"][0]["y"])
+
+        # The long lines sent over the comm are reduced to a few points per
+        # pixel column, and published whole at the end of the cell
+        sent, published = points(code)
+        self.assertLess(sent, 5000)
+        self.assertEqual(published, 100000)
+        self.assertEqual(points("plotly_options('decimation', 'none'); " + code)[0], 100000)
+        self.assertLess(points("plotly_options('decimation', 'lttb'); " + code)[0], 5000)
+        self.execute_helper(code="plotly_options('decimation', 'minmax')")
+
+        # Except the lines with markers
+        self.assertEqual(points("plot(1:1e5, sin((1:1e5) / 1e3), 'o')")[0], 100000)
+
+        self.execute_helper(code="plotly_options('comm', false)")
+        self.kc.shell_channel.send(self.kc.session.msg("comm_close", {"comm_id": comm_id, "data": {}}))
+
+    def test_plot_plotly_webgl(self):
+        def trace_type(code):
+            self.flush_channels()
+            reply, output_msgs = self.execute_helper(code=code)
+            self.assertEqual(reply["content"]["status"], "ok")
+            return output_msgs[-1]["content"]["data"]["application/vnd.plotly.v1+json"]["data"][0]["type"]
+
+        # The figures with many points are drawn with WebGL
+        self.assertEqual(trace_type("graphics_toolkit plotly; plot(1:10)"), "scatter")
+        self.assertEqual(trace_type("plot(1:1e5, 'o')"), "scattergl")
+        self.assertEqual(trace_type("polar(1:1e5, 1:1e5, 'o')"), "scatterpolargl")
+
+        # Unless forced either way
+        self.assertEqual(trace_type("plotly_options('webgl', 'always'); plot(1:10)"), "scattergl")
+        self.assertEqual(trace_type("plotly_options('webgl', 'never'); plot(1:1e5, 'o')"), "scatter")
+        self.execute_helper(code="plotly_options('webgl', 'auto')")
+
     def test_issue_68(self):
         """
         This tests that parsing of code with multiple errors is actually stopped
@@ -147,3 +650,235 @@ class KernelTests(jupyter_kernel_test.KernelTests):
                     reply, output_msgs = self.execute_helper(code)
 
                     assert reply['content']['status'] == 'ok', code
+
+
+# Messages and opengl calls of the render daemon protocol, as numbered in
+# render_protocol.hpp
+RENDER_HELLO, RENDER_CALLS, RENDER_QUERY, RENDER_RESULT = 0, 1, 2, 3
+RENDER_BEGIN_FRAME, RENDER_END_FRAME, RENDER_PIXELS, RENDER_FAILURE = 4, 5, 6, 7
+
+GL_BITMAP_CALL, GL_CLEAR_COLOR, GL_CLEAR = 3, 6, 7
+GL_DRAW_PIXELS, GL_GET_ERROR, GL_GET_INTEGERV = 19, 29, 31
+GL_PIXEL_STOREI, GL_POP_ATTRIB, GL_PUSH_ATTRIB = 48, 52, 55
+
+GL_COLOR_BUFFER_BIT, GL_VIEWPORT, GL_UNPACK_ALIGNMENT = 0x4000, 0x0BA2, 0x0CF5
+GL_RGB, GL_RGBA, GL_UNSIGNED_BYTE, GL_FLOAT = 0x1907, 0x1908, 0x1401, 0x1406
+
+
+def start_render_daemon(path):
+    """Start xoctave-renderd on a socket, or skip the tests without it"""
+    renderd = shutil.which("xoctave-renderd")
+    if renderd is None:
+        raise unittest.SkipTest("xoctave-renderd is not installed")
+
+    daemon = subprocess.Popen([renderd, path])
+
+    for _ in range(100):
+        if os.path.exists(path):
+            return daemon
+        if daemon.poll() is not None:
+            raise unittest.SkipTest("xoctave-renderd cannot create an OpenGL context")
+        time.sleep(0.1)
+
+    daemon.kill()
+    raise unittest.SkipTest("xoctave-renderd does not listen")
+
+
+def gl_image(call, width, height, *args, data):
+    """A call taking an image, whose pixels are aligned on 8 bytes"""
+    message = struct.pack("=Bii", call, width, height) + struct.pack(*args) + struct.pack("=Q", len(data))
+    return message + bytes(-len(message) % 8) + data
+
+
+class RenderDaemonTests(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        cls.directory = tempfile.TemporaryDirectory()
+        cls.path = os.path.join(cls.directory.name, "renderd.sock")
+        cls.daemon = start_render_daemon(cls.path)
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.daemon.terminate()
+        cls.daemon.wait()
+        cls.directory.cleanup()
+
+    def connect(self):
+        client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        client.settimeout(10)
+        client.connect(self.path)
+        self.addCleanup(client.close)
+
+        self.send(client, RENDER_HELLO, struct.pack("=I", 1))
+        kind, payload = self.receive(client)
+        self.assertEqual(kind, RENDER_HELLO)
+        version, max_size = struct.unpack("=Ii", payload)
+        self.assertEqual(version, 1)
+        self.assertGreater(max_size, 0)
+
+        return client
+
+    def send(self, client, kind, payload=b""):
+        client.sendall(struct.pack("=II", kind, len(payload)) + payload)
+
+    def receive_all(self, client, size):
+        data = b""
+        while len(data) < size:
+            chunk = client.recv(size - len(data))
+            if not chunk:
+                return None
+            data += chunk
+        return data
+
+    def receive(self, client):
+        """The next message, or None once the daemon closed the connection"""
+        header = self.receive_all(client, 8)
+        if header is None:
+            return None, None
+        kind, size = struct.unpack("=II", header)
+        return kind, self.receive_all(client, size)
+
+    def query(self, client, calls):
+        self.send(client, RENDER_QUERY, calls)
+        return self.receive(client)
+
+    def assertServed(self, client):
+        self.assertEqual(self.query(client, struct.pack("=B", GL_GET_ERROR))[0], RENDER_RESULT)
+
+    def assertDropped(self, client):
+        self.assertEqual(self.receive(client), (None, None))
+
+    def test_plot_notebook_render_daemon_framing(self):
+        # A query is answered with the values of the parameter
+        client = self.connect()
+        kind, payload = self.query(client, struct.pack("=BI", GL_GET_INTEGERV, GL_VIEWPORT))
+        self.assertEqual(kind, RENDER_RESULT)
+        self.assertEqual(len(payload), 4 * 4)
+
+        # The messages larger than the limit or of unknown types are refused
+        oversized = self.connect()
+        oversized.sendall(struct.pack("=II", RENDER_CALLS, (1 << 30) + 1))
+        self.assertDropped(oversized)
+
+        unknown = self.connect()
+        self.send(unknown, 42)
+        self.assertDropped(unknown)
+
+        # As are the calls missing their arguments
+        truncated = self.connect()
+        self.send(truncated, RENDER_QUERY, struct.pack("=BH", GL_GET_INTEGERV, 0))
+        self.assertDropped(truncated)
+
+        # The parameters whose values are not known fail, but the connection
+        # goes on
+        self.assertEqual(self.query(client, struct.pack("=BI", GL_GET_INTEGERV, 0x12345))[0], RENDER_FAILURE)
+        self.assertServed(client)
+
+    def test_plot_notebook_render_daemon_pixel_sizes(self):
+        client = self.connect()
+        self.send(client, RENDER_BEGIN_FRAME, struct.pack("=ii", 8, 8))
+
+        # The rows of 3x2 RGB bytes are aligned on 4 bytes, except the last
+        self.send(client, RENDER_CALLS, gl_image(GL_DRAW_PIXELS, 3, 2, "=II", GL_RGB, GL_UNSIGNED_BYTE, data=bytes(21)))
+        self.assertServed(client)
+
+        # Or on the alignment set by the client
+        self.send(client, RENDER_CALLS, struct.pack("=BIi", GL_PIXEL_STOREI, GL_UNPACK_ALIGNMENT, 1))
+        self.send(client, RENDER_CALLS, gl_image(GL_DRAW_PIXELS, 3, 2, "=II", GL_RGB, GL_UNSIGNED_BYTE, data=bytes(18)))
+        self.send(client, RENDER_CALLS, gl_image(GL_DRAW_PIXELS, 2, 2, "=II", GL_RGBA, GL_FLOAT, data=bytes(64)))
+        # Bitmaps have one bit per pixel
+        self.send(client, RENDER_CALLS, gl_image(GL_BITMAP_CALL, 10, 2, "=ffff", 0, 0, 0, 0, data=bytes(4)))
+        self.assertServed(client)
+
+        self.send(client, RENDER_END_FRAME)
+        kind, pixels = self.receive(client)
+        self.assertEqual(kind, RENDER_PIXELS)
+        self.assertEqual(len(pixels), 8 * 8 * 3)
+
+        # The images shorter or longer than the pixels opengl reads are refused
+        for size in [0, 20, 22]:
+            wrong = self.connect()
+            self.send(wrong, RENDER_BEGIN_FRAME, struct.pack("=ii", 8, 8))
+            pixels = gl_image(GL_DRAW_PIXELS, 3, 2, "=II", GL_RGB, GL_UNSIGNED_BYTE, data=bytes(size))
+            self.send(wrong, RENDER_CALLS, pixels)
+            self.send(wrong, RENDER_END_FRAME)
+            self.assertDropped(wrong)
+
+    def test_plot_notebook_render_daemon_attributes(self):
+        # The attributes saved by the daemon cannot be popped by the clients
+        client = self.connect()
+        self.send(client, RENDER_BEGIN_FRAME, struct.pack("=ii", 8, 8))
+        self.send(client, RENDER_CALLS, struct.pack("=BI", GL_PUSH_ATTRIB, GL_COLOR_BUFFER_BIT))
+        self.send(client, RENDER_CALLS, struct.pack("=BB", GL_POP_ATTRIB, GL_POP_ATTRIB))
+        self.send(client, RENDER_END_FRAME)
+        self.assertDropped(client)
+
+    def test_plot_notebook_render_daemon_stalled_client(self):
+        def clear(red, green, blue):
+            color = struct.pack("=Bffff", GL_CLEAR_COLOR, red, green, blue, 1)
+            return color + struct.pack("=BI", GL_CLEAR, GL_COLOR_BUFFER_BIT)
+
+        # A client stops in the middle of a frame, and of a message
+        stalled = self.connect()
+        self.send(stalled, RENDER_BEGIN_FRAME, struct.pack("=ii", 4, 4))
+        self.send(stalled, RENDER_CALLS, clear(1, 0, 0))
+        self.assertServed(stalled)
+        query = struct.pack("=II", RENDER_QUERY, 1) + struct.pack("=B", GL_GET_ERROR)
+        stalled.sendall(query[:5])
+
+        # The others are still served
+        client = self.connect()
+        self.send(client, RENDER_BEGIN_FRAME, struct.pack("=ii", 4, 4))
+        self.send(client, RENDER_CALLS, clear(0, 1, 0))
+        self.send(client, RENDER_END_FRAME)
+        self.assertEqual(self.receive(client), (RENDER_PIXELS, bytes([0, 255, 0]) * 16))
+
+        # And the frame of the first client is drawn once it goes on
+        stalled.sendall(query[5:])
+        self.assertEqual(self.receive(stalled)[0], RENDER_RESULT)
+        self.send(stalled, RENDER_END_FRAME)
+        self.assertEqual(self.receive(stalled), (RENDER_PIXELS, bytes([255, 0, 0]) * 16))
+
+
+class RenderDaemonKernelTests(jupyter_kernel_test.KernelTests):
+    """The kernel drawing its figures through a render daemon"""
+
+    kernel_name = "xoctave"
+    language_name = "Octave"
+
+    @classmethod
+    def setUpClass(cls):
+        cls.directory = tempfile.TemporaryDirectory()
+        path = os.path.join(cls.directory.name, "renderd.sock")
+        cls.daemon = start_render_daemon(path)
+
+        os.environ["XEUS_OCTAVE_RENDER_SOCKET"] = path
+        try:
+            super().setUpClass()
+        finally:
+            del os.environ["XEUS_OCTAVE_RENDER_SOCKET"]
+
+    @classmethod
+    def tearDownClass(cls):
+        super().tearDownClass()
+        cls.daemon.terminate()
+        cls.daemon.wait()
+        cls.directory.cleanup()
+
+    def test_plot_notebook_render_daemon(self):
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="graphics_toolkit notebook; plot(1:10); drawnow; disp(__notebook_gl_stats__().backend)"
+        )
+        self.assertEqual(reply["content"]["status"], "ok")
+
+        streams = [msg for msg in output_msgs if msg["msg_type"] == "stream"]
+        self.assertEqual(streams[0]["content"]["text"].strip(), "daemon")
+
+        updates = [msg for msg in output_msgs if msg["msg_type"] == "update_display_data"]
+        self.assertGreater(len(updates), 0)
+        self.assertTrue(all(len(msg["content"]["data"]["image/png"]) > 0 for msg in updates))
+
+        # The daemon is still there
+        self.assertIsNone(self.daemon.poll())